@@ -0,0 +1,190 @@
+//----------------------------------------------------------------------
+//	File:			ANNdistT.h
+//	Programmer:		Sunil Arya and David Mount
+//	Description:	Distance kernels templated on coordinate type
+//----------------------------------------------------------------------
+// Copyright (c) 1997-2005 University of Maryland and Sunil Arya and
+// David Mount.  All Rights Reserved.
+//
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//
+// The University of Maryland (U.M.) and the authors make no
+// representations about the suitability or fitness of this software for
+// any purpose.  It is provided "as is" without express or implied
+// warranty.
+//----------------------------------------------------------------------
+//	History:
+//	Revision 1.0.c  (char version)
+//		Squared distance kernels for unsigned char, unsigned short and
+//		float coordinates, with SSE2 versions where available.
+//----------------------------------------------------------------------
+
+#ifndef ANNdistT_H
+#define ANNdistT_H
+
+#include <ANN/ANN.h>					// basic ANN includes
+
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>					// SSE2 intrinsics
+#endif
+
+namespace ann_1_1_char
+{
+
+//----------------------------------------------------------------------
+//	ANNcoordTraits
+//		Maps a coordinate type to the type used for squared distances.
+//		The distance type must hold the squared distance between any
+//		two points of up to 128 dimensions exactly (for integer types)
+//		and must be signed, since the kd-tree uses differences of
+//		coordinates.
+//----------------------------------------------------------------------
+
+template <class Coord> struct ANNcoordTraits;
+
+template <> struct ANNcoordTraits<unsigned char> {
+	typedef int			Dist;			// 128 * 255^2 fits easily
+};
+
+template <> struct ANNcoordTraits<unsigned short> {
+	typedef long long	Dist;			// 65535^2 does not fit in int
+};
+
+template <> struct ANNcoordTraits<float> {
+	typedef float		Dist;
+};
+
+//----------------------------------------------------------------------
+//	annDistInf - largest distance value (no point found)
+//----------------------------------------------------------------------
+
+template <class Dist>
+inline Dist annDistInf()
+{  return std::numeric_limits<Dist>::max();  }
+
+//----------------------------------------------------------------------
+//	ANNdistBlock
+//		Squared distance between two blocks of ANN_DIST_BLOCK
+//		coordinates.  The leaf scan of the templated kd-tree computes
+//		distances one block at a time, testing for early abandon
+//		between blocks.  The generic version is a plain loop; SSE2
+//		versions are provided for the three supported coordinate types.
+//----------------------------------------------------------------------
+
+const int ANN_DIST_BLOCK = 16;			// coordinates per block
+
+template <class Coord, class Dist>
+struct ANNdistBlock {
+	static inline Dist dist(const Coord* q, const Coord* p)
+	{
+		Dist dist = 0;
+		for (int j = 0; j < ANN_DIST_BLOCK; j++) {
+			Dist t = (Dist) q[j] - (Dist) p[j];
+			dist += t*t;
+		}
+		return dist;
+	}
+};
+
+#ifdef __SSE2__
+
+template <>
+struct ANNdistBlock<unsigned char, int> {
+	static inline int dist(const unsigned char* q, const unsigned char* p)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i a = _mm_loadu_si128((const __m128i*) q);
+		__m128i b = _mm_loadu_si128((const __m128i*) p);
+										// widen to 16 bits and subtract
+		__m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero),
+									 _mm_unpacklo_epi8(b, zero));
+		__m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero),
+									 _mm_unpackhi_epi8(b, zero));
+										// square and add pairs
+		__m128i s = _mm_add_epi32(_mm_madd_epi16(d_lo, d_lo),
+								  _mm_madd_epi16(d_hi, d_hi));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1,0,3,2)));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2,3,0,1)));
+		return _mm_cvtsi128_si32(s);
+	}
+};
+
+template <>
+struct ANNdistBlock<unsigned short, long long> {
+	static inline long long dist(const unsigned short* q,
+								 const unsigned short* p)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i acc = zero;
+		for (int j = 0; j < ANN_DIST_BLOCK; j += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i*) (q + j));
+			__m128i b = _mm_loadu_si128((const __m128i*) (p + j));
+										// |a - b| without overflow
+			__m128i d = _mm_or_si128(_mm_subs_epu16(a, b),
+									 _mm_subs_epu16(b, a));
+										// full 32-bit squares
+			__m128i lo = _mm_mullo_epi16(d, d);
+			__m128i hi = _mm_mulhi_epu16(d, d);
+			__m128i s0 = _mm_unpacklo_epi16(lo, hi);
+			__m128i s1 = _mm_unpackhi_epi16(lo, hi);
+										// accumulate in 64 bits
+			acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(s0, zero));
+			acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(s0, zero));
+			acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(s1, zero));
+			acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(s1, zero));
+		}
+		long long s[2];
+		_mm_storeu_si128((__m128i*) s, acc);
+		return s[0] + s[1];
+	}
+};
+
+template <>
+struct ANNdistBlock<float, float> {
+	static inline float dist(const float* q, const float* p)
+	{
+		__m128 acc = _mm_setzero_ps();
+		for (int j = 0; j < ANN_DIST_BLOCK; j += 4) {
+			__m128 d = _mm_sub_ps(_mm_loadu_ps(q + j), _mm_loadu_ps(p + j));
+			acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+		}
+		acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+		acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+		return _mm_cvtss_f32(acc);
+	}
+};
+
+#endif // __SSE2__
+
+//----------------------------------------------------------------------
+//	annDistT
+//		Squared distance between two points, computed block by block.
+//		DIM is the dimension of space; instantiations with DIM > 0 have
+//		fixed trip counts, DIM = 0 reads the dimension from dim.
+//----------------------------------------------------------------------
+
+template <class Coord, class Dist, int DIM>
+inline Dist annDistT(const Coord* q, const Coord* p, int dim)
+{
+	const int n_dim = (DIM > 0 ? DIM : dim);
+	const int n_block = n_dim - n_dim % ANN_DIST_BLOCK;
+
+	Dist dist = 0;
+	int d = 0;
+	for (; d < n_block; d += ANN_DIST_BLOCK)
+		dist += ANNdistBlock<Coord, Dist>::dist(q + d, p + d);
+	for (; d < n_dim; d++) {
+		Dist t = (Dist) q[d] - (Dist) p[d];
+		dist += t*t;
+	}
+	return dist;
+}
+
+}
+
+#endif
@@ -0,0 +1,791 @@
+//----------------------------------------------------------------------
+//	File:			ANNkd_treeT.h
+//	Programmer:		Sunil Arya and David Mount
+//	Description:	kd-tree templated on coordinate type
+//----------------------------------------------------------------------
+// Copyright (c) 1997-2005 University of Maryland and Sunil Arya and
+// David Mount.  All Rights Reserved.
+//
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//
+// The University of Maryland (U.M.) and the authors make no
+// representations about the suitability or fitness of this software for
+// any purpose.  It is provided "as is" without express or implied
+// warranty.
+//----------------------------------------------------------------------
+//	History:
+//	Revision 1.0.c  (char version)
+//		kd-tree and priority search for unsigned char, unsigned short
+//		and float coordinates.
+//		Binary tree files that can be searched in place (mmapped).
+//----------------------------------------------------------------------
+
+#ifndef ANNkd_treeT_H
+#define ANNkd_treeT_H
+
+#include <ANN/ANNx.h>					// all ANN includes
+#include <ANN/ANNdistT.h>				// templated distance kernels
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+namespace ann_1_1_char
+{
+
+//----------------------------------------------------------------------
+//	ANNsearchStats
+//		Work done by priority searches, for tuning max_pts_visit.
+//		Unlike the counters of ANNperf.h these need no special build
+//		and are not global: a caller passes its own set to each
+//		search (one per thread or per search context), and a search
+//		adds to it once, at its end.  Without a set the search only
+//		counts in registers.
+//----------------------------------------------------------------------
+
+struct ANNsearchStats {
+	long long	searches;			// searches
+	long long	nodes;				// splitting nodes visited
+	long long	leaves;				// leaves (buckets) visited
+	long long	points;				// points visited
+	long long	coords;				// coordinates compared
+	long long	abandons;			// points given up on partial distance
+	long long	truncated;			// searches cut short by max_pts_visit
+
+	ANNsearchStats()
+		{ reset(); }
+
+	void reset()
+		{ searches = nodes = leaves = points = coords = abandons =
+			truncated = 0; }
+
+	void add(const ANNsearchStats& s) {
+		searches += s.searches;
+		nodes += s.nodes;
+		leaves += s.leaves;
+		points += s.points;
+		coords += s.coords;
+		abandons += s.abandons;
+		truncated += s.truncated;
+	}
+};
+
+//----------------------------------------------------------------------
+//	ANNkd_treeT
+//		A kd-tree over points whose coordinates are of type Coord
+//		(unsigned char, unsigned short or float).  Squared distances
+//		are of type ANNcoordTraits<Coord>::Dist.
+//
+//		The tree is built with the sliding midpoint rule (the rule
+//		ANNkd_tree uses by default) and is searched with the priority
+//		search of annkPriSearch().  For unsigned char coordinates it
+//		gives exactly the same results as ANNkd_tree.
+//
+//		Unlike ANNkd_tree, the tree does not copy or own the points.
+//		They are stored contiguously (point i starts at pa + i*dim) and
+//		must stay valid for the lifetime of the tree.  Nodes are kept in
+//		a single array and refer to their children by index.
+//
+//		The search does not use any global state, so a tree may be
+//		searched from several threads at once.  The limit on the number
+//		of points visited is passed to each search rather than set with
+//		annMaxPtsVisit().
+//
+//		A tree can be written to a binary file with BinaryDump() and
+//		later attached to a buffer holding that file (typically an
+//		mmapped file) with BinaryLoad().  A loaded tree is searched in
+//		place; nothing is copied or rebuilt.  See "Binary tree files"
+//		below for the format.
+//----------------------------------------------------------------------
+
+template <class Coord>
+class ANNkd_treeT {
+public:
+	typedef typename ANNcoordTraits<Coord>::Dist Dist;
+
+	ANNkd_treeT(						// build from point array
+		const Coord*	pa,				// points (n*dd coordinates)
+		int				n,				// number of points
+		int				dd,				// dimension
+		int				bs = 1);		// bucket size
+
+	ANNkd_treeT();						// empty tree (see BinaryLoad)
+
+	bool BinaryDump(FILE* out) const;	// write binary tree file
+
+	bool BinaryLoad(					// attach to binary tree file
+		const void*		buf,			// file contents
+		size_t			len,			// file length
+		const Coord*	pa);			// points (as passed when built)
+
+	int annkPriSearch(					// approx k near neighbor search
+		const Coord*	q,				// query point
+		int				k,				// number of near neighbors to return
+		ANNidxArray		nn_idx,			// nearest neighbor array (modified)
+		Dist*			dd,				// dist to near neighbors (modified)
+		double			eps = 0.0,		// error bound
+		int				max_pts_visit = 0, // 0 = no limit
+		ANNsearchStats*	stats = NULL) const; // work done (added to)
+
+	int theDim() const					// return dimension of space
+		{ return dim; }
+
+	int nPoints() const					// return number of points
+		{ return n_pts; }
+
+	const Coord* thePoints() const		// return pointer to points
+		{ return pts; }
+
+private:
+	struct Node {						// node of the tree
+		int			cut_dim;			// cutting dimension (-1 for leaf)
+		int			child[2];			// split: low and high child
+										// leaf: first pidx entry and count
+		Coord		cut_val;			// cutting value
+		Coord		cd_bnds[2];			// box bounds along cut_dim
+	};
+
+	const Coord*		pts;			// the points
+	int					n_pts;			// number of points
+	int					dim;			// dimension of space
+	int					bkt_size;		// bucket size
+	int					root;			// index of root node
+	int					n_nodes;		// number of nodes
+	const ANNidx*		pidx;			// point indices (leaf buckets)
+	const Node*			nodes;			// all nodes
+	const Coord*		bnd_box_lo;		// bounding box low point
+	const Coord*		bnd_box_hi;		// bounding box high point
+
+										// storage of a built tree (a
+										// loaded tree points into its file)
+	std::vector<ANNidx>	pidx_store;
+	std::vector<Node>	node_store;
+	std::vector<Coord>	bnd_store;		// low point, then high point
+
+	ANNkd_treeT(const ANNkd_treeT&);	// not copyable (points into
+	ANNkd_treeT& operator=(const ANNkd_treeT&); // its own storage)
+
+	Coord coord(int i, int d) const		// coordinate d of point pidx[i]
+		{ return pts[(size_t) pidx_store[i]*dim + d]; }
+
+	bool trivial(int i) const			// is node an empty leaf?
+		{ return nodes[i].cut_dim < 0 && nodes[i].child[1] == 0; }
+
+	int rkd_tree(int first, int n, std::vector<Coord>& lo,
+		std::vector<Coord>& hi);
+	void sl_midpt_split(int first, int n, const std::vector<Coord>& lo,
+		const std::vector<Coord>& hi, int& cut_dim, Coord& cut_val,
+		int& n_lo);
+	void plane_split(int first, int n, int d, Coord cv, int& br1,
+		int& br2);
+
+	template <int DIM>
+	int pri_search(const Coord* q, int k, ANNidxArray nn_idx, Dist* dd,
+		double eps, int max_pts_visit, ANNsearchStats* stats) const;
+};
+
+//----------------------------------------------------------------------
+//	ANNpr_queueT, ANNmin_kT
+//		Box priority queue and k-smallest set used by the priority
+//		search.  These are the structures of pr_queue.h and
+//		pr_queue_k.h with the key type as a parameter.  They are
+//		created by each search, so searches do not share any state.
+//----------------------------------------------------------------------
+
+template <class Dist>
+class ANNpr_queueT {
+	struct pq_node {					// node in priority queue
+		Dist		key;				// key value
+		int			info;				// node index
+	};
+	int						n;			// number of items in queue
+	int						max_size;	// maximum queue size
+	std::vector<pq_node>	pq;			// the queue (array [1..max])
+
+public:
+	ANNpr_queueT(int max) : n(0), max_size(max), pq(max+1) {}
+
+	bool non_empty() const				// is queue nonempty?
+		{ return n != 0; }
+
+	Dist min_key() const				// key of min item (nonempty)
+		{ return pq[1].key; }
+
+	void insert(Dist kv, int inf)		// insert item
+		{
+			if (++n > max_size) annError((char*)"Priority queue overflow.", ANNabort);
+			int r = n;
+			while (r > 1) {				// sift up new item
+				int p = r/2;
+				if (pq[p].key <= kv)	// in proper order
+					break;
+				pq[r] = pq[p];			// else swap with parent
+				r = p;
+			}
+			pq[r].key = kv;				// insert new item at final location
+			pq[r].info = inf;
+		}
+
+	void extr_min(Dist& kv, int& inf)	// extract minimum
+		{
+			kv = pq[1].key;				// key of min item
+			inf = pq[1].info;			// information of min item
+			Dist kn = pq[n--].key;		// last item in queue
+			int p = 1;					// p points to item out of position
+			int r = p<<1;				// left child of p
+			while (r <= n) {			// while r is still within the heap
+										// set r to smaller child of p
+				if (r < n  && pq[r].key > pq[r+1].key) r++;
+				if (kn <= pq[r].key)	// in proper order
+					break;
+				pq[p] = pq[r];			// else swap with child
+				p = r;					// advance pointers
+				r = p<<1;
+			}
+			pq[p] = pq[n+1];			// insert last item in proper place
+		}
+};
+
+template <class Dist>
+class ANNmin_kT {
+	struct mk_node {					// node in min_k structure
+		Dist		key;				// key value
+		ANNidx		info;				// point index
+	};
+	int						k;			// max number of keys to store
+	int						n;			// number of keys currently active
+	std::vector<mk_node>	mk;			// the sorted list
+
+public:
+	ANNmin_kT(int max) : k(max), n(0), mk(max+1) {}
+
+	Dist max_key() const				// return maximum key
+		{ return (n == k ? mk[k-1].key : annDistInf<Dist>()); }
+
+	Dist ith_smallest_key(int i) const	// ith smallest key
+		{ return (i < n ? mk[i].key : annDistInf<Dist>()); }
+
+	ANNidx ith_smallest_info(int i) const // info for ith smallest
+		{ return (i < n ? mk[i].info : ANN_NULL_IDX); }
+
+	void insert(Dist kv, ANNidx inf)	// insert item
+		{
+			int i;
+			for (i = n; i > 0; i--) {	// slide larger values up
+				if (mk[i-1].key > kv)
+					mk[i] = mk[i-1];
+				else
+					break;
+			}
+			mk[i].key = kv;				// store element here
+			mk[i].info = inf;
+			if (n < k) n++;				// increment number of items
+		}
+};
+
+//----------------------------------------------------------------------
+//	Construction
+//		This follows annEnclRect(), rkd_tree() and sl_midpt_split()
+//		in kd_tree.cpp, kd_util.cpp and kd_split.cpp.  Midpoints are
+//		computed in the distance type, so they are rounded down for
+//		integer coordinates exactly as in the char version.
+//----------------------------------------------------------------------
+
+template <class Coord>
+ANNkd_treeT<Coord>::ANNkd_treeT(
+	const Coord*		pa,				// points (n*dd coordinates)
+	int					n,				// number of points
+	int					dd,				// dimension
+	int					bs)				// bucket size
+	: pts(pa), n_pts(n), dim(dd), bkt_size(bs), root(-1), n_nodes(0),
+	  pidx(NULL), nodes(NULL), bnd_box_lo(NULL), bnd_box_hi(NULL),
+	  pidx_store(n), bnd_store(2*dd)
+{
+	for (int i = 0; i < n; i++)			// initially identity
+		pidx_store[i] = i;
+	if (n == 0) return;					// no points--no sweat
+
+	std::vector<Coord> lo(dd), hi(dd);
+	for (int d = 0; d < dd; d++) {		// find smallest enclosing rectangle
+		Coord lo_bnd = coord(0, d);
+		Coord hi_bnd = coord(0, d);
+		for (int i = 0; i < n; i++) {
+			if (coord(i, d) < lo_bnd) lo_bnd = coord(i, d);
+			else if (coord(i, d) > hi_bnd) hi_bnd = coord(i, d);
+		}
+		lo[d] = bnd_store[d] = lo_bnd;
+		hi[d] = bnd_store[dd + d] = hi_bnd;
+	}
+
+	node_store.reserve(2*(n/(bs > 0 ? bs : 1)) + 1);
+	root = rkd_tree(0, n, lo, hi);
+
+	pidx = &pidx_store[0];				// search through the pointers
+	nodes = &node_store[0];
+	n_nodes = (int) node_store.size();
+	bnd_box_lo = &bnd_store[0];
+	bnd_box_hi = &bnd_store[dd];
+}
+
+template <class Coord>
+ANNkd_treeT<Coord>::ANNkd_treeT()
+	: pts(NULL), n_pts(0), dim(0), bkt_size(0), root(-1), n_nodes(0),
+	  pidx(NULL), nodes(NULL), bnd_box_lo(NULL), bnd_box_hi(NULL)
+{
+}
+
+template <class Coord>
+int ANNkd_treeT<Coord>::rkd_tree(		// recursive construction
+	int					first,			// first pidx entry of subtree
+	int					n,				// number of points
+	std::vector<Coord>&	lo,				// bounding box (modified, restored)
+	std::vector<Coord>&	hi)
+{
+	Node node;
+	int idx = (int) node_store.size();
+
+	if (n <= bkt_size) {				// n small, make a leaf node
+		node.cut_dim = -1;				// (n == 0 is the trivial leaf)
+		node.child[0] = first;
+		node.child[1] = n;
+		node.cut_val = node.cd_bnds[0] = node.cd_bnds[1] = 0;
+		node_store.push_back(node);
+		return idx;
+	}
+
+	int cd;								// cutting dimension
+	Coord cv;							// cutting value
+	int n_lo;							// number on low side of cut
+
+	sl_midpt_split(first, n, lo, hi, cd, cv, n_lo);
+
+	node.cut_dim = cd;
+	node.cut_val = cv;
+	node.cd_bnds[0] = lo[cd];			// save bounds for cutting dimension
+	node.cd_bnds[1] = hi[cd];
+	node_store.push_back(node);
+
+	Coord hv = hi[cd];
+	hi[cd] = cv;						// modify bounds for left subtree
+	int lo_child = rkd_tree(first, n_lo, lo, hi);
+	hi[cd] = hv;						// restore bounds
+
+	Coord lv = lo[cd];
+	lo[cd] = cv;						// modify bounds for right subtree
+	int hi_child = rkd_tree(first + n_lo, n - n_lo, lo, hi);
+	lo[cd] = lv;						// restore bounds
+
+	node_store[idx].child[ANN_LO] = lo_child;
+	node_store[idx].child[ANN_HI] = hi_child;
+	return idx;
+}
+
+template <class Coord>
+void ANNkd_treeT<Coord>::sl_midpt_split(
+	int					first,			// first pidx entry
+	int					n,				// number of points
+	const std::vector<Coord>& lo,		// bounding rectangle for cell
+	const std::vector<Coord>& hi,
+	int&				cut_dim,		// cutting dimension (returned)
+	Coord&				cut_val,		// cutting value (returned)
+	int&				n_lo)			// num of points on low side (returned)
+{
+	const double ERR = 0.001;			// a small value
+	int d;
+
+	Dist max_length = (Dist) hi[0] - (Dist) lo[0];
+	for (d = 1; d < dim; d++) {			// find length of longest box side
+		Dist length = (Dist) hi[d] - (Dist) lo[d];
+		if (length > max_length) {
+			max_length = length;
+		}
+	}
+	Dist max_spread = -1;				// find long side with most spread
+	cut_dim = 0;
+	for (d = 0; d < dim; d++) {
+										// is it among longest?
+		if (((Dist) hi[d] - (Dist) lo[d]) >= (1-ERR)*max_length) {
+			Coord min = coord(first, d);	// compute its spread
+			Coord max = coord(first, d);
+			for (int i = 1; i < n; i++) {
+				Coord c = coord(first + i, d);
+				if (c < min) min = c;
+				else if (c > max) max = c;
+			}
+			Dist spr = (Dist) max - (Dist) min;
+			if (spr > max_spread) {		// is it max so far?
+				max_spread = spr;
+				cut_dim = d;
+			}
+		}
+	}
+										// ideal split at midpoint
+	Coord ideal_cut_val = (Coord)
+		(((Dist) lo[cut_dim] + (Dist) hi[cut_dim]) / 2);
+
+	Coord min = coord(first, cut_dim);	// find min/max coordinates
+	Coord max = coord(first, cut_dim);
+	for (int i = 1; i < n; i++) {
+		Coord c = coord(first + i, cut_dim);
+		if (c < min) min = c;
+		else if (c > max) max = c;
+	}
+
+	if (ideal_cut_val < min)			// slide to min or max as needed
+		cut_val = min;
+	else if (ideal_cut_val > max)
+		cut_val = max;
+	else
+		cut_val = ideal_cut_val;
+
+	int br1, br2;						// permute points accordingly
+	plane_split(first, n, cut_dim, cut_val, br1, br2);
+
+	if (ideal_cut_val < min) n_lo = 1;
+	else if (ideal_cut_val > max) n_lo = n-1;
+	else if (br1 > n/2) n_lo = br1;
+	else if (br2 < n/2) n_lo = br2;
+	else n_lo = n/2;
+}
+
+template <class Coord>
+void ANNkd_treeT<Coord>::plane_split(	// split points by a plane
+	int					first,			// first pidx entry
+	int					n,				// number of points
+	int					d,				// dimension along which to split
+	Coord				cv,				// cutting value
+	int&				br1,			// first break (values < cv)
+	int&				br2)			// second break (values == cv)
+{
+	ANNidx* pi = &pidx_store[first];
+	int l = 0;
+	int r = n-1;
+	for(;;) {							// partition about cv
+		while (l < n && coord(first + l, d) < cv) l++;
+		while (r >= 0 && coord(first + r, d) >= cv) r--;
+		if (l > r) break;
+		ANNidx tmp = pi[l]; pi[l] = pi[r]; pi[r] = tmp;
+		l++; r--;
+	}
+	br1 = l;					// now: pa[0..br1-1] < cv <= pa[br1..n-1]
+	r = n-1;
+	for(;;) {							// partition pa[br1..n-1] about cv
+		while (l < n && coord(first + l, d) <= cv) l++;
+		while (r >= br1 && coord(first + r, d) > cv) r--;
+		if (l > r) break;
+		ANNidx tmp = pi[l]; pi[l] = pi[r]; pi[r] = tmp;
+		l++; r--;
+	}
+	br2 = l;					// now: pa[br1..br2-1] == cv < pa[br2..n-1]
+}
+
+//----------------------------------------------------------------------
+//	Binary tree files
+//		A tree file holds the header below followed by four sections,
+//		each starting at a multiple of 8 bytes:
+//
+//			bnd_box_lo		dim coordinates
+//			bnd_box_hi		dim coordinates
+//			pidx			n_pts point indices
+//			nodes			n_nodes nodes
+//
+//		All values are stored in native byte order and layout, so a
+//		file can only be read on the machine type that wrote it.  The
+//		header records the sizes needed to detect a mismatch.  The
+//		points are not part of the file; BinaryLoad() must be given
+//		the same points the tree was built from.  It checks that the
+//		nodes form a tree over valid point indices, so a damaged file
+//		is rejected instead of being searched.
+//----------------------------------------------------------------------
+
+const char ANN_TREE_MAGIC[8] = "ANNkdT1";	// file signature
+
+struct ANNtreeFileHeader {
+	char		magic[8];				// ANN_TREE_MAGIC
+	int			coord_size;				// sizeof(Coord)
+	int			coord_integer;			// 1 if Coord is an integer type
+	int			node_size;				// size of a node
+	int			dim;					// dimension of space
+	int			n_pts;					// number of points
+	int			bkt_size;				// bucket size
+	int			root;					// index of root node
+	int			n_nodes;				// number of nodes
+};
+
+inline size_t annAlign8(size_t n)		// round up to a multiple of 8
+{  return (n + 7) & ~(size_t) 7;  }
+
+template <class Coord>
+bool ANNkd_treeT<Coord>::BinaryDump(FILE* out) const
+{
+	ANNtreeFileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, ANN_TREE_MAGIC, sizeof(hdr.magic));
+	hdr.coord_size = sizeof(Coord);
+	hdr.coord_integer = std::numeric_limits<Coord>::is_integer ? 1 : 0;
+	hdr.node_size = sizeof(Node);
+	hdr.dim = dim;
+	hdr.n_pts = n_pts;
+	hdr.bkt_size = bkt_size;
+	hdr.root = root;
+	hdr.n_nodes = n_nodes;
+
+	const void* sec[4] = { bnd_box_lo, bnd_box_hi, pidx, nodes };
+	size_t len[4] = { dim*sizeof(Coord), dim*sizeof(Coord),
+		n_pts*sizeof(ANNidx), n_nodes*sizeof(Node) };
+	if (n_pts == 0) len[0] = len[1] = 0;	// no bounding box
+
+	static const char zero[8] = { 0 };
+	size_t pos = sizeof(hdr);
+	if (fwrite(&hdr, sizeof(hdr), 1, out) != 1) return false;
+	for (int i = 0; i < 4; i++) {
+		size_t pad = annAlign8(pos) - pos;
+		if (pad > 0 && fwrite(zero, 1, pad, out) != pad) return false;
+		pos += pad;
+		if (len[i] > 0 && fwrite(sec[i], 1, len[i], out) != len[i])
+			return false;
+		pos += len[i];
+	}
+	return true;
+}
+
+template <class Coord>
+bool ANNkd_treeT<Coord>::BinaryLoad(
+	const void*			buf,			// file contents
+	size_t				len,			// file length
+	const Coord*		pa)				// points
+{
+	const char* base = (const char*) buf;
+	ANNtreeFileHeader hdr;
+	if (len < sizeof(hdr)) return false;
+	memcpy(&hdr, base, sizeof(hdr));
+
+	if (memcmp(hdr.magic, ANN_TREE_MAGIC, sizeof(hdr.magic)) != 0 ||
+		hdr.coord_size != (int) sizeof(Coord) ||
+		hdr.coord_integer != (std::numeric_limits<Coord>::is_integer ? 1 : 0) ||
+		hdr.node_size != (int) sizeof(Node) ||
+		hdr.dim < 0 || hdr.n_pts < 0 || hdr.n_nodes < 0 ||
+		hdr.root >= hdr.n_nodes || (hdr.n_pts > 0 && hdr.root < 0))
+		return false;
+
+	size_t bnd_len = hdr.n_pts > 0 ? hdr.dim*sizeof(Coord) : 0;
+	size_t off_lo = annAlign8(sizeof(hdr));
+	size_t off_hi = annAlign8(off_lo + bnd_len);
+	size_t off_idx = annAlign8(off_hi + bnd_len);
+	size_t off_nodes = annAlign8(off_idx + hdr.n_pts*sizeof(ANNidx));
+	if (off_nodes + hdr.n_nodes*sizeof(Node) != len) return false;
+
+										// the search trusts the node
+										// array, so check that it is a
+										// tree over valid point indices
+	const ANNidx* idx = (const ANNidx*) (base + off_idx);
+	for (int i = 0; i < hdr.n_pts; i++) {
+		if (idx[i] < 0 || idx[i] >= hdr.n_pts) return false;
+	}
+	const Node* nd = (const Node*) (base + off_nodes);
+	for (int i = 0; i < hdr.n_nodes; i++) {
+		if (nd[i].cut_dim >= 0) {		// splitting node: children come
+										// after it (as built), so the
+										// nodes cannot form a cycle
+			if (nd[i].cut_dim >= hdr.dim ||
+				nd[i].child[ANN_LO] <= i || nd[i].child[ANN_LO] >= hdr.n_nodes ||
+				nd[i].child[ANN_HI] <= i || nd[i].child[ANN_HI] >= hdr.n_nodes)
+				return false;
+		}
+		else if (nd[i].child[0] < 0 || nd[i].child[1] < 0 ||
+			nd[i].child[1] > hdr.n_pts - nd[i].child[0])
+			return false;				// leaf bucket outside pidx
+	}
+
+	pts = pa;
+	n_pts = hdr.n_pts;
+	dim = hdr.dim;
+	bkt_size = hdr.bkt_size;
+	root = hdr.root;
+	n_nodes = hdr.n_nodes;
+	bnd_box_lo = (const Coord*) (base + off_lo);
+	bnd_box_hi = (const Coord*) (base + off_hi);
+	pidx = (const ANNidx*) (base + off_idx);
+	nodes = (const Node*) (base + off_nodes);
+
+	pidx_store.clear();					// drop any built tree
+	node_store.clear();
+	bnd_store.clear();
+	return true;
+}
+
+//----------------------------------------------------------------------
+//	Priority search
+//		This follows annkPriSearch() in kd_pr_search.cpp, with the
+//		recursion over splitting nodes turned into a loop.  Leaf
+//		buckets are scanned a block of ANN_DIST_BLOCK coordinates at a
+//		time, abandoning a point once its partial distance exceeds the
+//		distance to the k-th closest point (see kd_leaf_scan.h).
+//
+//		The return value is the number of points visited.  If stats
+//		is given, the work done is added to it.
+//----------------------------------------------------------------------
+
+template <class Coord>
+int ANNkd_treeT<Coord>::annkPriSearch(
+	const Coord*		q,				// query point
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	Dist*				dd,				// dist to near neighbors (returned)
+	double				eps,			// error bound
+	int					max_pts_visit,
+	ANNsearchStats*		stats) const
+{
+	switch (dim) {
+	case 128:
+		return pri_search<128>(q, k, nn_idx, dd, eps, max_pts_visit, stats);
+	case 64:
+		return pri_search<64>(q, k, nn_idx, dd, eps, max_pts_visit, stats);
+	case 32:
+		return pri_search<32>(q, k, nn_idx, dd, eps, max_pts_visit, stats);
+	default:
+		return pri_search<0>(q, k, nn_idx, dd, eps, max_pts_visit, stats);
+	}
+}
+
+template <class Coord>
+template <int DIM>
+int ANNkd_treeT<Coord>::pri_search(
+	const Coord*		q,				// query point
+	int					k,				// number of near neighbors to return
+	ANNidxArray			nn_idx,			// nearest neighbor indices (returned)
+	Dist*				dd,				// dist to near neighbors (returned)
+	double				eps,			// error bound
+	int					max_pts_visit,
+	ANNsearchStats*		stats) const
+{
+	const int n_dim = (DIM > 0 ? DIM : dim);
+	const int n_block = n_dim - n_dim % ANN_DIST_BLOCK;
+										// max tolerable squared error
+	double max_err = (1.0 + eps)*(1.0 + eps);
+	int pts_visited = 0;
+	int n_nodes_visited = 0;			// work done (see ANNsearchStats)
+	int n_leaves = 0;
+	long long n_coords = 0;
+	int n_abandons = 0;
+	bool truncated = false;
+
+	ANNmin_kT<Dist> point_mk(k);		// set for closest k points
+
+	if (root >= 0) {
+		Dist box_dist = 0;				// distance to root box
+		for (int d = 0; d < n_dim; d++) {
+			if (q[d] < bnd_box_lo[d]) {
+				Dist t = (Dist) bnd_box_lo[d] - (Dist) q[d];
+				box_dist += t*t;
+			}
+			else if (q[d] > bnd_box_hi[d]) {
+				Dist t = (Dist) q[d] - (Dist) bnd_box_hi[d];
+				box_dist += t*t;
+			}
+		}
+
+		ANNpr_queueT<Dist> box_pq(n_pts);// priority queue for boxes
+		box_pq.insert(box_dist, root);
+
+		while (box_pq.non_empty() &&
+			(!(max_pts_visit != 0 && pts_visited > max_pts_visit))) {
+			int np;						// next box from priority queue
+			box_pq.extr_min(box_dist, np);
+
+			if (box_dist*max_err >= point_mk.max_key())
+				break;
+										// descend to a leaf, enqueueing
+										// the farther child at each split
+			while (nodes[np].cut_dim >= 0) {
+				const Node& nd = nodes[np];
+				Dist cut_diff = (Dist) q[nd.cut_dim] - (Dist) nd.cut_val;
+				Dist box_diff;
+				int close, far;
+				if (cut_diff < 0) {		// left of cutting plane
+					box_diff = (Dist) nd.cd_bnds[ANN_LO] - (Dist) q[nd.cut_dim];
+					close = nd.child[ANN_LO];
+					far = nd.child[ANN_HI];
+				}
+				else {					// right of cutting plane
+					box_diff = (Dist) q[nd.cut_dim] - (Dist) nd.cd_bnds[ANN_HI];
+					close = nd.child[ANN_HI];
+					far = nd.child[ANN_LO];
+				}
+				if (box_diff < 0)		// within bounds - ignore
+					box_diff = 0;
+										// distance to further box
+				Dist new_dist = box_dist +
+					(cut_diff*cut_diff - box_diff*box_diff);
+				if (!trivial(far))		// enqueue if not trivial
+					box_pq.insert(new_dist, far);
+				np = close;
+				n_nodes_visited++;
+			}
+										// scan points in bucket
+			const Node& leaf = nodes[np];
+			const ANNidx* bkt = &pidx[leaf.child[0]];
+			int n_bkt = leaf.child[1];
+			Dist min_dist = point_mk.max_key();
+
+			for (int i = 0; i < n_bkt; i++) {
+				const Coord* pp = pts + (size_t) bkt[i]*n_dim;
+				Dist dist = 0;
+				int d = 0;
+				for (; d < n_block; d += ANN_DIST_BLOCK) {
+					dist += ANNdistBlock<Coord, Dist>::dist(q + d, pp + d);
+					if (dist > min_dist) {	// exceeds dist to k-th smallest?
+						d += ANN_DIST_BLOCK;
+						break;
+					}
+				}
+				if (dist <= min_dist) {
+					for (; d < n_dim; d++) {
+						Dist t = (Dist) q[d] - (Dist) pp[d];
+						if ((dist += t*t) > min_dist) {
+							d++;
+							break;
+						}
+					}
+				}
+				n_coords += d;
+				if (dist > min_dist)
+					n_abandons++;
+				else if (ANN_ALLOW_SELF_MATCH || dist != 0) {
+					point_mk.insert(dist, bkt[i]);
+					min_dist = point_mk.max_key();
+				}
+			}
+			pts_visited += n_bkt;
+			n_leaves++;
+		}
+										// stopped by max_pts_visit with
+										// a box left that could be closer?
+		truncated = box_pq.non_empty() &&
+			box_pq.min_key()*max_err < point_mk.max_key();
+	}
+
+	if (stats != NULL) {
+		stats->searches++;
+		stats->nodes += n_nodes_visited;
+		stats->leaves += n_leaves;
+		stats->points += pts_visited;
+		stats->coords += n_coords;
+		stats->abandons += n_abandons;
+		if (truncated)
+			stats->truncated++;
+	}
+
+	for (int i = 0; i < k; i++) {		// extract the k-th closest points
+		dd[i] = point_mk.ith_smallest_key(i);
+		nn_idx[i] = point_mk.ith_smallest_info(i);
+	}
+	return pts_visited;
+}
+
+}
+
+#endif
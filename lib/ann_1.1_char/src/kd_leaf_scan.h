@@ -0,0 +1,145 @@
+//----------------------------------------------------------------------
+// File:			kd_leaf_scan.h
+// Programmer:		Sunil Arya and David Mount
+// Description:		Bucket scan for kd-tree leaves, specialized on dimension
+// Last modified:	01/04/05 (Version 1.0)
+//----------------------------------------------------------------------
+// Copyright (c) 1997-2005 University of Maryland and Sunil Arya and
+// David Mount.  All Rights Reserved.
+//
+// This software and related documentation is part of the Approximate
+// Nearest Neighbor Library (ANN).  This software is provided under
+// the provisions of the Lesser GNU Public License (LGPL).  See the
+// file ../ReadMe.txt for further information.
+//
+// The University of Maryland (U.M.) and the authors make no
+// representations about the suitability or fitness of this software for
+// any purpose.  It is provided "as is" without express or implied
+// warranty.
+//----------------------------------------------------------------------
+// History:
+//	Revision 1.0.c  (char version)
+//		Leaf scan shared by standard and priority search, with
+//		fixed trip count instantiations for 128, 64 and 32-D points.
+//----------------------------------------------------------------------
+
+#ifndef ANN_kd_leaf_scan_H
+#define ANN_kd_leaf_scan_H
+
+#include "kd_tree.h"					// kd-tree declarations
+#include "pr_queue_k.h"					// k-element priority queue
+
+#include <ANN/ANNperf.h>				// performance evaluation
+
+namespace ann_1_1_char
+{
+
+//----------------------------------------------------------------------
+//	Leaf bucket scan
+//		Computes the squared distance from the query point to every
+//		point in the bucket and inserts those that are among the k
+//		closest seen so far.  As in the original leaf search, partial
+//		distances are abandoned as soon as they exceed the distance to
+//		the k-th closest point, but the test is made once per block of
+//		ANN_LEAF_BLOCK coordinates rather than once per coordinate.
+//		Since squared differences are non-negative this gives exactly
+//		the same result while keeping the inner loop branch free.
+//
+//		DIM is the dimension of space.  The instantiations for 128, 64
+//		and 32 have fixed trip counts that the compiler can unroll
+//		completely.  DIM = 0 is the generic version, which reads the
+//		dimension from its argument (any dimension is allowed).
+//----------------------------------------------------------------------
+
+const int ANN_LEAF_BLOCK = 16;			// coordinates per abandon test
+
+template <int DIM>
+inline void annLeafScan(
+	int					n_pts,			// no. points in bucket
+	ANNidxArray			bkt,			// bucket of points
+	ANNpointArray		pts,			// the points
+	ANNpoint			q,				// query point
+	int					dim,			// dimension (used if DIM == 0)
+	ANNmin_k			*pointMK)		// set of k closest points
+{
+	ANNdist dist;						// distance to data point
+	ANNcoord* pp;						// data coordinate pointer
+	ANNdist min_dist;					// distance to k-th closest point
+	ANNdist t;
+	int d;
+
+	const int n_dim   = (DIM > 0 ? DIM : dim);
+	const int n_block = (DIM > 0 ? DIM - DIM % ANN_LEAF_BLOCK : 0);
+
+	min_dist = pointMK->max_key();		// k-th smallest distance so far
+
+	for (int i = 0; i < n_pts; i++) {	// check points in bucket
+
+		pp = pts[bkt[i]];				// first coord of next data point
+		dist = 0;
+		d = 0;
+										// fixed size blocks
+		for (; d < n_block; d += ANN_LEAF_BLOCK) {
+			ANN_COORD(ANN_LEAF_BLOCK)	// more coordinates hit
+			ANN_FLOP(4*ANN_LEAF_BLOCK)	// increment floating ops
+			for (int j = 0; j < ANN_LEAF_BLOCK; j++) {
+				t = (ANNdist) q[d+j] - (ANNdist) pp[d+j];
+				dist = ANN_SUM(dist, ANN_POW(t));
+			}
+			if (dist > min_dist)		// exceeds dist to k-th smallest?
+				break;
+		}
+										// remaining coordinates
+		if (d >= n_block && dist <= min_dist) {
+			for (; d < n_dim; d++) {
+				ANN_COORD(1)			// one more coordinate hit
+				ANN_FLOP(4)				// increment floating ops
+				t = (ANNdist) q[d] - (ANNdist) pp[d];
+				if ((dist = ANN_SUM(dist, ANN_POW(t))) > min_dist)
+					break;
+			}
+		}
+
+		if (dist <= min_dist &&					// among the k best?
+		   (ANN_ALLOW_SELF_MATCH || dist!=0)) { // and no self-match problem
+												// add it to the list
+			pointMK->insert(dist, bkt[i]);
+			min_dist = pointMK->max_key();
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+//	annLeafScanDim
+//		Dispatches to the instantiation matching the dimension of the
+//		tree.  Dimensions without a dedicated instantiation use the
+//		generic loop.
+//----------------------------------------------------------------------
+
+inline void annLeafScanDim(
+	int					n_pts,			// no. points in bucket
+	ANNidxArray			bkt,			// bucket of points
+	ANNpointArray		pts,			// the points
+	ANNpoint			q,				// query point
+	int					dim,			// dimension of space
+	ANNmin_k			*pointMK)		// set of k closest points
+{
+	switch (dim) {
+	case 128:
+		annLeafScan<128>(n_pts, bkt, pts, q, dim, pointMK);
+		break;
+	case 64:
+		annLeafScan<64>(n_pts, bkt, pts, q, dim, pointMK);
+		break;
+	case 32:
+		annLeafScan<32>(n_pts, bkt, pts, q, dim, pointMK);
+		break;
+	default:
+		annLeafScan<0>(n_pts, bkt, pts, q, dim, pointMK);
+		break;
+	}
+}
+
+}
+
+#endif
@@ -29,6 +29,7 @@
 #include "kd_util.h"					// kd-tree utilities
 #include "pr_queue.h"					// priority queue declarations
 #include "pr_queue_k.h"					// k-element priority queue
+#include "kd_leaf_scan.h"				// leaf bucket scan
 
 #include <ANN/ANNperf.h>				// performance evaluation
 
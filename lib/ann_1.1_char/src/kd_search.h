@@ -28,6 +28,7 @@
 #include "kd_tree.h"					// kd-tree declarations
 #include "kd_util.h"					// kd-tree utilities
 #include "pr_queue_k.h"					// k-element priority queue
+#include "kd_leaf_scan.h"				// leaf bucket scan
 
 #include <ANN/ANNperf.h>				// performance evaluation
 
@@ -0,0 +1,177 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "Checkpoint.h"
+
+#include <unistd.h>
+
+using namespace match;
+
+string MatchCheckpoint::checkpointFileName(const char* matchFile) {
+  return string(matchFile) + ".ckpt";
+}
+
+MatchCheckpoint::~MatchCheckpoint() {
+  if(fp != NULL) {
+    fclose(fp);
+  }
+}
+
+bool MatchCheckpoint::open(const char* matchFile, bool resume, 
+    int seconds) {
+  matchFileName = matchFile;
+  ckptFileName = checkpointFileName(matchFile);
+  interval = seconds;
+  lastCommit = time(NULL);
+
+  if(!resume) {
+    fp = fopen(ckptFileName.c_str(), "w");
+    if(fp == NULL) {
+      printf("\nError opening checkpoint file %s\n", ckptFileName.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  if(!readCheckpoint() || !checkTrailingRecord()) {
+    return false;
+  }
+
+  /// Drop whatever was written after the last commit
+  if(truncate(matchFileName.c_str(), (off_t)matchFileEnd) != 0) {
+    printf("\nError truncating match file %s\n", matchFileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*! \brief Reads the committed pairs and cuts the checkpoint file after
+ **  the last complete commit line.
+ **/
+bool MatchCheckpoint::readCheckpoint() {
+  fp = fopen(ckptFileName.c_str(), "r+");
+  if(fp == NULL) {
+    printf("\nError opening checkpoint file %s, cannot resume\n", 
+        ckptFileName.c_str());
+    return false;
+  }
+
+  char line[256];
+  long long ckptEnd = 0;
+  vector< ImagePair > uncommitted;
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    /// A line without newline was cut short by the kill
+    if(strchr(line, '\n') == NULL) {
+      break;
+    }
+
+    if(line[0] == '#') {
+      long long recordStart, fileEnd;
+      if(sscanf(line + 1, "%lld %lld", &recordStart, &fileEnd) != 2) {
+        break;
+      }
+      donePairs.insert(uncommitted.begin(), uncommitted.end());
+      uncommitted.clear();
+      lastRecordStart = recordStart;
+      matchFileEnd = fileEnd;
+      ckptEnd = ftell(fp);
+    } else {
+      int a, b;
+      if(sscanf(line, "%d %d", &a, &b) != 2) {
+        break;
+      }
+      uncommitted.push_back(make_pair(a, b));
+    }
+  }
+
+  /// Appending continues after the last commit
+  fflush(fp);
+  if(ftruncate(fileno(fp), (off_t)ckptEnd) != 0 || 
+      fseek(fp, 0, SEEK_END) != 0) {
+    printf("\nError truncating checkpoint file %s\n", ckptFileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*! \brief Verifies that the last committed record of the match file,
+ **  <im1 im2>, <num_matches> and num_matches lines, is complete and 
+ **  ends at the committed length.
+ **/
+bool MatchCheckpoint::checkTrailingRecord() {
+  FILE* mf = fopen(matchFileName.c_str(), "r");
+  if(mf == NULL) {
+    if(matchFileEnd == 0) {
+      return true;
+    }
+    printf("\nError opening match file %s, cannot resume\n", 
+        matchFileName.c_str());
+    return false;
+  }
+
+  bool ok = true;
+  if(fseek(mf, 0, SEEK_END) != 0 || ftell(mf) < matchFileEnd) {
+    ok = false;
+  } else if(lastRecordStart >= 0) {
+    int im1, im2, numMatches;
+    ok = fseek(mf, lastRecordStart, SEEK_SET) == 0 &&
+      fscanf(mf, "%d %d %d", &im1, &im2, &numMatches) == 3;
+    for(int m=0; ok && m < numMatches; m++) {
+      int k1, k2;
+      ok = fscanf(mf, "%d %d", &k1, &k2) == 2;
+    }
+    ok = ok && fgetc(mf) == '\n' && ftell(mf) == matchFileEnd;
+  }
+  fclose(mf);
+
+  if(!ok) {
+    printf("\nMatch file %s does not end with the last checkpointed "
+        "record, cannot resume\n", matchFileName.c_str());
+  }
+  return ok;
+}
+
+bool MatchCheckpoint::commit(long long recordStart, 
+    MatchWriter& matchFile) {
+  if(!matchFile.sync()) {
+    printf("\nError writing match file %s\n", matchFileName.c_str());
+    return false;
+  }
+
+  long long fileEnd = matchFile.tell();
+  for(int p=0; p < (int)pendingPairs.size(); p++) {
+    fprintf(fp, "%d %d\n", pendingPairs[p].first, pendingPairs[p].second);
+  }
+  fprintf(fp, "# %lld %lld\n", recordStart, fileEnd);
+
+  if(fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+    printf("\nError writing checkpoint file %s\n", ckptFileName.c_str());
+    return false;
+  }
+
+  donePairs.insert(pendingPairs.begin(), pendingPairs.end());
+  pendingPairs.clear();
+  lastRecordStart = recordStart;
+  matchFileEnd = fileEnd;
+  lastCommit = time(NULL);
+  return true;
+}
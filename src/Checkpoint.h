@@ -0,0 +1,116 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H 
+
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "PairList.h"
+#include "MatchFile.h"
+
+#include <stdio.h>
+#include <time.h>
+
+namespace match {
+
+/* Default number of seconds between two checkpoints */
+const int DEFAULT_CHECKPOINT_INTERVAL = 60;
+
+/* Progress record of a match-graph run, kept next to the match file
+ * (<matches file>.ckpt) so that a killed run can be resumed.
+ *
+ * The file is only appended to. Every commit appends the pairs that 
+ * were completed since the previous commit, matched or rejected, as 
+ * <i j> lines, followed by a line 
+ *   # <start of last record> <end of match file>
+ * giving the length of the match file after these pairs. The match 
+ * file is synced to disk before the commit line is written, so a 
+ * commit never covers records that were lost in a crash. Pairs after
+ * the last complete commit line are ignored on resume, as is match 
+ * file content beyond the committed length. */
+class MatchCheckpoint {
+  string ckptFileName;
+  string matchFileName;
+  FILE* fp;
+
+  int interval;
+  time_t lastCommit;
+
+  set< ImagePair > donePairs;
+  vector< ImagePair > pendingPairs;
+
+  long long lastRecordStart;
+  long long matchFileEnd;
+
+  bool readCheckpoint();
+  bool checkTrailingRecord();
+
+  public:
+
+  MatchCheckpoint() : fp(NULL), interval(DEFAULT_CHECKPOINT_INTERVAL),
+      lastCommit(0), lastRecordStart(-1), matchFileEnd(0) {}
+  ~MatchCheckpoint();
+
+  static string checkpointFileName(const char* matchFile);
+
+  /* Starts a new checkpoint file for matchFile or, if resume is set,
+   * continues the existing one. On resume, the completed pairs are
+   * read, the last match record is verified and the match file is cut
+   * to the committed length; open the match file for appending only 
+   * after this. */
+  bool open(const char* matchFile, bool resume, int seconds);
+
+  bool isDone(const ImagePair& p) const {
+    return donePairs.find(p) != donePairs.end();
+  }
+
+  int getNumDone() const {
+    return (int)donePairs.size();
+  }
+
+  /* Length of the match file after the committed pairs */
+  long long getMatchFileEnd() const {
+    return matchFileEnd;
+  }
+
+  /* Start of the last record of the match file, -1 if none */
+  long long getLastRecordStart() const {
+    return lastRecordStart;
+  }
+
+  /* Marks a pair as completed; it is recorded by the next commit */
+  void addPair(const ImagePair& p) {
+    pendingPairs.push_back(p);
+  }
+
+  /* True if the interval has passed since the last commit */
+  bool isDue() const {
+    return !pendingPairs.empty() && time(NULL) - lastCommit >= interval;
+  }
+
+  /* Syncs the match file and records the pending pairs; recordStart is
+   * the start of its last record */
+  bool commit(long long recordStart, MatchWriter& matchFile);
+};
+
+};
+#endif //__CHECKPOINT_H 
@@ -0,0 +1,173 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "FMatrixCache.h"
+#include "keys2a.h"
+
+#include <unistd.h>
+
+using namespace match;
+
+FMatrixCache::~FMatrixCache() {
+  close();
+}
+
+static bool writeEntry(FILE* fp, const ImagePair& p, 
+    const FMatrixEntry& e) {
+  const double* F = e.F;
+  return fprintf(fp, "%d %d %d %d %.17g %.17g %.17g %.17g %.17g %.17g "
+      "%.17g %.17g %.17g\n", p.first, p.second, e.numGlobalMatches, 
+      e.numInliers, F[0], F[1], F[2], F[3], F[4], F[5], F[6], F[7], 
+      F[8]) > 0;
+}
+
+/*! \brief Writes the header and the key file stamps of a new cache, 
+ ** followed by the pairs kept from the old one
+ **/
+static bool writeCache(FILE* fp, const string& header, 
+    const vector<long long>& sizes, const vector<long long>& mtimes,
+    const map< ImagePair, FMatrixEntry >& entries) {
+  bool ok = fputs(header.c_str(), fp) >= 0;
+  for(int i=0; i < (int)sizes.size(); i++) {
+    ok = ok && fprintf(fp, "# key %d %lld %lld\n", i, sizes[i], 
+        mtimes[i]) > 0;
+  }
+  map< ImagePair, FMatrixEntry >::const_iterator it;
+  for(it = entries.begin(); it != entries.end(); it++) {
+    ok = ok && writeEntry(fp, it->first, it->second);
+  }
+  return ok;
+}
+
+/*! \brief Reads the pairs of an existing cache and cuts off a last line
+ ** that was cut short by a killed run
+ **
+ **  The key file stamps precede the pairs, so a pair is dropped as it is
+ **  read if either of its key files differs from its stamp. Any changed
+ **  or missing stamp rewrites the file, appending would keep them.
+ **/
+bool FMatrixCache::open(const char* name, const string& params,
+    const vector<string>& keyFiles) {
+  fileName = name;
+  string header = "# fmatrix_cache " + params + "\n";
+
+  /// A key file that cannot be read gets a stamp no cache matches
+  int numImages = keyFiles.size();
+  vector<long long> sizes(numImages, -1);
+  vector<long long> mtimes(numImages, -1);
+  for(int i=0; i < numImages; i++) {
+    GetKeyFileStamp(keyFiles[i].c_str(), &sizes[i], &mtimes[i]);
+  }
+
+  fp = fopen(name, "r+");
+  if(fp != NULL) {
+    char line[1024];
+    long long validEnd = 0;
+    bool sameParams = fgets(line, sizeof(line), fp) != NULL && 
+      header == line;
+    vector<char> changed(numImages, 1);
+    int numDropped = 0;
+    if(sameParams) {
+      validEnd = ftell(fp);
+      while(fgets(line, sizeof(line), fp) != NULL) {
+        if(strchr(line, '\n') == NULL) {
+          break;
+        }
+        int im;
+        long long size, mtime;
+        if(sscanf(line, "# key %d %lld %lld", &im, &size, &mtime) == 3) {
+          if(im >= 0 && im < numImages) {
+            changed[im] = size != sizes[im] || mtime != mtimes[im];
+          }
+          validEnd = ftell(fp);
+          continue;
+        }
+        ImagePair p;
+        FMatrixEntry e;
+        double* F = e.F;
+        if(sscanf(line, "%d %d %d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+              &p.first, &p.second, &e.numGlobalMatches, &e.numInliers,
+              &F[0], &F[1], &F[2], &F[3], &F[4], &F[5], &F[6], &F[7], 
+              &F[8]) != 13) {
+          break;
+        }
+        if(p.first < 0 || p.first >= numImages || p.second < 0 || 
+            p.second >= numImages || changed[p.first] || 
+            changed[p.second]) {
+          numDropped++;
+        } else {
+          entries[p] = e;
+        }
+        validEnd = ftell(fp);
+      }
+    } else {
+      printf("[KeyMatchGeoAware] F-matrix cache %s was made with other "
+          "parameters, starting it anew\n", name);
+    }
+    if(numDropped > 0) {
+      printf("[KeyMatchGeoAware] F-matrix cache %s: dropped %d pairs whose "
+          "key files changed\n", name, numDropped);
+    }
+
+    bool rewrite = !sameParams || 
+      std::find(changed.begin(), changed.end(), 1) != changed.end();
+    if(rewrite) {
+      validEnd = 0;
+    }
+    fflush(fp);
+    if(ftruncate(fileno(fp), (off_t)validEnd) != 0 || 
+        fseek(fp, 0, SEEK_END) != 0) {
+      printf("\nError truncating F-matrix cache %s\n", name);
+      return false;
+    }
+    if(rewrite && !writeCache(fp, header, sizes, mtimes, entries)) {
+      printf("\nError writing F-matrix cache %s\n", name);
+      return false;
+    }
+    return true;
+  }
+
+  fp = fopen(name, "w");
+  if(fp == NULL) {
+    printf("\nError opening F-matrix cache %s\n", name);
+    return false;
+  }
+  writeCache(fp, header, sizes, mtimes, entries);
+  return true;
+}
+
+bool FMatrixCache::add(const ImagePair& p, const FMatrixEntry& e) {
+  numAdded++;
+  return writeEntry(fp, p, e);
+}
+
+bool FMatrixCache::close() {
+  if(fp == NULL) {
+    return true;
+  }
+  bool ok = fclose(fp) == 0;
+  fp = NULL;
+  if(!ok) {
+    printf("\nError writing F-matrix cache %s\n", fileName.c_str());
+  }
+  return ok;
+}
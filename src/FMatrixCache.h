@@ -0,0 +1,98 @@
+#ifndef __FMATRIX_CACHE_H
+#define __FMATRIX_CACHE_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "PairList.h"
+
+#include <stdio.h>
+
+namespace match {
+
+/* Outcome of the global stage and F estimation of one pair */
+struct FMatrixEntry {
+  int numGlobalMatches;
+  int numInliers;
+  double F[9];
+};
+
+/* Cache of the fundamental matrices of a match-graph run, so that runs
+ * with other settings of the later stages can skip the global stage 
+ * and computeFmatrix().
+ *
+ * The file is a text file with the line
+ *   # fmatrix_cache <parameters>
+ * followed by the size and modification time of each key file,
+ *   # key <image> <size> <mtime>
+ * and one line per pair,
+ *   <im1 im2 num_global_matches num_inliers F[0] ... F[8]>
+ * F is stored with all digits, so a reused F is exactly the computed
+ * one. Pairs that fail the global stage are stored too, with F = 0.
+ * A file made with other parameters is started anew. The parameters
+ * are every option that changes an F or the pairs it is stored for:
+ * the global stage options, the RANSAC budget (it picks the 
+ * estimator), the probe (it skips pairs before the global stage) and
+ * the consistency tolerances (the filter is only estimated for pairs
+ * whose F is computed). Pairs of an image whose key file has changed since
+ * (or has no stamp) are dropped and the file is rewritten with the 
+ * current stamps, as GlobalTree does with its cache files. New pairs 
+ * are appended but only the pairs read by open() are looked up, so 
+ * find() may be used from several threads while add() is called from
+ * one. */
+class FMatrixCache {
+  string fileName;
+  FILE* fp;
+  map< ImagePair, FMatrixEntry > entries;
+  int numAdded;
+
+  public:
+
+  FMatrixCache() : fp(NULL), numAdded(0) {}
+  ~FMatrixCache();
+
+  /* Reads the cache if it was made with the same parameters, keeps
+   * the pairs whose key files (in image order) are unchanged and opens
+   * it for adding pairs */
+  bool open(const char* name, const string& params, 
+      const vector<string>& keyFiles);
+
+  const FMatrixEntry* find(const ImagePair& p) const {
+    map< ImagePair, FMatrixEntry >::const_iterator it = entries.find(p);
+    return it == entries.end() ? NULL : &it->second;
+  }
+
+  bool add(const ImagePair& p, const FMatrixEntry& e);
+
+  int getNumRead() const {
+    return (int)entries.size();
+  }
+
+  int getNumAdded() const {
+    return numAdded;
+  }
+
+  bool close();
+};
+
+};
+#endif //__FMATRIX_CACHE_H 
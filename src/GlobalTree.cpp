@@ -0,0 +1,205 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "GlobalTree.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace match;
+
+/* Header of a cache file, followed by the ANN binary tree file */
+struct GlobalTreeFileHeader {
+  char magic[8];
+  long long keyFileSize;
+  long long keyFileMtime;
+  int numPts;
+  int dim;
+  int type;
+  int reserved;
+};
+
+static const char GLOBAL_TREE_MAGIC[8] = "GATREE1";
+
+string GlobalTree::cacheFileName(const char* keyFile) {
+  return string(keyFile) + ".tree";
+}
+
+GlobalTree::~GlobalTree() {
+  switch(type) {
+    case KEY_UINT16:  deleteTree<unsigned short>(); break;
+    case KEY_FLOAT32: deleteTree<float>(); break;
+    default:          deleteTree<unsigned char>(); break;
+  }
+  if(map != NULL) {
+    munmap(map, mapLen);
+  }
+}
+
+template <class Desc>
+void GlobalTree::deleteTree() {
+  delete (ANNkd_treeT<Desc>*)tree;
+  tree = NULL;
+}
+
+/*! \brief Builds the tree, or maps it from the cache file of keyFile.
+ **
+ **  A missing, stale or unreadable cache file is not an error; the tree
+ **  is built and the cache file (re)written. Failing to write the cache 
+ **  file only prints a warning.
+ **/
+bool GlobalTree::init(const unsigned char* keys, int nPts, int d,
+    keydesc_t t, const char* keyFile, bool useCache) {
+  type = t;
+  numPts = nPts;
+  dim = d;
+
+  string cacheFile = cacheFileName(keyFile);
+  switch(type) {
+    case KEY_UINT16:
+      if(useCache && loadTree<unsigned short>(keys, cacheFile.c_str(), 
+            keyFile)) return true;
+      buildTree<unsigned short>(keys);
+      if(useCache) writeTree<unsigned short>(cacheFile.c_str(), keyFile);
+      break;
+    case KEY_FLOAT32:
+      if(useCache && loadTree<float>(keys, cacheFile.c_str(), 
+            keyFile)) return true;
+      buildTree<float>(keys);
+      if(useCache) writeTree<float>(cacheFile.c_str(), keyFile);
+      break;
+    default:
+      if(useCache && loadTree<unsigned char>(keys, cacheFile.c_str(), 
+            keyFile)) return true;
+      buildTree<unsigned char>(keys);
+      if(useCache) writeTree<unsigned char>(cacheFile.c_str(), keyFile);
+      break;
+  }
+  return tree != NULL;
+}
+
+template <class Desc>
+bool GlobalTree::buildTree(const unsigned char* keys) {
+  tree = new ANNkd_treeT<Desc>((const Desc*)keys, numPts, dim, 
+      GLOBAL_TREE_BUCKET_SIZE);
+  loaded = false;
+  return true;
+}
+
+/*! \brief Maps the cache file and attaches the tree to it if the file 
+ **  was written for the current key file and parameters.
+ **/
+template <class Desc>
+bool GlobalTree::loadTree(const unsigned char* keys, 
+    const char* cacheFile, const char* keyFile) {
+  long long keyFileSize, keyFileMtime;
+  if(!GetKeyFileStamp(keyFile, &keyFileSize, &keyFileMtime)) {
+    return false;
+  }
+
+  int fd = open(cacheFile, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || 
+      st.st_size < (off_t)sizeof(GlobalTreeFileHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(addr == MAP_FAILED) {
+    return false;
+  }
+
+  const GlobalTreeFileHeader* hdr = (const GlobalTreeFileHeader*)addr;
+  bool valid = memcmp(hdr->magic, GLOBAL_TREE_MAGIC, 
+        sizeof(hdr->magic)) == 0 &&
+    hdr->keyFileSize == keyFileSize && hdr->keyFileMtime == keyFileMtime &&
+    hdr->numPts == numPts && hdr->dim == dim && hdr->type == (int)type;
+
+  ANNkd_treeT<Desc>* t = new ANNkd_treeT<Desc>();
+  if(valid) {
+    valid = t->BinaryLoad((const char*)addr + sizeof(GlobalTreeFileHeader),
+        st.st_size - sizeof(GlobalTreeFileHeader), (const Desc*)keys) &&
+      t->nPoints() == numPts && t->theDim() == dim;
+  }
+
+  if(!valid) {
+    delete t;
+    munmap(addr, st.st_size);
+    return false;
+  }
+
+  tree = t;
+  map = addr;
+  mapLen = st.st_size;
+  loaded = true;
+  return true;
+}
+
+/*! \brief Writes the tree to the cache file.
+ **
+ **  The file is written under a temporary name and renamed, so an 
+ **  interrupted run or a concurrent reader never sees a partial file.
+ **/
+template <class Desc>
+bool GlobalTree::writeTree(const char* cacheFile, const char* keyFile) {
+  long long keyFileSize, keyFileMtime;
+  if(!GetKeyFileStamp(keyFile, &keyFileSize, &keyFileMtime)) {
+    return false;
+  }
+
+  GlobalTreeFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, GLOBAL_TREE_MAGIC, sizeof(hdr.magic));
+  hdr.keyFileSize = keyFileSize;
+  hdr.keyFileMtime = keyFileMtime;
+  hdr.numPts = numPts;
+  hdr.dim = dim;
+  hdr.type = (int)type;
+
+  char tmpFile[1024];
+  snprintf(tmpFile, sizeof(tmpFile), "%s.%d.tmp", cacheFile, (int)getpid());
+  FILE* fp = fopen(tmpFile, "wb");
+  if(fp == NULL) {
+    printf("\nCould not write tree cache %s", cacheFile);
+    return false;
+  }
+
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+    ((const ANNkd_treeT<Desc>*)tree)->BinaryDump(fp);
+  ok = (fclose(fp) == 0) && ok;
+
+  if(!ok || rename(tmpFile, cacheFile) != 0) {
+    printf("\nCould not write tree cache %s", cacheFile);
+    unlink(tmpFile);
+    return false;
+  }
+  return true;
+}
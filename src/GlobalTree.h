@@ -0,0 +1,112 @@
+#ifndef __GLOBAL_TREE_H
+#define __GLOBAL_TREE_H 
+
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "keys2a.h"
+#include "ANN/ANNkd_treeT.h"
+
+namespace match {
+
+/* Bucket size of global kd-trees */
+const int GLOBAL_TREE_BUCKET_SIZE = 16;
+
+/* Maps a descriptor value type to its keydesc_t */
+template <class Desc> inline keydesc_t descriptorType();
+template <> inline keydesc_t descriptorType<unsigned char>() { 
+  return KEY_UINT8; 
+}
+template <> inline keydesc_t descriptorType<unsigned short>() { 
+  return KEY_UINT16; 
+}
+template <> inline keydesc_t descriptorType<float>() { 
+  return KEY_FLOAT32; 
+}
+
+/* Kd-tree of the top-scale features of one image, used by the global
+ * (first) matching stage. The tree is built once per image and shared by
+ * all pairs the image takes part in.
+ *
+ * With a cache file, the tree is stored on disk in ANN's binary tree
+ * format (see ANNkd_treeT::BinaryDump) behind a small header that records
+ * the size and modification time of the key file and the number, length
+ * and type of the descriptors. In later runs the file is mmapped and 
+ * searched in place if the header still matches, otherwise the tree is
+ * rebuilt and the file rewritten. */
+class GlobalTree {
+  keydesc_t type;
+  int numPts;
+  int dim;
+
+  void* tree;         // ANNkd_treeT<Desc>* for the Desc of type
+  void* map;          // mmapped cache file (if the tree was loaded)
+  size_t mapLen;
+  bool loaded;
+
+  template <class Desc> bool buildTree(const unsigned char* keys);
+  template <class Desc> bool loadTree(const unsigned char* keys,
+      const char* cacheFile, const char* keyFile);
+  template <class Desc> void deleteTree();
+  template <class Desc> bool writeTree(const char* cacheFile, 
+      const char* keyFile);
+
+  GlobalTree(const GlobalTree&);
+  GlobalTree& operator=(const GlobalTree&);
+
+  public:
+
+  GlobalTree() : type(KEY_UINT8), numPts(0), dim(0), tree(NULL), 
+      map(NULL), mapLen(0), loaded(false) {}
+  ~GlobalTree();
+
+  /* Builds the tree of the first numPts descriptors in keys. If 
+   * useCache is set, the tree is read from (or written to) the cache 
+   * file of keyFile, see cacheFileName(). keys must stay valid for the 
+   * lifetime of the tree. */
+  bool init(const unsigned char* keys, int numPts, int dim, 
+      keydesc_t type, const char* keyFile, bool useCache);
+
+  /* Returns the tree if its descriptors are of type Desc, else NULL */
+  template <class Desc> const ANNkd_treeT<Desc>* get() const {
+    if(tree == NULL || type != descriptorType<Desc>()) {
+      return NULL;
+    }
+    return (const ANNkd_treeT<Desc>*)tree;
+  }
+
+  int getNumPoints() const {
+    return numPts;
+  }
+
+  /* True if the tree was mapped from its cache file */
+  bool isLoaded() const {
+    return loaded;
+  }
+
+  /* Name of the cache file of a key file (<key file>.tree) */
+  static string cacheFileName(const char* keyFile);
+};
+
+};
+#endif //__GLOBAL_TREE_H 
@@ -156,7 +156,12 @@ void Gridder::getGridPoints(float x, float y, map<int, int>& gridPts) {
 
     //cout << "Grid Index " << idx << endl;
 
-    vector<int>& pts = gridToPointIndex[idx];
+    /// find() leaves the map untouched, grids are shared between threads
+    map<int, vector<int> >::const_iterator it = gridToPointIndex.find(idx);
+    if(it == gridToPointIndex.end()) {
+        return;
+    }
+    const vector<int>& pts = it->second;
     for(int j=0; j < pts.size(); j++) {
         gridPts.insert(pair< int, int >(pts[j],1.0));
     }
@@ -188,8 +193,11 @@ void Gridder::getNearbyGridPoints(vector<float> x, vector<float> y,
     vector<float> dists(4);
     getGridIndDists(x[i],y[i],idx,dists);
     for(int j=0; j < 4; j++) {
-      vector<int>& pts = gridToPointIndex[idx[j]];
-      gridPts.insert(gridPts.end(), pts.begin(), pts.end());
+      map<int, vector<int> >::const_iterator it = 
+        gridToPointIndex.find(idx[j]);
+      if(it != gridToPointIndex.end()) {
+        gridPts.insert(gridPts.end(), it->second.begin(), it->second.end());
+      }
     }
   }
 }
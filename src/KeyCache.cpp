@@ -0,0 +1,237 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "KeyCache.h"
+
+#include <stdio.h>
+
+using namespace match;
+
+KeyCache::KeyCache(const vector< string >& files, const vector< int >& w,
+    const vector< int >& h, keydesc_t t, int topscale, bool treeCache,
+    bool sketches, long long maxMemory) : keyFiles(files), widths(w), 
+    heights(h), type(t), treeTopscale(topscale), useTreeCache(treeCache), 
+    useSketches(sketches), maxBytes(maxMemory), usedBytes(0), descDim(0), numRequests(0), 
+    numHits(0), numLoads(0), numReloads(0), bytesRead(0), bytesReread(0),
+    numPrefetches(0) {
+  Entry e;
+  e.keys = NULL;
+  e.info = NULL;
+  e.numKeys = 0;
+  e.grid = NULL;
+  e.tree = NULL;
+  e.sketch = NULL;
+  e.bytes = 0;
+  e.numLoads = 0;
+  e.numPins = 0;
+  e.state = ENTRY_EMPTY;
+  entries.assign(keyFiles.size(), e);
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&loaded, NULL);
+}
+
+KeyCache::~KeyCache() {
+  for(int i=0; i < (int)entries.size(); i++) {
+    if(entries[i].state == ENTRY_LOADED) {
+      evict(i);
+    }
+  }
+  pthread_cond_destroy(&loaded);
+  pthread_mutex_destroy(&lock);
+}
+
+/*! \brief Reads the keys of image i and builds its grid, global tree
+ ** and sketches
+ **
+ ** Called without the lock; only the loading thread uses the entry
+ ** until it is marked loaded.
+ **/
+bool KeyCache::load(int i, int* dim) {
+  Entry& e = entries[i];
+
+  *dim = 0;
+  e.numKeys = ReadKeyFile(keyFiles[i].c_str(), &e.keys, &e.info, dim, 
+      type);
+
+  e.grid = new Gridder(16, widths[i], heights[i], e.numKeys, e.info);
+
+  int numTopPts = (int)(e.numKeys*treeTopscale/100);
+  e.tree = new GlobalTree();
+  e.tree->init(e.keys, numTopPts, *dim, type, keyFiles[i].c_str(),
+      useTreeCache);
+
+  if(useSketches) {
+    e.sketch = new KeySketch();
+    e.sketch->init(e.keys, e.numKeys, *dim, type);
+  }
+
+  e.bytes = (long long)e.numKeys*(*dim*KeyDescriptorSize(type) + 
+      sizeof(keypt_t));
+  return true;
+}
+
+void KeyCache::freeEntry(Entry& e) {
+  delete e.tree;
+  delete e.sketch;
+  delete e.grid;
+  delete[] e.keys;
+  delete[] e.info;
+  e.tree = NULL;
+  e.sketch = NULL;
+  e.grid = NULL;
+  e.keys = NULL;
+  e.info = NULL;
+  e.state = ENTRY_EMPTY;
+}
+
+void KeyCache::evict(int i) {
+  Entry& e = entries[i];
+  freeEntry(e);
+  usedBytes -= e.bytes;
+  lru.erase(e.lruPos);
+}
+
+/*! \brief Evicts unpinned images, least recently used first, until the
+ ** loaded keys fit in the budget. Image keep stays loaded.
+ **/
+void KeyCache::evictToBudget(int keep) {
+  list<int>::iterator it = lru.end();
+  while(usedBytes > maxBytes && it != lru.begin()) {
+    --it;
+    int k = *it;
+    if(k == keep || entries[k].numPins > 0) {
+      continue;
+    }
+    ++it;
+    evict(k);
+  }
+}
+
+/*! \brief Loads image i if needed and makes it the most recently used.
+ ** A pinned image is not evicted until it is unpinned.
+ **/
+bool KeyCache::acquire(int i, bool pin) {
+  Entry& e = entries[i];
+
+  pthread_mutex_lock(&lock);
+  if(pin) {
+    numRequests++;
+  }
+
+  /// Another thread may be loading the image already
+  while(e.state == ENTRY_LOADING) {
+    pthread_cond_wait(&loaded, &lock);
+  }
+
+  /// A prefetch never evicts keys to make room, they may be in use 
+  /// sooner than the prefetched ones
+  if(!pin && (e.state == ENTRY_LOADED || usedBytes >= maxBytes)) {
+    pthread_mutex_unlock(&lock);
+    return true;
+  }
+
+  if(e.state == ENTRY_LOADED) {
+    if(pin) {
+      numHits++;
+    }
+    lru.erase(e.lruPos);
+  } else {
+    e.state = ENTRY_LOADING;
+    pthread_mutex_unlock(&lock);
+
+    int dim = 0;
+    bool ok = load(i, &dim);
+
+    pthread_mutex_lock(&lock);
+    if(ok && e.numKeys > 0) {
+      if(descDim == 0) {
+        descDim = dim;
+      } else if(dim != descDim) {
+        printf("\nDescriptor length %d of %s does not match %d\n", 
+            dim, keyFiles[i].c_str(), descDim);
+        ok = false;
+      }
+    }
+    if(!ok) {
+      freeEntry(e);
+      pthread_cond_broadcast(&loaded);
+      pthread_mutex_unlock(&lock);
+      return false;
+    }
+
+    e.state = ENTRY_LOADED;
+    usedBytes += e.bytes;
+    numLoads++;
+    bytesRead += e.bytes;
+    if(e.numLoads++ > 0) {
+      numReloads++;
+      bytesReread += e.bytes;
+    }
+    if(!pin) {
+      numPrefetches++;
+    }
+    pthread_cond_broadcast(&loaded);
+  }
+  lru.push_front(i);
+  e.lruPos = lru.begin();
+
+  if(pin) {
+    e.numPins++;
+    evictToBudget(i);
+  }
+  pthread_mutex_unlock(&lock);
+  return true;
+}
+
+bool KeyCache::acquirePair(int i, int j) {
+  if(!acquire(i, true)) {
+    return false;
+  }
+  if(!acquire(j, true)) {
+    pthread_mutex_lock(&lock);
+    entries[i].numPins--;
+    pthread_mutex_unlock(&lock);
+    return false;
+  }
+  return true;
+}
+
+void KeyCache::releasePair(int i, int j) {
+  pthread_mutex_lock(&lock);
+  entries[i].numPins--;
+  entries[j].numPins--;
+  evictToBudget(-1);
+  pthread_mutex_unlock(&lock);
+}
+
+bool KeyCache::prefetch(int i) {
+  return acquire(i, false);
+}
+
+void KeyCache::printStats() {
+  printf("[KeyMatchGeoAware] Key cache hit %lld of %lld requests (%0.1f%%), "
+      "%d loads (%d reloads, %d prefetched), %0.1f MB read, "
+      "%0.1f MB re-read\n", numHits, numRequests, 
+      numRequests > 0 ? 100.0*numHits/numRequests : 0.0,
+      numLoads, numReloads, numPrefetches, bytesRead/(1024.0*1024.0), 
+      bytesReread/(1024.0*1024.0));
+}
@@ -0,0 +1,143 @@
+#ifndef __KEY_CACHE_H
+#define __KEY_CACHE_H 
+
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "keys2a.h"
+#include "Gridder.h"
+#include "GlobalTree.h"
+#include "KeySketch.h"
+
+#include <list>
+#include <pthread.h>
+
+namespace match {
+
+/* Memory-bounded cache of the per-image data of a match-graph run:
+ * keys, grid, global tree and (if enabled) sketches, loaded when a pair
+ * needs them. Once the
+ * keys (descriptors and keypoints) of the loaded images take more than
+ * maxBytes, the least recently used images are evicted. Images of pairs
+ * being matched are never evicted, so the budget is exceeded if they 
+ * alone do not fit. The cache may be used from several threads; an 
+ * image is loaded by one thread while the others wait for it. */
+class KeyCache {
+  enum entrystate_t { ENTRY_EMPTY, ENTRY_LOADING, ENTRY_LOADED };
+
+  struct Entry {
+    unsigned char* keys;
+    keypt_t* info;
+    int numKeys;
+    Gridder* grid;
+    GlobalTree* tree;
+    KeySketch* sketch;
+    long long bytes;
+    int numLoads;
+    int numPins;
+    entrystate_t state;
+    list<int>::iterator lruPos;
+  };
+
+  vector< string > keyFiles;
+  vector< int > widths;
+  vector< int > heights;
+  keydesc_t type;
+  int treeTopscale;
+  bool useTreeCache;
+  bool useSketches;
+  long long maxBytes;
+
+  vector< Entry > entries;
+  list< int > lru;
+  long long usedBytes;
+  int descDim;
+
+  long long numRequests;
+  long long numHits;
+  int numLoads;
+  int numReloads;
+  long long bytesRead;
+  long long bytesReread;
+  int numPrefetches;
+
+  /// Guards all but the data of loaded entries
+  pthread_mutex_t lock;
+  pthread_cond_t loaded;
+
+  bool load(int i, int* dim);
+  void freeEntry(Entry& e);
+  void evict(int i);
+  void evictToBudget(int keep);
+  bool acquire(int i, bool pin);
+
+  public:
+
+  KeyCache(const vector< string >& files, const vector< int >& w,
+      const vector< int >& h, keydesc_t t, int topscale, bool treeCache,
+      bool sketches, long long maxMemory);
+  ~KeyCache();
+
+  /* Makes sure the data of images i and j is loaded and keeps it 
+   * until releasePair(i, j) */
+  bool acquirePair(int i, int j);
+  void releasePair(int i, int j);
+
+  /* Loads image i ahead of its use if it is not loaded yet and the
+   * budget is not used up. Nothing is evicted for it. */
+  bool prefetch(int i);
+
+  unsigned char* getKeys(int i) {
+    return entries[i].keys;
+  }
+
+  keypt_t* getKeysInfo(int i) {
+    return entries[i].info;
+  }
+
+  int getNumKeys(int i) {
+    return entries[i].numKeys;
+  }
+
+  Gridder* getGrid(int i) {
+    return entries[i].grid;
+  }
+
+  GlobalTree* getGlobalTree(int i) {
+    return entries[i].tree;
+  }
+
+  /* NULL unless the cache was created with sketches */
+  KeySketch* getSketch(int i) {
+    return entries[i].sketch;
+  }
+
+  int getDescriptorDim() {
+    return descDim;
+  }
+
+  void printStats();
+};
+
+};
+#endif //__KEY_CACHE_H 
@@ -0,0 +1,84 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "KeySketch.h"
+
+using namespace match;
+
+/*! \brief Draws the coordinate pairs of the sketch bits for descriptors
+ **  of length dim
+ **/
+static void sketchPairs(int dim, vector<int>& first, vector<int>& second) {
+  first.resize(KEY_SKETCH_BITS);
+  second.resize(KEY_SKETCH_BITS);
+  unsigned int seed = KEY_SKETCH_SEED;
+  for(int b=0; b < KEY_SKETCH_BITS; b++) {
+    first[b] = rand_r(&seed) % dim;
+    second[b] = rand_r(&seed) % (dim - 1);
+    if(second[b] >= first[b]) {
+      second[b]++;
+    }
+  }
+}
+
+/*! \brief Sketches of descriptors with values of type Desc
+ **/
+template <class Desc>
+static void sketchKeys(const Desc* keys, int numPts, int dim,
+    unsigned long long* bits) {
+  vector<int> first, second;
+  sketchPairs(dim, first, second);
+  for(int i=0; i < numPts; i++) {
+    const Desc* desc = keys + (size_t)i*dim;
+    unsigned long long* sketch = bits + (size_t)i*KEY_SKETCH_WORDS;
+    for(int w=0; w < KEY_SKETCH_WORDS; w++) {
+      unsigned long long word = 0;
+      for(int k=0; k < 64; k++) {
+        int b = w*64 + k;
+        if(desc[first[b]] > desc[second[b]]) {
+          word |= 1ULL << k;
+        }
+      }
+      sketch[w] = word;
+    }
+  }
+}
+
+void KeySketch::init(const unsigned char* keys, int num, int dim,
+    keydesc_t type) {
+  numPts = num;
+  bits.assign((size_t)numPts*KEY_SKETCH_WORDS, 0);
+  if(numPts == 0 || dim < 2) {
+    return;
+  }
+  switch(type) {
+    case KEY_UINT16:
+      sketchKeys((const unsigned short*)keys, numPts, dim, bits.data());
+      break;
+    case KEY_FLOAT32:
+      sketchKeys((const float*)keys, numPts, dim, bits.data());
+      break;
+    default:
+      sketchKeys(keys, numPts, dim, bits.data());
+      break;
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef __KEY_SKETCH_H
+#define __KEY_SKETCH_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "keys2a.h"
+
+namespace match {
+
+/* Bits of a sketch, in 64-bit words */
+const int KEY_SKETCH_BITS = 256;
+const int KEY_SKETCH_WORDS = KEY_SKETCH_BITS/64;
+
+/* Seed of the descriptor coordinate pairs compared by the sketch bits */
+const unsigned int KEY_SKETCH_SEED = 12345;
+
+/* Binary sketches of the descriptors of one image, built once when the
+ * keys are loaded. Bit b of a sketch is set if coordinate a_b of the
+ * descriptor is larger than coordinate c_b, for KEY_SKETCH_BITS pairs
+ * (a_b, c_b) drawn with a fixed seed: a random projection onto 
+ * e_a - e_c, so sketches of different images are comparable without any
+ * statistics of the images. The Hamming distance of two sketches grows
+ * with the angle between the descriptors and is used to rank candidates
+ * before their exact distance is computed. */
+class KeySketch {
+  int numPts;
+  vector< unsigned long long > bits;
+
+  public:
+  KeySketch() : numPts(0) {}
+
+  /* Sketches of numPts descriptors of length dim and value type type */
+  void init(const unsigned char* keys, int numPts, int dim, 
+      keydesc_t type);
+
+  int getNumPts() const {
+    return numPts;
+  }
+
+  const unsigned long long* getSketch(int i) const {
+    return &bits[i*KEY_SKETCH_WORDS];
+  }
+
+  long long getBytes() const {
+    return (long long)bits.size()*sizeof(unsigned long long);
+  }
+};
+
+/* Hamming distance of two sketches */
+inline int SketchDistance(const unsigned long long* a, 
+    const unsigned long long* b) {
+  int dist = 0;
+  for(int w=0; w < KEY_SKETCH_WORDS; w++) {
+    dist += __builtin_popcountll(a[w] ^ b[w]);
+  }
+  return dist;
+}
+
+};
+#endif //__KEY_SKETCH_H
@@ -0,0 +1,256 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "KeyStore.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace match;
+
+/* Header of a key store, followed by numImages KeyStoreEntry, the key
+ * file names and the aligned arrays */
+struct KeyStoreHeader {
+  char magic[8];
+  int numImages;
+  int dim;
+  int type;
+  int reserved;
+  long long size;
+};
+
+namespace match {
+struct KeyStoreEntry {
+  long long descOffset;
+  long long infoOffset;
+  long long nameOffset;
+  int numKeys;
+  int reserved;
+};
+};
+
+static const char KEY_STORE_MAGIC[8] = "GAKEYS1";
+
+static long long alignUp(long long n, long long a) {
+  return (n + a - 1)/a*a;
+}
+
+bool KeyStore::isShmName(const char* name) {
+  return name[0] == '/' && strchr(name + 1, '/') == NULL;
+}
+
+static int openStore(const char* name, int flags, mode_t mode) {
+  if(KeyStore::isShmName(name)) {
+    return shm_open(name, flags, mode);
+  }
+  return ::open(name, flags, mode);
+}
+
+/*! \brief Writes len bytes at offset, retrying short writes
+ **/
+static bool writeAt(int fd, const void* buf, long long len, 
+    long long offset) {
+  const char* p = (const char*)buf;
+  while(len > 0) {
+    ssize_t n = pwrite(fd, p, len, (off_t)offset);
+    if(n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+bool KeyStore::remove(const char* name) {
+  if(isShmName(name)) {
+    return shm_unlink(name) == 0;
+  }
+  return unlink(name) == 0;
+}
+
+/*! \brief Packs the key files one at a time; the header and index are
+ **  written last, so a store that failed half way is never valid.
+ **/
+bool KeyStore::pack(const char* name, const vector<string>& keyFiles,
+    keydesc_t type, bool hugePages) {
+  int n = keyFiles.size();
+
+  /// A new object, so that processes still mapping an old store 
+  /// keep their copy
+  remove(name);
+  int fd = openStore(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if(fd < 0) {
+    printf("\nError creating key store %s\n", name);
+    return false;
+  }
+
+  KeyStoreHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, KEY_STORE_MAGIC, sizeof(header.magic));
+  header.numImages = n;
+  header.type = (int)type;
+
+  vector< KeyStoreEntry > entries(n);
+  memset(entries.data(), 0, n*sizeof(KeyStoreEntry));
+
+  long long offset = sizeof(KeyStoreHeader) + n*sizeof(KeyStoreEntry);
+  bool ok = true;
+  for(int i=0; ok && i < n; i++) {
+    entries[i].nameOffset = offset;
+    ok = writeAt(fd, keyFiles[i].c_str(), keyFiles[i].size() + 1, offset);
+    offset += keyFiles[i].size() + 1;
+  }
+
+  for(int i=0; ok && i < n; i++) {
+    unsigned char* keys = NULL;
+    keypt_t* info = NULL;
+    int dim = 0;
+    int numKeys = ReadKeyFile(keyFiles[i].c_str(), &keys, &info, &dim, 
+        type);
+
+    if(numKeys > 0) {
+      if(header.dim == 0) {
+        header.dim = dim;
+      } else if(dim != header.dim) {
+        printf("\nDescriptor length %d of %s does not match %d\n", 
+            dim, keyFiles[i].c_str(), header.dim);
+        ok = false;
+      }
+    }
+
+    long long descLen = (long long)numKeys*dim*KeyDescriptorSize(type);
+    long long infoLen = (long long)numKeys*sizeof(keypt_t);
+
+    entries[i].numKeys = numKeys;
+    entries[i].descOffset = alignUp(offset, KEY_STORE_ALIGN);
+    entries[i].infoOffset = alignUp(entries[i].descOffset + descLen, 
+        KEY_STORE_ALIGN);
+    offset = entries[i].infoOffset + infoLen;
+
+    ok = ok && writeAt(fd, keys, descLen, entries[i].descOffset) &&
+      writeAt(fd, info, infoLen, entries[i].infoOffset);
+
+    delete[] keys;
+    delete[] info;
+  }
+
+  header.size = alignUp(offset, hugePages ? KEY_STORE_HUGE_PAGE : 
+      KEY_STORE_ALIGN);
+  ok = ok && ftruncate(fd, (off_t)header.size) == 0 &&
+    writeAt(fd, entries.data(), n*sizeof(KeyStoreEntry), 
+        sizeof(KeyStoreHeader)) &&
+    writeAt(fd, &header, sizeof(header), 0);
+  close(fd);
+
+  if(!ok) {
+    printf("\nError writing key store %s\n", name);
+    remove(name);
+  }
+  return ok;
+}
+
+KeyStore::~KeyStore() {
+  if(map != NULL) {
+    munmap(map, mapLen);
+  }
+}
+
+bool KeyStore::open(const char* name, bool hugePages) {
+  int fd = openStore(name, O_RDONLY, 0);
+  if(fd < 0) {
+    printf("\nError opening key store %s\n", name);
+    return false;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(KeyStoreHeader)) {
+    printf("\nInvalid key store %s\n", name);
+    close(fd);
+    return false;
+  }
+
+  mapLen = st.st_size;
+  map = mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED) {
+    map = NULL;
+    printf("\nError mapping key store %s\n", name);
+    return false;
+  }
+#ifdef MADV_HUGEPAGE
+  if(hugePages) {
+    madvise(map, mapLen, MADV_HUGEPAGE);
+  }
+#endif
+
+  const KeyStoreHeader* header = (const KeyStoreHeader*)map;
+  bool ok = memcmp(header->magic, KEY_STORE_MAGIC, 
+      sizeof(header->magic)) == 0 && header->size == mapLen &&
+    header->numImages >= 0 && (long long)sizeof(KeyStoreHeader) + 
+    header->numImages*(long long)sizeof(KeyStoreEntry) <= mapLen;
+
+  entries = (const KeyStoreEntry*)((const char*)map + 
+      sizeof(KeyStoreHeader));
+  int descSize = ok ? KeyDescriptorSize((keydesc_t)header->type) : 0;
+  for(int i=0; ok && i < header->numImages; i++) {
+    const KeyStoreEntry& e = entries[i];
+    ok = e.numKeys >= 0 && e.nameOffset < mapLen &&
+      e.descOffset % KEY_STORE_ALIGN == 0 &&
+      e.descOffset + (long long)e.numKeys*header->dim*descSize <= mapLen &&
+      e.infoOffset % KEY_STORE_ALIGN == 0 &&
+      e.infoOffset + e.numKeys*(long long)sizeof(keypt_t) <= mapLen;
+  }
+
+  if(!ok) {
+    printf("\nInvalid key store %s\n", name);
+    munmap(map, mapLen);
+    map = NULL;
+    entries = NULL;
+    return false;
+  }
+
+  numImages = header->numImages;
+  dim = header->dim;
+  type = (keydesc_t)header->type;
+  return true;
+}
+
+int KeyStore::getNumKeys(int i) const {
+  return entries[i].numKeys;
+}
+
+const char* KeyStore::getKeyFileName(int i) const {
+  return (const char*)map + entries[i].nameOffset;
+}
+
+const unsigned char* KeyStore::getKeys(int i) const {
+  return (const unsigned char*)map + entries[i].descOffset;
+}
+
+const keypt_t* KeyStore::getKeysInfo(int i) const {
+  return (const keypt_t*)((const char*)map + entries[i].infoOffset);
+}
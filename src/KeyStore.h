@@ -0,0 +1,100 @@
+#ifndef __KEY_STORE_H
+#define __KEY_STORE_H 
+
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "keys2a.h"
+
+namespace match {
+
+/* Alignment of the descriptor and keypoint arrays in a key store */
+const int KEY_STORE_ALIGN = 64;
+
+/* Size to which a key store meant for huge pages is padded */
+const long long KEY_STORE_HUGE_PAGE = 2*1024*1024;
+
+struct KeyStoreEntry;
+
+/* Read-only packed copy of the key files of a collection, shared by 
+ * all match_graph processes of a host.
+ *
+ * The store holds a header, an index entry and the key file name per
+ * image, and per image the descriptors (as read by ReadKeyFile) and the
+ * keypt_t array, each starting at a multiple of KEY_STORE_ALIGN bytes.
+ * It is written once by pack() and mapped read-only by open(), so all
+ * processes share one physical copy and need not parse key files.
+ *
+ * A store name of the form "/name" (one leading slash only) is a POSIX
+ * shared memory object (shm_open), anything else is a file name, e.g. 
+ * a file on a hugetlbfs mount. */
+class KeyStore {
+  void* map;
+  long long mapLen;
+
+  int numImages;
+  int dim;
+  keydesc_t type;
+
+  const KeyStoreEntry* entries;
+
+  public:
+
+  KeyStore() : map(NULL), mapLen(0), numImages(0), dim(0), 
+      type(KEY_UINT8), entries(NULL) {}
+  ~KeyStore();
+
+  static bool isShmName(const char* name);
+
+  /* Reads the key files and writes them to the store. With hugePages 
+   * the store size is padded to a multiple of KEY_STORE_HUGE_PAGE. */
+  static bool pack(const char* name, const vector<string>& keyFiles,
+      keydesc_t type, bool hugePages);
+
+  /* Removes the store */
+  static bool remove(const char* name);
+
+  /* Maps the store read-only; with hugePages, asks for transparent 
+   * huge pages for the mapping */
+  bool open(const char* name, bool hugePages);
+
+  int getNumImages() const {
+    return numImages;
+  }
+
+  int getDescriptorDim() const {
+    return dim;
+  }
+
+  keydesc_t getDescriptorType() const {
+    return type;
+  }
+
+  int getNumKeys(int i) const;
+  const char* getKeyFileName(int i) const;
+  const unsigned char* getKeys(int i) const;
+  const keypt_t* getKeysInfo(int i) const;
+};
+
+};
+#endif //__KEY_STORE_H 
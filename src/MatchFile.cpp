@@ -0,0 +1,342 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "MatchFile.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace match;
+
+static const char MATCH_MAGIC[9] = "GAMATCH1";
+static const char MATCH_INDEX_MAGIC[9] = "GAINDEX1";
+
+bool match::ParseMatchFormat(const char* name, matchformat_t* format) {
+  if(strcmp(name, "text") == 0) {
+    *format = MATCH_TEXT;
+  } else if(strcmp(name, "binary") == 0) {
+    *format = MATCH_BINARY;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void putVarint(string& buf, unsigned long long v) {
+  while(v >= 0x80) {
+    buf += (char)(v | 0x80);
+    v >>= 7;
+  }
+  buf += (char)v;
+}
+
+static unsigned int zigzag(int v) {
+  return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static int unzigzag(unsigned int v) {
+  return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static bool getVarint(FILE* fp, unsigned long long* v) {
+  *v = 0;
+  for(int shift=0; shift < 64; shift += 7) {
+    int c = fgetc(fp);
+    if(c == EOF) {
+      return false;
+    }
+    *v |= (unsigned long long)(c & 0x7f) << shift;
+    if((c & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*! \brief Writes len bytes at offset, retrying short writes
+ **/
+static bool writeAt(int fd, const char* p, long long len, 
+    long long offset) {
+  while(len > 0) {
+    ssize_t n = pwrite(fd, p, len, (off_t)offset);
+    if(n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+
+MatchWriter::~MatchWriter() {
+  if(fd >= 0) {
+    close();
+  }
+}
+
+/*! \brief Writes the handed off buffers until the writer is closed
+ **/
+void* MatchWriter::writeThread(void* arg) {
+  MatchWriter* w = (MatchWriter*)arg;
+
+  pthread_mutex_lock(&w->lock);
+  while(true) {
+    while(!w->hasPending && !w->stop) {
+      pthread_cond_wait(&w->changed, &w->lock);
+    }
+    if(!w->hasPending) {
+      break;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    /// Only this thread uses the pending buffer until it is released
+    bool ok = writeAt(w->fd, w->pending.data(), w->pending.size(),
+        w->pendingOffset);
+
+    pthread_mutex_lock(&w->lock);
+    if(!ok) {
+      w->failed = true;
+    }
+    w->hasPending = false;
+    pthread_cond_broadcast(&w->changed);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+bool MatchWriter::open(const char* name, matchformat_t f, bool append,
+    int bufSize) {
+  if(append && f != MATCH_TEXT) {
+    printf("\nAppending is only supported for text match files\n");
+    return false;
+  }
+
+  fd = ::open(name, O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+  if(fd < 0) {
+    printf("\nError opening match file %s\n", name);
+    return false;
+  }
+  pthread_mutex_init(&lock, NULL);
+  pthread_cond_init(&changed, NULL);
+
+  format = f;
+  bufferSize = bufSize;
+  buffer.reserve(bufferSize);
+  pending.reserve(bufferSize);
+  index.clear();
+  failed = false;
+  stop = false;
+  hasPending = false;
+
+  fileEnd = 0;
+  if(append) {
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      return false;
+    }
+    fileEnd = st.st_size;
+  }
+
+  /// Without the thread, buffers are written when they are handed off
+  running = pthread_create(&thread, NULL, writeThread, this) == 0;
+
+  if(format == MATCH_BINARY) {
+    writeRaw(MATCH_MAGIC, 8);
+  }
+  return true;
+}
+
+/*! \brief Gives the filled buffer to the write thread, waiting for the
+ ** previous one to be written first
+ **/
+void MatchWriter::handOff() {
+  if(buffer.empty()) {
+    return;
+  }
+  if(!running) {
+    failed = failed || 
+      !writeAt(fd, buffer.data(), buffer.size(), fileEnd - buffer.size());
+    buffer.clear();
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  while(hasPending) {
+    pthread_cond_wait(&changed, &lock);
+  }
+  pending.swap(buffer);
+  pendingOffset = fileEnd - pending.size();
+  hasPending = true;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+  buffer.clear();
+}
+
+void MatchWriter::writeRaw(const char* data, int len) {
+  buffer.append(data, len);
+  fileEnd += len;
+  if((int)buffer.size() >= bufferSize) {
+    handOff();
+  }
+}
+
+void MatchWriter::writeRecord(int im1, int im2, 
+    const vector< pair<int, int> >& m) {
+  int start = buffer.size();
+
+  if(format == MATCH_BINARY) {
+    MatchIndexEntry e;
+    e.im1 = im1;
+    e.im2 = im2;
+    e.offset = fileEnd;
+    e.numMatches = m.size();
+    e.reserved = 0;
+    index.push_back(e);
+
+    putVarint(buffer, im1);
+    putVarint(buffer, im2);
+    putVarint(buffer, m.size());
+    int prev1 = 0;
+    int prev2 = 0;
+    for(int k=0; k < (int)m.size(); k++) {
+      putVarint(buffer, (unsigned int)(m[k].first - prev1));
+      putVarint(buffer, zigzag(m[k].second - prev2));
+      prev1 = m[k].first;
+      prev2 = m[k].second;
+    }
+  } else {
+    char line[64];
+    int len = sprintf(line, "%d %d\n%d\n", im1, im2, (int)m.size());
+    buffer.append(line, len);
+    for(int k=0; k < (int)m.size(); k++) {
+      len = sprintf(line, "%d %d\n", m[k].first, m[k].second);
+      buffer.append(line, len);
+    }
+  }
+
+  fileEnd += buffer.size() - start;
+  if((int)buffer.size() >= bufferSize) {
+    handOff();
+  }
+}
+
+bool MatchWriter::flush() {
+  handOff();
+  pthread_mutex_lock(&lock);
+  while(hasPending) {
+    pthread_cond_wait(&changed, &lock);
+  }
+  bool ok = !failed;
+  pthread_mutex_unlock(&lock);
+  return ok;
+}
+
+bool MatchWriter::sync() {
+  return flush() && fsync(fd) == 0;
+}
+
+bool MatchWriter::close() {
+  if(fd < 0) {
+    return false;
+  }
+
+  if(format == MATCH_BINARY) {
+    long long indexOffset = fileEnd;
+    long long numRecords = index.size();
+    if(!index.empty()) {
+      writeRaw((const char*)index.data(), 
+          index.size()*sizeof(MatchIndexEntry));
+    }
+    writeRaw((const char*)&indexOffset, sizeof(indexOffset));
+    writeRaw((const char*)&numRecords, sizeof(numRecords));
+    writeRaw(MATCH_INDEX_MAGIC, 8);
+  }
+
+  bool ok = flush();
+
+  pthread_mutex_lock(&lock);
+  stop = true;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+  if(running) {
+    pthread_join(thread, NULL);
+    running = false;
+  }
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+
+  ok = ::close(fd) == 0 && ok;
+  fd = -1;
+  return ok;
+}
+
+bool match::ReadMatchIndex(FILE* fp, vector< MatchIndexEntry >& index) {
+  char magic[8];
+  long long trailer[2];
+  if(fseeko(fp, 0, SEEK_SET) != 0 || fread(magic, 1, 8, fp) != 8 ||
+      memcmp(magic, MATCH_MAGIC, 8) != 0) {
+    return false;
+  }
+  if(fseeko(fp, -24, SEEK_END) != 0 || 
+      fread(trailer, sizeof(long long), 2, fp) != 2 ||
+      fread(magic, 1, 8, fp) != 8 || 
+      memcmp(magic, MATCH_INDEX_MAGIC, 8) != 0) {
+    return false;
+  }
+
+  long long indexOffset = trailer[0];
+  long long numRecords = trailer[1];
+  index.resize(numRecords);
+  if(numRecords == 0) {
+    return true;
+  }
+  return fseeko(fp, (off_t)indexOffset, SEEK_SET) == 0 &&
+    fread(index.data(), sizeof(MatchIndexEntry), numRecords, fp) == 
+    (size_t)numRecords;
+}
+
+bool match::ReadMatchRecord(FILE* fp, const MatchIndexEntry& e,
+    vector< pair<int, int> >& matches) {
+  unsigned long long im1, im2, n;
+  if(fseeko(fp, (off_t)e.offset, SEEK_SET) != 0 || 
+      !getVarint(fp, &im1) || !getVarint(fp, &im2) || 
+      !getVarint(fp, &n) || im1 != (unsigned long long)e.im1 || 
+      im2 != (unsigned long long)e.im2 || 
+      n != (unsigned long long)e.numMatches) {
+    return false;
+  }
+
+  matches.resize(n);
+  int prev1 = 0;
+  int prev2 = 0;
+  for(int k=0; k < e.numMatches; k++) {
+    unsigned long long d1, d2;
+    if(!getVarint(fp, &d1) || !getVarint(fp, &d2)) {
+      return false;
+    }
+    prev1 += (int)d1;
+    prev2 += unzigzag((unsigned int)d2);
+    matches[k] = make_pair(prev1, prev2);
+  }
+  return true;
+}
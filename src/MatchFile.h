@@ -0,0 +1,134 @@
+#ifndef __MATCH_FILE_H
+#define __MATCH_FILE_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+namespace match {
+
+/* Layout of a match file */
+enum matchformat_t {
+  MATCH_TEXT = 0,   /* <im1 im2\n num_matches\n keyIdx1 keyIdx2\n...> */
+  MATCH_BINARY      /* see MatchWriter */
+};
+
+/* Parses "text" or "binary" */
+bool ParseMatchFormat(const char* name, matchformat_t* format);
+
+/* Default size of each of the two buffers of a MatchWriter */
+const int DEFAULT_MATCH_WRITE_BUFFER = 8*1024*1024;
+
+/* Entry of the index at the end of a binary match file */
+struct MatchIndexEntry {
+  int im1;
+  int im2;
+  long long offset;
+  int numMatches;
+  int reserved;
+};
+
+/* Buffered writer of a match file. Records are formatted into one of
+ * two large buffers while a background thread writes the other one out,
+ * so the writer never waits for the disk unless both are full.
+ *
+ * A binary match file starts with the 8 byte magic "GAMATCH1". Each 
+ * record is a sequence of unsigned LEB128 varints: im1, im2, the number
+ * of matches and, per match (sorted by keyIdx1), the difference of 
+ * keyIdx1 to that of the previous match and the zigzag coded difference
+ * of keyIdx2 to that of the previous match (both 0 before the first 
+ * match). The records are followed by one MatchIndexEntry per record
+ * and a trailer of the index offset, the number of records (both 
+ * 64 bit) and the magic "GAINDEX1". */
+class MatchWriter {
+  int fd;
+  matchformat_t format;
+  int bufferSize;
+
+  /// Buffer being filled, and the buffer being written by the thread
+  string buffer;
+  string pending;
+  long long pendingOffset;
+  bool hasPending;
+
+  /// End of the file, including the buffered data
+  long long fileEnd;
+  vector< MatchIndexEntry > index;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  bool running;
+  bool stop;
+  bool failed;
+
+  static void* writeThread(void* arg);
+  void handOff();
+
+  public:
+
+  MatchWriter() : fd(-1), format(MATCH_TEXT), 
+      bufferSize(DEFAULT_MATCH_WRITE_BUFFER), pendingOffset(0),
+      hasPending(false), fileEnd(0), running(false), stop(false), 
+      failed(false) {}
+  ~MatchWriter();
+
+  /* Opens the file for writing; with append the existing content is 
+   * kept and records are added at its end. Appending is only 
+   * supported for text files. */
+  bool open(const char* name, matchformat_t f, bool append, 
+      int bufSize = DEFAULT_MATCH_WRITE_BUFFER);
+
+  /* Adds data as it is, e.g. the records of an existing text file */
+  void writeRaw(const char* data, int len);
+
+  /* Adds the record of the matches between im1 and im2, sorted by 
+   * keyIdx1 */
+  void writeRecord(int im1, int im2, const vector< pair<int, int> >& m);
+
+  /* Offset at which the next record starts */
+  long long tell() {
+    return fileEnd;
+  }
+
+  /* Waits until everything added so far is written */
+  bool flush();
+
+  /* Waits until everything added so far is written and on disk */
+  bool sync();
+
+  /* Writes the index (binary) and closes the file */
+  bool close();
+};
+
+/* Reads the index of a binary match file */
+bool ReadMatchIndex(FILE* fp, vector< MatchIndexEntry >& index);
+
+/* Reads the matches of the record of index entry e */
+bool ReadMatchRecord(FILE* fp, const MatchIndexEntry& e, 
+    vector< pair<int, int> >& matches);
+
+};
+#endif //__MATCH_FILE_H 
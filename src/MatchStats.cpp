@@ -0,0 +1,364 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "MatchStats.h"
+#include "Trace.h"
+
+#include <time.h>
+
+using namespace match;
+
+static const char* STAGE_NAMES[NUM_MATCH_STAGES] = {
+  "load", "probe", "global", "ransac", "lines", "cluster", "candidates",
+  "tree", "search", "verify"
+};
+
+static const char* COUNTER_NAMES[NUM_MATCH_COUNTERS] = {
+  "groups", "queries", "candidates", "ratio_rejects", "epipolar_rejects",
+  "capped_groups", "padded_groups", "consistency_rejects",
+  "sketch_rejects"
+};
+
+static const char* BUDGET_NAMES[] = {
+  "time", "comparisons", "ransac"
+};
+
+/* Fields of ANNsearchStats */
+const int NUM_SEARCH_FIELDS = 7;
+
+static const char* SEARCH_FIELD_NAMES[NUM_SEARCH_FIELDS] = {
+  "searches", "nodes", "leaves", "points", "coords", "abandons", 
+  "truncated"
+};
+
+static void searchFields(const ann_1_1_char::ANNsearchStats& s, 
+    long long* fields) {
+  fields[0] = s.searches;
+  fields[1] = s.nodes;
+  fields[2] = s.leaves;
+  fields[3] = s.points;
+  fields[4] = s.coords;
+  fields[5] = s.abandons;
+  fields[6] = s.truncated;
+}
+
+const char* match::MatchStageName(int stage) {
+  return STAGE_NAMES[stage];
+}
+
+const char* match::MatchCounterName(int counter) {
+  return COUNTER_NAMES[counter];
+}
+
+string match::BudgetFlagNames(int flags) {
+  string names;
+  for(int b=0; b < 3; b++) {
+    if(flags & (1 << b)) {
+      names += (names.empty() ? "" : "+");
+      names += BUDGET_NAMES[b];
+    }
+  }
+  return names.empty() ? string("none") : names;
+}
+
+double match::WallTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec*1e-9;
+}
+
+void PairStats::clear() {
+  im1 = -1;
+  im2 = -1;
+  for(int s=0; s < NUM_MATCH_STAGES; s++) {
+    stageTime[s] = 0.0;
+  }
+  for(int c=0; c < NUM_MATCH_COUNTERS; c++) {
+    counters[c] = 0;
+  }
+  for(int b=0; b < CANDIDATE_HIST_BINS; b++) {
+    candidateHist[b] = 0;
+  }
+  budget = BUDGET_NONE;
+  globalSearch.reset();
+  matchSearch.reset();
+  trace = NULL;
+  pair = -1;
+  perf = NULL;
+  memset(stagePerf, 0, sizeof(stagePerf));
+  memset(pairPerf, 0, sizeof(pairPerf));
+}
+
+void PairStats::add(const PairStats& s) {
+  for(int st=0; st < NUM_MATCH_STAGES; st++) {
+    stageTime[st] += s.stageTime[st];
+    for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+      stagePerf[st][c] += s.stagePerf[st][c];
+    }
+  }
+  for(int c=0; c < NUM_MATCH_COUNTERS; c++) {
+    counters[c] += s.counters[c];
+  }
+  for(int b=0; b < CANDIDATE_HIST_BINS; b++) {
+    candidateHist[b] += s.candidateHist[b];
+  }
+  globalSearch.add(s.globalSearch);
+  matchSearch.add(s.matchSearch);
+  for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+    pairPerf[c] += s.pairPerf[c];
+  }
+}
+
+/*! \brief Adds the hardware counts since begin to counts
+ **/
+static void addPerfSince(PerfCounterGroup* perf, 
+    const unsigned long long* begin, unsigned long long* counts) {
+  unsigned long long now[NUM_PERF_COUNTERS];
+  if(!perf->read(now)) {
+    return;
+  }
+  for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+    if(now[c] > begin[c]) {
+      counts[c] += now[c] - begin[c];
+    }
+  }
+}
+
+void PairStats::beginStage(matchstage_t stage, StageMark* mark) {
+  if(trace != NULL && stage < STAGE_CANDIDATES) {
+    trace->add(STAGE_NAMES[stage], 'B', pair);
+  }
+  mark->time = WallTime();
+  if(perf != NULL && !perf->read(mark->perf)) {
+    memset(mark->perf, 0, sizeof(mark->perf));
+  }
+}
+
+/*! \brief Adds the time and hardware counts since mark to a stage. The
+ **  counters are read before the clock, so that neither includes the 
+ **  cost of reading the other.
+ **/
+void PairStats::endStage(matchstage_t stage, const StageMark& mark) {
+  if(perf != NULL) {
+    addPerfSince(perf, mark.perf, stagePerf[stage]);
+  }
+  stageTime[stage] += WallTime() - mark.time;
+  if(trace != NULL && stage < STAGE_CANDIDATES) {
+    trace->add(STAGE_NAMES[stage], 'E', pair);
+  }
+}
+
+void PairStats::addCandidateSet(int size) {
+  counters[COUNT_CANDIDATES] += size;
+  int b = 0;
+  for(int bound = CANDIDATE_HIST_BASE; b < CANDIDATE_HIST_BINS - 1 && 
+      size >= bound; bound *= 2) {
+    b++;
+  }
+  candidateHist[b]++;
+}
+
+void PairStats::beginPair(StageMark* mark) {
+  mark->time = WallTime();
+  if(perf != NULL && !perf->read(mark->perf)) {
+    memset(mark->perf, 0, sizeof(mark->perf));
+  }
+}
+
+void PairStats::endPair(const StageMark& mark) {
+  if(perf != NULL) {
+    addPerfSince(perf, mark.perf, pairPerf);
+  }
+}
+
+bool match::ParseStatsFormat(const char* name, statsformat_t* format) {
+  if(strcmp(name, "json") == 0) {
+    *format = STATS_JSON;
+  } else if(strcmp(name, "csv") == 0) {
+    *format = STATS_CSV;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*! \brief Lower bound of the candidate sizes in bin b of the histogram
+ **/
+static int candidateBinStart(int b) {
+  return b == 0 ? 0 : CANDIDATE_HIST_BASE << (b - 1);
+}
+
+StatsWriter::~StatsWriter() {
+  close();
+}
+
+bool StatsWriter::open(const char* name, statsformat_t fmt, bool perf) {
+  format = fmt;
+  perfColumns = perf;
+  fp = fopen(name, "w");
+  if(fp == NULL) {
+    printf("\nError opening statistics file %s\n", name);
+    return false;
+  }
+
+  if(format == STATS_CSV) {
+    fprintf(fp, "im1,im2,status,matches,budget");
+    for(int s=0; s < NUM_MATCH_STAGES; s++) {
+      fprintf(fp, ",%s_ms", STAGE_NAMES[s]);
+    }
+    for(int c=0; c < NUM_MATCH_COUNTERS; c++) {
+      fprintf(fp, ",%s", COUNTER_NAMES[c]);
+    }
+    for(int f=0; f < 2*NUM_SEARCH_FIELDS; f++) {
+      fprintf(fp, ",%s_%s", f < NUM_SEARCH_FIELDS ? "global" : "match",
+          SEARCH_FIELD_NAMES[f % NUM_SEARCH_FIELDS]);
+    }
+    for(int b=0; b < CANDIDATE_HIST_BINS; b++) {
+      fprintf(fp, ",cand_%d", candidateBinStart(b));
+    }
+    for(int s=0; perfColumns && s <= NUM_MATCH_STAGES; s++) {
+      for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+        fprintf(fp, ",%s_%s", s < NUM_MATCH_STAGES ? STAGE_NAMES[s] : 
+            "pair", PerfCounterName(c));
+      }
+    }
+    fprintf(fp, "\n");
+  }
+  return true;
+}
+
+void StatsWriter::write(const PairStats& stats, const char* status,
+    int numMatches) {
+  bool json = format == STATS_JSON;
+  string budget = BudgetFlagNames(stats.budget);
+  if(json) {
+    fprintf(fp, "{\"im1\":%d,\"im2\":%d,\"status\":\"%s\",\"matches\":%d,"
+        "\"budget\":\"%s\"", stats.im1, stats.im2, status, numMatches,
+        budget.c_str());
+  } else {
+    fprintf(fp, "%d,%d,%s,%d,%s", stats.im1, stats.im2, status, numMatches,
+        budget.c_str());
+  }
+
+  for(int s=0; s < NUM_MATCH_STAGES; s++) {
+    if(json) {
+      fprintf(fp, ",\"%s_ms\":%.4f", STAGE_NAMES[s], 
+          stats.stageTime[s]*1000.0);
+    } else {
+      fprintf(fp, ",%.4f", stats.stageTime[s]*1000.0);
+    }
+  }
+  for(int c=0; c < NUM_MATCH_COUNTERS; c++) {
+    if(json) {
+      fprintf(fp, ",\"%s\":%lld", COUNTER_NAMES[c], stats.counters[c]);
+    } else {
+      fprintf(fp, ",%lld", stats.counters[c]);
+    }
+  }
+
+  long long fields[2*NUM_SEARCH_FIELDS];
+  searchFields(stats.globalSearch, fields);
+  searchFields(stats.matchSearch, fields + NUM_SEARCH_FIELDS);
+  for(int f=0; f < 2*NUM_SEARCH_FIELDS; f++) {
+    if(json) {
+      fprintf(fp, ",\"%s_%s\":%lld", f < NUM_SEARCH_FIELDS ? "global" : 
+          "match", SEARCH_FIELD_NAMES[f % NUM_SEARCH_FIELDS], fields[f]);
+    } else {
+      fprintf(fp, ",%lld", fields[f]);
+    }
+  }
+
+  if(json) {
+    fprintf(fp, ",\"cand_hist\":[");
+  }
+  for(int b=0; b < CANDIDATE_HIST_BINS; b++) {
+    fprintf(fp, (json && b == 0) ? "%d" : ",%d", stats.candidateHist[b]);
+  }
+  if(json) {
+    fprintf(fp, "]");
+  }
+
+  /// Stage NUM_MATCH_STAGES stands for the whole pair
+  for(int s=0; perfColumns && s <= NUM_MATCH_STAGES; s++) {
+    const unsigned long long* counts = s < NUM_MATCH_STAGES ? 
+      stats.stagePerf[s] : stats.pairPerf;
+    const char* stage = s < NUM_MATCH_STAGES ? STAGE_NAMES[s] : "pair";
+    for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+      if(json) {
+        fprintf(fp, ",\"%s_%s\":%llu", stage, PerfCounterName(c), counts[c]);
+      } else {
+        fprintf(fp, ",%llu", counts[c]);
+      }
+    }
+  }
+  fprintf(fp, json ? "}\n" : "\n");
+}
+
+bool StatsWriter::close() {
+  if(fp == NULL) {
+    return true;
+  }
+  bool ok = fclose(fp) == 0;
+  fp = NULL;
+  return ok;
+}
+
+/*! \brief Ratio of two counts, 0 if the denominator is 0
+ **/
+static double countRatio(unsigned long long a, unsigned long long b, 
+    double scale) {
+  return b > 0 ? scale*(double)a/(double)b : 0.0;
+}
+
+void match::PrintStagePerf(const char* prefix, const PairStats& total) {
+  printf("%s %-10s %14s %14s %6s %12s %8s %12s %8s\n", prefix, "stage", 
+      "cycles", "instructions", "ipc", "llc_misses", "per_ki", 
+      "br_misses", "per_ki");
+  for(int s=0; s <= NUM_MATCH_STAGES; s++) {
+    const unsigned long long* counts = s < NUM_MATCH_STAGES ? 
+      total.stagePerf[s] : total.pairPerf;
+    unsigned long long instructions = counts[PERF_INSTRUCTIONS];
+    printf("%s %-10s %14llu %14llu %6.2f %12llu %8.2f %12llu %8.2f\n", 
+        prefix, s < NUM_MATCH_STAGES ? STAGE_NAMES[s] : "pair", 
+        counts[PERF_CYCLES], instructions, 
+        countRatio(instructions, counts[PERF_CYCLES], 1.0),
+        counts[PERF_LLC_MISSES], 
+        countRatio(counts[PERF_LLC_MISSES], instructions, 1000.0),
+        counts[PERF_BRANCH_MISSES], 
+        countRatio(counts[PERF_BRANCH_MISSES], instructions, 1000.0));
+  }
+}
+
+void match::PrintSearchStats(const char* prefix, const PairStats& total) {
+  const ann_1_1_char::ANNsearchStats* searches[2] = { &total.globalSearch,
+    &total.matchSearch };
+  const char* names[2] = { "global", "match" };
+  for(int s=0; s < 2; s++) {
+    double n = searches[s]->searches > 0 ? searches[s]->searches : 1;
+    printf("%s kd-tree %s: %lld searches, per search %.1f nodes, %.1f "
+        "leaves, %.1f points, %.1f coords, %.1f abandoned; %.1f%% stopped "
+        "by the visit limit\n", prefix, names[s], searches[s]->searches,
+        searches[s]->nodes/n, searches[s]->leaves/n, searches[s]->points/n,
+        searches[s]->coords/n, searches[s]->abandons/n, 
+        100.0*searches[s]->truncated/n);
+  }
+}
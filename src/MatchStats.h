@@ -0,0 +1,215 @@
+#ifndef __MATCH_STATS_H
+#define __MATCH_STATS_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "PerfCounters.h"
+#include "ANN/ANNkd_treeT.h"
+
+#include <stdio.h>
+
+namespace match {
+
+/* Timed stages of matching a pair */
+enum matchstage_t {
+  STAGE_LOAD = 0,    /* waiting for the keys of the pair (key cache) */
+  STAGE_PROBE,       /* probeMatch() */
+  STAGE_GLOBAL,      /* globalMatch(), including its trees */
+  STAGE_RANSAC,      /* computeFmatrix() */
+  STAGE_LINES,       /* computeEpipolarLines() */
+  STAGE_CLUSTER,     /* clusterPoints(), clusterPointsFast() */
+  STAGE_CANDIDATES,  /* candidate sets (grid lookup) */
+  STAGE_TREE,        /* kd-trees of the candidate sets */
+  STAGE_SEARCH,      /* kd-tree (or brute-force) search of the candidates */
+  STAGE_VERIFY,      /* epipolar check of the matches passing ratio test */
+  NUM_MATCH_STAGES
+};
+
+/* Counters of matching a pair */
+enum matchcounter_t {
+  COUNT_GROUPS = 0,        /* epipolar line groups */
+  COUNT_QUERIES,           /* source features searched by match() */
+  COUNT_CANDIDATES,        /* sum of the candidate set sizes */
+  COUNT_RATIO_REJECTS,     /* match() queries failing the ratio test */
+  COUNT_EPIPOLAR_REJECTS,  /* match() queries failing the epipolar check */
+  COUNT_CAPPED_GROUPS,     /* groups with a subsampled candidate set */
+  COUNT_PADDED_GROUPS,     /* groups with a padded candidate set */
+  COUNT_CONSISTENCY_REJECTS, /* candidates of inconsistent scale or 
+                                orientation */
+  COUNT_SKETCH_REJECTS,    /* exact comparisons skipped by sketch ranking */
+  NUM_MATCH_COUNTERS
+};
+
+/* Limits of a PairBudget (see Matcher.h) that a pair ran into, as bit
+ * flags */
+enum budget_t {
+  BUDGET_NONE = 0,
+  BUDGET_TIME = 1,          /* wall-clock time of the pair */
+  BUDGET_COMPARISONS = 2,   /* candidate comparisons of the match stage */
+  BUDGET_RANSAC = 4         /* RANSAC iterations of computeFmatrix() */
+};
+
+/* Names of the budget flags, joined by '+', "none" without flags */
+string BudgetFlagNames(int flags);
+
+/* Histogram of the candidate set sizes of the groups. Bin 0 counts the
+ * sets of less than CANDIDATE_HIST_BASE candidates, bin b the sets of
+ * CANDIDATE_HIST_BASE*2^(b-1) up to CANDIDATE_HIST_BASE*2^b, the last
+ * bin all larger sets. */
+const int CANDIDATE_HIST_BINS = 8;
+const int CANDIDATE_HIST_BASE = 64;
+
+/* Names of the stages and counters in the exported statistics */
+const char* MatchStageName(int stage);
+const char* MatchCounterName(int counter);
+
+/* Seconds of a monotonic wall clock */
+double WallTime();
+
+class TraceBuffer;
+
+/* Start of a stage */
+struct StageMark {
+  double time;
+  unsigned long long perf[NUM_PERF_COUNTERS];
+};
+
+/* Wall-clock time per stage and counters of one pair. The matcher and 
+ * the drivers fill it only if they are given one, so statistics cost a
+ * pointer test per instrumentation point when disabled. 
+ *
+ * If trace is set, the stages up to STAGE_CLUSTER are also recorded as
+ * spans of pair; the later stages run once per group or query and are
+ * only timed. If perf is set, the hardware counters of the thread are 
+ * read at each stage boundary and summed per stage (a system call per
+ * read, so the per-query stages are slowed down noticeably). pairPerf
+ * is left to the driver. */
+struct PairStats {
+  int im1;
+  int im2;
+  double stageTime[NUM_MATCH_STAGES];
+  long long counters[NUM_MATCH_COUNTERS];
+  int candidateHist[CANDIDATE_HIST_BINS];
+
+  /// budget_t flags of the limits the pair ran into
+  int budget;
+
+  /// kd-tree searches of the probe and global stage, and of match()
+  ann_1_1_char::ANNsearchStats globalSearch;
+  ann_1_1_char::ANNsearchStats matchSearch;
+
+  TraceBuffer* trace;
+  int pair;
+
+  PerfCounterGroup* perf;
+  unsigned long long stagePerf[NUM_MATCH_STAGES][NUM_PERF_COUNTERS];
+  unsigned long long pairPerf[NUM_PERF_COUNTERS];
+
+  /* Resets the times and counters, and disables tracing and hardware
+   * counters */
+  void clear();
+
+  /* Adds the times and counters of s */
+  void add(const PairStats& s);
+
+  /* Start of a stage */
+  void beginStage(matchstage_t stage, StageMark* mark);
+
+  /* End of a stage that started at mark */
+  void endStage(matchstage_t stage, const StageMark& mark);
+
+  /* Start and end of the whole pair, for pairPerf */
+  void beginPair(StageMark* mark);
+  void endPair(const StageMark& mark);
+
+  void count(matchcounter_t counter, long long n) {
+    counters[counter] += n;
+  }
+
+  void addCandidateSet(int size);
+};
+
+/* Adds the time from construction to destruction to a stage of stats,
+ * if stats is not NULL */
+class StageTimer {
+  PairStats* stats;
+  matchstage_t stage;
+  StageMark mark;
+
+  public:
+  StageTimer(PairStats* s, matchstage_t st) : stats(s), stage(st) {
+    if(stats != NULL) {
+      stats->beginStage(stage, &mark);
+    }
+  }
+
+  ~StageTimer() {
+    if(stats != NULL) {
+      stats->endStage(stage, mark);
+    }
+  }
+};
+
+/* Layout of a statistics file */
+enum statsformat_t {
+  STATS_JSON = 0,   /* one JSON object per line */
+  STATS_CSV         /* a header line and one line per pair */
+};
+
+/* Parses "json" or "csv" */
+bool ParseStatsFormat(const char* name, statsformat_t* format);
+
+/* Writes one line of statistics per pair: im1, im2, status, matches,
+ * budget (see BudgetFlagNames()), the stage times in milliseconds as <stage>_ms, the counters, the 
+ * kd-tree search statistics as global_<field> and match_<field> (see
+ * ANNsearchStats) and the candidate histogram as cand_<lower bound of 
+ * the bin>. In JSON the 
+ * histogram is one array, cand_hist. With perfColumns, the hardware
+ * counters follow as <stage>_<counter> and pair_<counter>. */
+class StatsWriter {
+  FILE* fp;
+  statsformat_t format;
+  bool perfColumns;
+
+  public:
+  StatsWriter() : fp(NULL), format(STATS_JSON), perfColumns(false) {}
+  ~StatsWriter();
+
+  bool open(const char* name, statsformat_t fmt, bool perf);
+
+  /* Writes one pair; status and numMatches describe its outcome */
+  void write(const PairStats& stats, const char* status, int numMatches);
+
+  bool close();
+};
+
+/* Prints the hardware counters per stage and of the pairs in total,
+ * with the instructions per cycle and misses per 1000 instructions */
+void PrintStagePerf(const char* prefix, const PairStats& total);
+
+/* Prints the kd-tree search statistics of the global and match stages
+ * in total, with the work per search */
+void PrintSearchStats(const char* prefix, const PairStats& total);
+
+};
+#endif //__MATCH_STATS_H
@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "keys2a.h"
 #include "Geometric.h"
+#include "Trace.h"
 
 /*
  * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
@@ -28,12 +29,146 @@
 
 using namespace match;
 
+/*! \brief Largest of the squared distances of a correspondence from 
+ **  its epipolar lines in both images, the error OpenCV's RANSAC uses
+ **/
+static double epipolarError(const double* f, const cv::Point2f& p1,
+    const cv::Point2f& p2) {
+  double a2 = f[0]*p1.x + f[1]*p1.y + f[2];
+  double b2 = f[3]*p1.x + f[4]*p1.y + f[5];
+  double c2 = f[6]*p1.x + f[7]*p1.y + f[8];
+  double a1 = f[0]*p2.x + f[3]*p2.y + f[6];
+  double b1 = f[1]*p2.x + f[4]*p2.y + f[7];
+  double d = p2.x*a2 + p2.y*b2 + c2;
+  double s1 = a1*a1 + b1*b1;
+  double s2 = a2*a2 + b2*b2;
+  double e1 = s1 > 0 ? d*d/s1 : HUGE_VAL;
+  double e2 = s2 > 0 ? d*d/s2 : HUGE_VAL;
+  return e1 > e2 ? e1 : e2;
+}
+
+/*! \brief Marks the correspondences within threshold pixels of their
+ **  epipolar lines under F, returns their number
+ **/
+static int markInliers(const cv::Mat& F, const vector<cv::Point2f>& pts1,
+    const vector<cv::Point2f>& pts2, double threshold, 
+    vector<char>& inliers) {
+  const double* f = F.ptr<double>();
+  int numInliers = 0;
+  inliers.resize(pts1.size());
+  for(int i=0; i < (int)pts1.size(); i++) {
+    inliers[i] = epipolarError(f, pts1[i], pts2[i]) <= threshold*threshold;
+    numInliers += inliers[i];
+  }
+  return numInliers;
+}
+
+/*! \brief RANSAC estimate of F in at most maxIters iterations
+ **
+ **  Fits 8-point samples with findFundamentalMat(CV_FM_8POINT), which 
+ **  every OpenCV version has, and keeps the F with most inliers within 1
+ **  pixel, as the unbounded findFundamentalMat(CV_FM_RANSAC) call does.
+ **  It stops once an all-inlier sample has been drawn with confidence 
+ **  0.99 at the best inlier ratio, and sets cutShort if maxIters stopped
+ **  it first. F is refitted to the inliers of the best sample. Samples 
+ **  are drawn with a fixed seed, so the estimate is repeatable. Returns
+ **  an empty F if no sample could be fitted.
+ **/
+static cv::Mat boundedRansac(const vector<cv::Point2f>& pts1,
+    const vector<cv::Point2f>& pts2, int maxIters, vector<char>& inliers,
+    bool* cutShort) {
+  const int sampleSize = 8;
+  const double threshold = 1.0;
+  const double confidence = 0.99;
+
+  int numPts = pts1.size();
+  cv::Mat bestF;
+  int bestCount = 0;
+  *cutShort = false;
+  inliers.assign(numPts, 0);
+  if(numPts < sampleSize) {
+    return bestF;
+  }
+
+  unsigned int seed = 1;
+  double needed = HUGE_VAL;
+  vector<cv::Point2f> sample1(sampleSize), sample2(sampleSize);
+  vector<int> picked(sampleSize);
+  vector<char> mask;
+  int it = 0;
+  for(; it < maxIters && it < needed; it++) {
+    for(int k=0; k < sampleSize; k++) {
+      bool repeated = true;
+      while(repeated) {
+        picked[k] = rand_r(&seed) % numPts;
+        repeated = find(picked.begin(), picked.begin() + k, picked[k]) != 
+          picked.begin() + k;
+      }
+      sample1[k] = pts1[picked[k]];
+      sample2[k] = pts2[picked[k]];
+    }
+    cv::Mat F = findFundamentalMat(sample1, sample2, CV_FM_8POINT);
+    if(F.empty()) {
+      continue;
+    }
+    int count = markInliers(F, pts1, pts2, threshold, mask);
+    if(count > bestCount) {
+      bestF = F;
+      bestCount = count;
+      inliers.swap(mask);
+      double w = pow((double)count/numPts, sampleSize);
+      needed = w >= 1.0 ? 0 : log(1.0 - confidence)/log(1.0 - w);
+    }
+  }
+  *cutShort = it >= maxIters && needed > maxIters;
+  if(bestF.empty()) {
+    return bestF;
+  }
+
+  /// Refit to all inliers, keep the refit if it does not lose any
+  vector<cv::Point2f> in1, in2;
+  for(int i=0; i < numPts; i++) {
+    if(inliers[i]) {
+      in1.push_back(pts1[i]);
+      in2.push_back(pts2[i]);
+    }
+  }
+  if((int)in1.size() > sampleSize) {
+    cv::Mat F = findFundamentalMat(in1, in2, CV_FM_8POINT);
+    if(!F.empty() && markInliers(F, pts1, pts2, threshold, mask) >= 
+        bestCount) {
+      bestF = F;
+      inliers.swap(mask);
+    }
+  }
+  return bestF;
+}
+
+/*! \brief Records the time and comparison limits that are used up
+ **/
+bool FeatureMatcher::checkBudget() {
+  if((budgetExceeded & (BUDGET_TIME | BUDGET_COMPARISONS)) != 0) {
+    return true;
+  }
+  if(budget.maxComparisons > 0 && numComparisons >= budget.maxComparisons) {
+    budgetExceeded |= BUDGET_COMPARISONS;
+  }
+  if(budget.maxSeconds > 0 && WallTime() - budgetStart >= budget.maxSeconds) {
+    budgetExceeded |= BUDGET_TIME;
+  }
+  return (budgetExceeded & (BUDGET_TIME | BUDGET_COMPARISONS)) != 0;
+}
+
 /*! \brief Computes Fundamental Matrix for initialized matches.
  **
  **  This is a wrapper function that prepares (x,y) pairs of matches 
  **  and calls the OpenCV function findFundamentalMat(...). 
  **/
 int FeatureMatcher::computeFmatrix(double* Fdata) {
+  StageTimer timer(stats, STAGE_RANSAC);
+  if(overBudget()) {
+    return -1;
+  }
   vector<cv::Point2f> imgPts1, imgPts2;
   for(int i=0; i < matches.size(); i++) {
     int idx1 = matches[i].first;
@@ -43,28 +178,51 @@ int FeatureMatcher::computeFmatrix(double* Fdata) {
     imgPts2.push_back( cv::Point2f(refKeysInfo[idx2].x,refKeysInfo[idx2].y));
 
   }
-  cv::Mat Finliers;
-
-  /// Please see OpenCV documentation before you change parameters
-  cv::Mat F = findFundamentalMat(imgPts1, imgPts2, CV_FM_RANSAC, 1, 0.99, Finliers);
-
-  /// Delete all outlier matches
-  vector<pair<int, int> > :: iterator itr = matches.begin();
-  for (int i=0; i< Finliers.size().height; i++) {
-    if (Finliers.at<char>(i) != 1) {
-      matches.erase(itr);  
+  cv::Mat F;
+  if(budget.maxRansacIters > 0) {
+    vector<char> inliers;
+    bool cutShort = false;
+    F = boundedRansac(imgPts1, imgPts2, budget.maxRansacIters, inliers,
+        &cutShort);
+    if(cutShort) {
+      budgetExceeded |= BUDGET_RANSAC;
+    }
+    vector<pair<int, int> > kept;
+    for(int i=0; i < (int)inliers.size(); i++) {
+      if(inliers[i]) {
+        kept.push_back(matches[i]);
+      }
+    }
+    matches.swap(kept);
+  } else {
+    cv::Mat Finliers;
+
+    /// Please see OpenCV documentation before you change parameters
+    F = findFundamentalMat(imgPts1, imgPts2, CV_FM_RANSAC, 1, 0.99, 
+        Finliers);
+
+    /// Delete all outlier matches
+    vector<pair<int, int> > :: iterator itr = matches.begin();
+    for (int i=0; i< Finliers.size().height; i++) {
+      if (Finliers.at<char>(i) != 1) {
+        matches.erase(itr);  
+      }
+      itr++;
     }
-    itr++;
   }
 
   /// Check if sufficient matches remian inliers
   //  This can be made stricter (See paper)
   int matchCount = (int)(matches.size());
-  if(matchCount >= 27) {
+  if(matchCount >= 27 && !F.empty()) {
     const double* ptr = F.ptr<double>();
     for(int f=0; f < 9; f++) {
       Fdata[f] = ptr[f]/ptr[8];
     }
+    if(candidatePolicy.scaleTolerance > 0 || 
+        candidatePolicy.orientTolerance > 0) {
+      estimateKeyConsistency();
+    }
 
     return (int)matches.size();
   }
@@ -73,10 +231,102 @@ int FeatureMatcher::computeFmatrix(double* Fdata) {
 }
 
 
+/*! \brief Angle a wrapped to [-PI, PI)
+ **/
+static double wrapAngle(double a) {
+  return a - 2*M_PI*floor((a + M_PI)/(2*M_PI));
+}
+
+/*! \brief Estimates the dominant scale ratio and rotation of the pair
+ **
+ **  The scale ratio is the median log ratio over the matches (the 
+ **  inliers of F). The rotation is the circular mean of the orientation
+ **  differences within 20 degrees of the peak of their 10-degree
+ **  histogram. The filter is enabled if enough matches agree with both.
+ **/
+void FeatureMatcher::estimateKeyConsistency() {
+  keyFilter = false;
+  int numMatches = matches.size();
+  if(numMatches < KEY_CONSISTENCY_MIN_MATCHES) {
+    return;
+  }
+
+  const int numBins = 36;
+  vector<double> logScales;
+  vector<double> rotations(numMatches);
+  vector<int> hist(numBins, 0);
+  for(int m=0; m < numMatches; m++) {
+    const keypt_t& src = srcKeysInfo[matches[m].first];
+    const keypt_t& ref = refKeysInfo[matches[m].second];
+    if(src.scale > 0 && ref.scale > 0) {
+      logScales.push_back(log(ref.scale/src.scale));
+    }
+    rotations[m] = wrapAngle(ref.orient - src.orient);
+    int b = (int)((rotations[m] + M_PI)*numBins/(2*M_PI));
+    hist[b < numBins ? b : numBins - 1]++;
+  }
+  if(logScales.size() < KEY_CONSISTENCY_MIN_MATCHES) {
+    return;
+  }
+
+  nth_element(logScales.begin(), logScales.begin() + logScales.size()/2,
+      logScales.end());
+  keyLogScale = logScales[logScales.size()/2];
+
+  int peak = 0;
+  int peakCount = -1;
+  for(int b=0; b < numBins; b++) {
+    int count = hist[(b + numBins - 1) % numBins] + hist[b] + 
+      hist[(b + 1) % numBins];
+    if(count > peakCount) {
+      peak = b;
+      peakCount = count;
+    }
+  }
+  double peakAngle = (peak + 0.5)*2*M_PI/numBins - M_PI;
+  double sumSin = 0, sumCos = 0;
+  for(int m=0; m < numMatches; m++) {
+    if(fabs(wrapAngle(rotations[m] - peakAngle)) <= 2*M_PI/numBins*2) {
+      sumSin += sin(rotations[m]);
+      sumCos += cos(rotations[m]);
+    }
+  }
+  keyRotation = atan2(sumSin, sumCos);
+
+  keyFilter = true;
+  int support = 0;
+  for(int m=0; m < numMatches; m++) {
+    if(consistentKeys(matches[m].first, matches[m].second)) {
+      support++;
+    }
+  }
+  keyFilter = support >= KEY_CONSISTENCY_MIN_SUPPORT*numMatches;
+}
+
+/*! \brief True if the scale and orientation of a reference feature
+ **  agree with a source feature under the dominant ratio and rotation
+ **/
+bool FeatureMatcher::consistentKeys(int qPtIdx, int refPtIdx) {
+  const keypt_t& src = srcKeysInfo[qPtIdx];
+  const keypt_t& ref = refKeysInfo[refPtIdx];
+  if(candidatePolicy.scaleTolerance > 0 && src.scale > 0 && ref.scale > 0 &&
+      fabs(log(ref.scale/src.scale) - keyLogScale) > 
+      log(candidatePolicy.scaleTolerance)) {
+    return false;
+  }
+  if(candidatePolicy.orientTolerance > 0 && 
+      fabs(wrapAngle(ref.orient - src.orient - keyRotation)) > 
+      candidatePolicy.orientTolerance) {
+    return false;
+  }
+  return true;
+}
+
 /*! \brief Computes epipolar lines for all source feature points.
  **        The computed lines are stored in vector< double > epiLines 
  **/
 void FeatureMatcher::computeEpipolarLines() {
+  StageTimer timer(stats, STAGE_LINES);
   epiLines.resize(numSrcPts);
   for(int i=0; i < numSrcPts; i++) {
     epiLines[i].resize(3);
@@ -133,50 +383,302 @@ void FeatureMatcher::verifyEpipolarConstraints() {
  **/
 
 int FeatureMatcher::globalMatch(int h, bool twoWaySearch) {
-  /// Clear previously computed matches if any
-  matches.clear();
+  switch(descType) {
+    case KEY_UINT16:  
+      return globalMatchT<unsigned short>(h, twoWaySearch, 0, NULL);
+    case KEY_FLOAT32: 
+      return globalMatchT<float>(h, twoWaySearch, 0, NULL);
+    default:          
+      return globalMatchT<unsigned char>(h, twoWaySearch, 0, NULL);
+  }
+}
+
+/*! \brief Global Kd-tree based matching that stops as soon as the 
+ **  matches suffice for estimating F.
+ **
+ **  Easy pairs need far fewer than h% features for a good F, hard pairs
+ **  may need more. This variant matches in steps of h%, h% + 
+ **  PROGRESSIVE_STEP_PERCENT, ... up to hMax%. Each step is the global
+ **  match of its fraction (same trees and search budget as globalMatch()
+ **  of that fraction) except that it searches the source features in 
+ **  order of scale and stops once it has targetMatches matches that are
+ **  well distributed over the source image (see PROGRESSIVE_MIN_CELLS).
+ **  Only a step that ends without them moves on to the next fraction.
+ **
+ **  A larger fraction changes the nearest neighbours of the features 
+ **  already searched, so each step starts over; a pair that needs hMax%
+ **  pays for the smaller steps too, and ends with the matches of 
+ **  globalMatch(hMax). Prebuilt global trees are used by the step whose 
+ **  fraction they were built for, other steps build their own trees. 
+ **  getNumGlobalQueries() gives the number of source features searched
+ **  over all steps.
+ **/
+int FeatureMatcher::globalMatchProgressive(int h, int hMax, 
+    int targetMatches, bool twoWaySearch) {
+  int numQueries = 0;
+  int step = h < hMax ? h : hMax;
+  while(true) {
+    bool targetMet = false;
+    switch(descType) {
+      case KEY_UINT16:  
+        globalMatchT<unsigned short>(step, twoWaySearch, targetMatches, 
+            &targetMet);
+        break;
+      case KEY_FLOAT32: 
+        globalMatchT<float>(step, twoWaySearch, targetMatches, &targetMet);
+        break;
+      default:          
+        globalMatchT<unsigned char>(step, twoWaySearch, targetMatches, 
+            &targetMet);
+        break;
+    }
+    numQueries += numGlobalQueries;
+    if(targetMet || step >= hMax || overBudget()) {
+      break;
+    }
+    step = step + PROGRESSIVE_STEP_PERCENT < hMax ? 
+      step + PROGRESSIVE_STEP_PERCENT : hMax;
+  }
+  numGlobalQueries = numQueries;
+  return (int)matches.size();
+}
+
+/*! \brief Returns the tree of a prebuilt global tree if it indexes
+ **  the first numPts descriptors in keys, else NULL.
+ **/
+template <class Desc>
+static const ANNkd_treeT<Desc>* usableGlobalTree(const GlobalTree* globalTree,
+    const Desc* keys, int numPts, int dim) {
+  if(globalTree == NULL) {
+    return NULL;
+  }
+  const ANNkd_treeT<Desc>* tree = globalTree->get<Desc>();
+  if(tree == NULL || tree->thePoints() != keys || 
+      tree->nPoints() != numPts || tree->theDim() != dim) {
+    return NULL;
+  }
+  return tree;
+}
+
+/*! \brief Number of nodes to visit in a global Kd-tree search 
+ **  (standard practice).
+ **
+ **  Limit this number to the lesser 500 or TotalPoints/20
+ **  If the 20% points are too less, limit it at least to 50
+ **/
+static int globalPtsToVisit(int numTopRefPts, int numTopSrcPts) {
+  int PtsToVisit = numTopRefPts > numTopSrcPts ? numTopRefPts : numTopSrcPts;
+
+  PtsToVisit = ceil((float)PtsToVisit/(float)20) < 
+    500 ? ceil((float)PtsToVisit/(float)20) : 500;
+
+  if(PtsToVisit < 50) PtsToVisit = 50;
+  return PtsToVisit;
+}
+
+/*! \brief Cheap test whether a pair can pass the global stage.
+ **
+ **  Searches the first numProbe of the top h% source features (the
+ **  largest scales) against the top h% reference features with the same
+ **  tree and search budget as globalMatch(h, false), and returns the 
+ **  number of matches passing the ratio test. The matches themselves are
+ **  not kept. Compare the count with probeRejectThreshold() to decide 
+ **  whether the global stage is worth running.
+ **
+ **  Only the reference tree is searched, so this is cheap when a
+ **  prebuilt global tree of the reference image is set.
+ **/
+int FeatureMatcher::probeMatch(int h, int numProbe) {
+  switch(descType) {
+    case KEY_UINT16:  return probeMatchT<unsigned short>(h, numProbe);
+    case KEY_FLOAT32: return probeMatchT<float>(h, numProbe);
+    default:          return probeMatchT<unsigned char>(h, numProbe);
+  }
+}
+
+/*! \brief Smallest probe match count for which a pair is kept.
+ **
+ **  A pair that only just passes the global stage has minMatches matches
+ **  among its numTop searched features. Taking numProbe of them, the 
+ **  probe count of such a pair is modelled as Binomial(numProbe, 
+ **  minMatches/numTop). The returned threshold t is the largest one
+ **  with P(count < t) <= budget, so pairs with fewer than t probe
+ **  matches can be rejected while wrongly rejecting at most a budget 
+ **  fraction of passing pairs (pairs with more matches are rejected 
+ **  less often). The binomial has a heavier lower tail than sampling 
+ **  without replacement, which keeps the estimate on the safe side.
+ **
+ **  Returns 0 (never reject) if the probe is not smaller than the stage.
+ **/
+int match::probeRejectThreshold(int numProbe, int numTop, int minMatches,
+    double budget) {
+  if(numProbe <= 0 || numProbe >= numTop || minMatches >= numTop) {
+    return 0;
+  }
+
+  double p = (double)minMatches/(double)numTop;
+  double pmf = pow(1.0 - p, numProbe);
+  double cdf = 0.0;
+
+  int t = 0;
+  while(t < numProbe) {
+    /// cdf is P(count < t); try to grow the threshold by one
+    if(cdf + pmf > budget) {
+      break;
+    }
+    cdf += pmf;
+    pmf *= (double)(numProbe - t)/(double)(t + 1)*p/(1.0 - p);
+    t++;
+  }
+  return t;
+}
+
+/*! \brief Number of top-scale features searched by the probe.
+ **
+ **  A pair that only just passes the global stage has a match rate of 
+ **  p = minMatches/numTop, so a probe of n features finds none with
+ **  probability (1-p)^n and can reject a pair within the budget only if
+ **  n >= log(budget)/log(1-p), which is a quarter of numTop with the
+ **  defaults. A fixed sample of a few hundred features is below that for
+ **  usual SIFT images; the sample is grown to the smallest size that can
+ **  reject, as long as that stays below PROBE_MAX_FRACTION of numTop.
+ **/
+int match::probeSampleSize(int numTop, int probeSize, double probeFraction,
+    int minMatches, double budget) {
+  int numProbe = (int)(numTop*probeFraction);
+  numProbe = numProbe > probeSize ? numProbe : probeSize;
+  numProbe = numProbe < numTop ? numProbe : numTop;
+  if(probeRejectThreshold(numProbe, numTop, minMatches, budget) > 0) {
+    return numProbe;
+  }
+  if(numTop <= 0 || minMatches >= numTop || budget <= 0) {
+    return 0;
+  }
+
+  double p = (double)minMatches/(double)numTop;
+  int maxProbe = (int)(numTop*PROBE_MAX_FRACTION);
+  int n = (int)ceil(log(budget)/log(1.0 - p));
+  while(n <= maxProbe && 
+      probeRejectThreshold(n, numTop, minMatches, budget) == 0) {
+    n++;
+  }
+  return n <= maxProbe ? n : 0;
+}
+
+/*! \brief probeMatch() for descriptors with values of type Desc.
+ **/
+template <class Desc>
+int FeatureMatcher::probeMatchT(int h, int numProbe) {
+  typedef typename ANNkd_treeT<Desc>::Dist Dist;
+  StageTimer timer(stats, STAGE_PROBE);
 
-  /// Find number of h% matches
   int numTopRefPts = (int)(numRefPts*h/100);  
   int numTopSrcPts = (int)(numSrcPts*h/100);  
+  if(numProbe > numTopSrcPts) {
+    numProbe = numTopSrcPts;
+  }
+
+  const Desc* refDesc = (const Desc*)refKey;
+  const Desc* srcDesc = (const Desc*)srcKey;
 
-  /// Allocate point structures for Kd-tree based search
-  ANNpointArray keyPts = annAllocPts( numTopRefPts, 128);
-  ANNpointArray qKeyPts = annAllocPts( numTopSrcPts, 128);
+  const ANNkd_treeT<Desc>* tree = usableGlobalTree(refGlobalTree, 
+      refDesc, numTopRefPts, descDim);
+  ANNkd_treeT<Desc>* ownTree = NULL;
+  if(tree == NULL) {
+    ownTree = new ANNkd_treeT<Desc>(refDesc, numTopRefPts, descDim, 
+        GLOBAL_TREE_BUCKET_SIZE);
+    tree = ownTree;
+  }
 
-  /// Copy descriptors to allocated point structures
-  for(int i=0; i < numTopRefPts; i++) 
-    memcpy(keyPts[i], refKey+128*i, sizeof(unsigned char)*128);
+  int PtsToVisit = globalPtsToVisit(numTopRefPts, numTopSrcPts);
 
-  for(int i=0; i < numTopSrcPts; i++) 
-    memcpy(qKeyPts[i], srcKey+128*i, sizeof(unsigned char)*128);
+  ANNsearchStats* search = stats != NULL ? &stats->globalSearch : NULL;
+  int numMatches = 0;
+  for(int i=0; i < numProbe; i++) {
+    ANNidx indices[2];
+    Dist dists[2];
 
-  /// Create trees for source and target descriptors
-  ANNkd_tree* tree = new ANNkd_tree(keyPts, numTopRefPts, 128, 16);
-  ANNkd_tree* qTree = new ANNkd_tree(qKeyPts, numTopSrcPts, 128, 16);
+    const Desc* qKey = srcDesc + descDim*i;
+    tree->annkPriSearch(qKey, 2, indices, dists, 0.0, PtsToVisit, search);
 
-  /// Number of nodes to visit in Kd-tree (standard practice)
-  /// Limit this number to the lesser 500 or TotalPoints/20
-  /// If the 20% points are too less, limit it at least to 50
-  int PtsToVisit = numTopRefPts > numTopSrcPts ? numTopRefPts : numTopSrcPts;
+    float distRatio = sqrt((float)(dists[0])/(float)(dists[1]));
+    if(distRatio <= 0.6) {
+      numMatches++;
+    }
+  }
 
-  PtsToVisit = ceil((float)PtsToVisit/(float)20) < 
-    500 ? ceil((float)PtsToVisit/(float)20) : 500;
+  delete ownTree;
+  return numMatches;
+}
 
-  if(PtsToVisit < 50) PtsToVisit = 50;
+/*! \brief globalMatch() for descriptors with values of type Desc.
+ **
+ **  If targetMatches > 0, stops early as a step of 
+ **  globalMatchProgressive() and sets targetMet if it did.
+ **/
+template <class Desc>
+int FeatureMatcher::globalMatchT(int h, bool twoWaySearch, 
+    int targetMatches, bool* targetMet) {
+  typedef typename ANNkd_treeT<Desc>::Dist Dist;
+  StageTimer timer(stats, STAGE_GLOBAL);
+
+  /// Clear previously computed matches if any
+  matches.clear();
+
+  /// Find number of h% matches
+  int numTopRefPts = (int)(numRefPts*h/100);  
+  int numTopSrcPts = (int)(numSrcPts*h/100);  
+
+  /// Keys are sorted by scale, so the top h% features are the first
+  /// numTop*Pts descriptors and the trees can use the key buffers directly
+  const Desc* refDesc = (const Desc*)refKey;
+  const Desc* srcDesc = (const Desc*)srcKey;
+
+  /// Use the prebuilt trees of the images if available, else
+  /// create trees for source and target descriptors.
+  /// The source tree is only needed for two way search
+  const ANNkd_treeT<Desc>* tree = usableGlobalTree(refGlobalTree, 
+      refDesc, numTopRefPts, descDim);
+  const ANNkd_treeT<Desc>* qTree = usableGlobalTree(srcGlobalTree,
+      srcDesc, numTopSrcPts, descDim);
+
+  ANNkd_treeT<Desc>* ownTree = NULL;
+  ANNkd_treeT<Desc>* ownQTree = NULL;
+  if(tree == NULL) {
+    ownTree = new ANNkd_treeT<Desc>(refDesc, numTopRefPts, descDim, 
+        GLOBAL_TREE_BUCKET_SIZE);
+    tree = ownTree;
+  }
+  if(qTree == NULL && twoWaySearch) {
+    ownQTree = new ANNkd_treeT<Desc>(srcDesc, numTopSrcPts, descDim, 
+        GLOBAL_TREE_BUCKET_SIZE);
+    qTree = ownQTree;
+  }
+
+  int PtsToVisit = globalPtsToVisit(numTopRefPts, numTopSrcPts);
 
-  annMaxPtsVisit(PtsToVisit);
   //printf("\nPts To Visit : %d", PtsToVisit);
 
+  /// Occupied cells of the coverage grid for early stopping
+  vector<int> cellCounts(PROGRESSIVE_GRID_SIZE*PROGRESSIVE_GRID_SIZE, 0);
+  int numCells = 0;
+  ANNsearchStats* search = stats != NULL ? &stats->globalSearch : NULL;
+
   /// For each of the selected source features
-  for(int i=0; i < numTopSrcPts; i++) {
+  int i = 0;
+  for(; i < numTopSrcPts; i++) {
+
+    /// Keep the matches found so far once the budget is used up
+    if(i % BUDGET_CHECK_INTERVAL == 0 && overBudget()) {
+      break;
+    }
 
-    vector<ANNidx> indices(2);
-    vector<ANNdist> dists(2);
+    ANNidx indices[2];
+    Dist dists[2];
 
     /// Search for two closest points in the reference tree
-    unsigned char* qKey = srcKey + 128*i;
-    tree->annkPriSearch(qKey, 2, indices.data(), dists.data(), 0.0);
+    const Desc* qKey = srcDesc + descDim*i;
+    tree->annkPriSearch(qKey, 2, indices, dists, 0.0, PtsToVisit, search);
 
     /// Compute best distance to second best distance ratio
     float bestDist = (float)(dists[0]);
@@ -195,17 +697,15 @@ int FeatureMatcher::globalMatch(int h, bool twoWaySearch) {
 
     /// If the ratio is below the threshold, the closest point is the match
     int matchingPt = (int)indices[0];
-    int secondMatch = (int)indices[1];
-    indices.clear();
-    dists.clear();
 
     /// If two way search is enabled, verify that 
     //  the query point is the best match for the
     //  matching point and also satisfies ratio test
     if(twoWaySearch) {
 
-      unsigned char* qKey1 = refKey + 128*matchingPt;
-      qTree->annkPriSearch(qKey1, 2, indices.data(), dists.data(), 0.0);
+      const Desc* qKey1 = refDesc + descDim*matchingPt;
+      qTree->annkPriSearch(qKey1, 2, indices, dists, 0.0, PtsToVisit, 
+          search);
 
       float bestDist1 = (float)(dists[0]);
       float secondBestDist1 = (float)(dists[1]);
@@ -222,18 +722,36 @@ int FeatureMatcher::globalMatch(int h, bool twoWaySearch) {
     }
 
 //    printf("\nSrc Point %d, 1st %d, 2nd %d",
-//        i, matchingPt, secondMatch);
+//        i, matchingPt, (int)indices[1]);
     /// Add the pairs to matches list
     matches.push_back(make_pair(i, matchingPt)); 
-  }
 
-  /// Deallocate Point Structures
-  annDeallocPts(keyPts);
-  annDeallocPts(qKeyPts);
+    /// In progressive mode, stop once there are enough matches
+    /// and they are spread over the source image
+    if(targetMatches > 0) {
+      int cx = (int)(srcKeysInfo[i].x*PROGRESSIVE_GRID_SIZE/qWidth);
+      int cy = (int)(srcKeysInfo[i].y*PROGRESSIVE_GRID_SIZE/qHeight);
+      cx = cx < 0 ? 0 : (cx >= PROGRESSIVE_GRID_SIZE ? 
+          PROGRESSIVE_GRID_SIZE-1 : cx);
+      cy = cy < 0 ? 0 : (cy >= PROGRESSIVE_GRID_SIZE ? 
+          PROGRESSIVE_GRID_SIZE-1 : cy);
+      if(cellCounts[cy*PROGRESSIVE_GRID_SIZE + cx]++ == 0) {
+        numCells++;
+      }
+
+      if((int)matches.size() >= targetMatches && 
+          numCells >= PROGRESSIVE_MIN_CELLS) {
+        *targetMet = true;
+        i++;
+        break;
+      }
+    }
+  }
+  numGlobalQueries = i;
 
-  /// Delete Kd-tree
-  delete tree;
-  delete qTree;
+  /// Delete Kd-trees built here
+  delete ownTree;
+  delete ownQTree;
   return (int)matches.size();
 }
 
@@ -290,10 +808,39 @@ void FeatureMatcher::visualizeMatches(const char* saveAs = NULL) {
  **  It is perhaps less efficient in time but more accurate. 
  **/
 int FeatureMatcher:: bfMatch() {
+  TraceSpan span(stats != NULL ? stats->trace : NULL, "bf_match", 
+      stats != NULL ? stats->pair : -1);
+  switch(descType) {
+    case KEY_UINT16:  return bfMatchT<unsigned short>();
+    case KEY_FLOAT32: return bfMatchT<float>();
+    default:          return bfMatchT<unsigned char>();
+  }
+}
+
+/*! \brief bfMatch() for descriptors with values of type Desc.
+ **/
+template <class Desc>
+int FeatureMatcher::bfMatchT() {
+  switch(descDim) {
+    case 128: return bfMatchDim<Desc, 128>();
+    case 64:  return bfMatchDim<Desc, 64>();
+    case 32:  return bfMatchDim<Desc, 32>();
+    default:  return bfMatchDim<Desc, 0>();
+  }
+}
+
+/*! \brief bfMatch() for descriptors of type Desc and length DIM 
+ **  (0: any length).
+ **/
+template <class Desc, int DIM>
+int FeatureMatcher::bfMatchDim() {
   matches.clear();
   /// For all groups of points clustered based on their epipolar lines
   /// Read clusterPointsFast() to see implementation details
   for(int i=0; i < pointGroups.size(); i++) {   
+    if(overBudget()) {
+      break;
+    }
     int qPtSize = pointGroups[i].size();
 
     /// Get corresponding epipolar line for this group of pts
@@ -302,31 +849,58 @@ int FeatureMatcher:: bfMatch() {
 
     /// Get features close to the epipolar line
     vector<int> probMatches;
-    getProbableMatches(idx, probMatches);
+    {
+      StageTimer timer(stats, STAGE_CANDIDATES);
+      getProbableMatches(idx, pointGroups[i], probMatches);
+    }
+    if(stats != NULL) {
+      stats->count(COUNT_GROUPS, 1);
+      stats->addCandidateSet(probMatches.size());
+    }
 
     if(probMatches.size() == 0) {
       continue;
     }
 
+    /// Rank the candidates of each query by their sketches if the set
+    /// is larger than the number kept
+    int sketchKeep = candidatePolicy.sketchKeep;
+    bool rankSketches = sketching() && (int)probMatches.size() > sketchKeep;
+    vector< pair<int, int> > ranked;
+
     ///  For each points within a cluster, find descriptor space distance 
     ///  from all the points in the candidate set (probMatches) 
     ///  Inster the points in a map, to sort in order of distance
     for(int j=0; j < pointGroups[i].size(); j++) {
+      if(j > 0 && j % BUDGET_CHECK_INTERVAL == 0 && overBudget()) {
+        break;
+      }
+      int numExact = rankSketches ? sketchKeep : probMatches.size();
+      numComparisons += numExact;
 
       int qPtIdx = pointGroups[i][j];
 
-      unsigned char* currQuery = srcKey + 128*qPtIdx;
+      const Desc* currQuery = (const Desc*)srcKey + descDim*qPtIdx;
       multimap<float,int> distMap;
 
-      for(int jj=0; jj < probMatches.size(); jj++) {
-        unsigned char* refVector = refKey + 128*probMatches[jj];
-
-        float acc = 0.0;
-        for(int dd=0; dd < 128; dd++) {
-          acc = acc + (refVector[dd] - currQuery[dd])*
-            (refVector[dd] - currQuery[dd]);
+      {
+        StageTimer timer(stats, STAGE_SEARCH);
+        if(rankSketches) {
+          nearestSketches(qPtIdx, probMatches, ranked);
+          if(stats != NULL) {
+            stats->count(COUNT_SKETCH_REJECTS, 
+                probMatches.size() - sketchKeep);
+          }
+        }
+        for(int jj=0; jj < numExact; jj++) {
+          int cand = rankSketches ? probMatches[ranked[jj].second] :
+            probMatches[jj];
+          const Desc* refVector = (const Desc*)refKey + descDim*cand;
+
+          float acc = (float)descriptorDistance<Desc, DIM>(refVector, 
+              currQuery, descDim);
+          distMap.insert(make_pair(acc,cand)); 
         }
-        distMap.insert(make_pair(acc,probMatches[jj])); 
       }
 
       multimap<float,int>::iterator itr;
@@ -343,24 +917,21 @@ int FeatureMatcher:: bfMatch() {
       float distRatio1 = sqrt(bestDist/secondBestDist);
 
       distMap.clear();
+      if(stats != NULL) {
+        stats->count(COUNT_QUERIES, 1);
+      }
 
       if(distRatio1 > 0.6) {
+        if(stats != NULL) {
+          stats->count(COUNT_RATIO_REJECTS, 1);
+        }
         continue;
       }
 
       int matchingPt = bestMatch.second;
 
       /// Perform epipolar verification
-      double x2[] = {refKeysInfo[matchingPt].x, 
-        refKeysInfo[matchingPt].y, 1.0};
-      double line[3];
-      geometry::ComputeEpipolarLine(x2,fMatrix.data(),line,true); 
-
-      double x1[] = {srcKeysInfo[qPtIdx].x,
-        srcKeysInfo[qPtIdx].y, 1.0};
-      float epiDist2 = 
-        geometry::ComputeDistanceFromLine( x1, line);
-      if(epiDist2 >= 4.0) {
+      if(!verifyMatch(qPtIdx, matchingPt)) {
         continue;
       }
       matches.push_back(make_pair(qPtIdx, matchingPt));
@@ -380,11 +951,30 @@ int FeatureMatcher:: bfMatch() {
  **/
 
 int FeatureMatcher::match() {
+  TraceSpan span(stats != NULL ? stats->trace : NULL, "match", 
+      stats != NULL ? stats->pair : -1);
+  switch(descType) {
+    case KEY_UINT16:  return matchT<unsigned short>();
+    case KEY_FLOAT32: return matchT<float>();
+    default:          return matchT<unsigned char>();
+  }
+}
+
+/*! \brief match() for descriptors with values of type Desc.
+ **/
+template <class Desc>
+int FeatureMatcher::matchT() {
+  typedef typename ANNkd_treeT<Desc>::Dist Dist;
+
   matches.clear();
   /// For all groups of points clustered based on their epipolar lines
   /// Read clusterPointsFast() to see implementation details
 
   for(int i=0; i < pointGroups.size(); i++) {  
+    /// Return the matches found so far once the budget is used up
+    if(overBudget()) {
+      break;
+    }
     int qPtSize = pointGroups[i].size();
 
     /// Get corresponding epipolar line for this group of pts
@@ -395,12 +985,17 @@ int FeatureMatcher::match() {
     /// of its descriptors
 
     vector<int> probMatches;
-    ANNkd_tree* tree = constructSearchTree(idx, probMatches);
+    vector<Desc> subKeys;
+    ANNkd_treeT<Desc>* tree = constructSearchTree(idx, pointGroups[i], 
+        probMatches, subKeys);
+    if(stats != NULL) {
+      stats->count(COUNT_GROUPS, 1);
+      stats->addCandidateSet(probMatches.size());
+    }
 
     /// Limit the nodes to visit in this tree as max(20% of candidates,20)
     int PtsToVisit = (float)(probMatches.size())/20;
     PtsToVisit = PtsToVisit > 20 ? PtsToVisit : 20;
-    annMaxPtsVisit(PtsToVisit);
 
     if(tree == NULL) {
       continue;
@@ -410,15 +1005,24 @@ int FeatureMatcher::match() {
     /// from the candidate set (probMatches) using Kd-tree in descriptor
     /// space and perform ratio-test
     for(int j=0; j < pointGroups[i].size(); j++) {
-      vector<ANNidx> nn_idx(2);
-      vector<ANNdist> dists(2);
+      if(j > 0 && j % BUDGET_CHECK_INTERVAL == 0 && overBudget()) {
+        break;
+      }
+      numComparisons += probMatches.size();
 
-      vector<ANNidx> nn_idx1(2);
-      vector<ANNdist> dists1(2);
+      ANNidx nn_idx[2];
+      Dist dists[2];
 
       int qPtIdx = pointGroups[i][j];
-      unsigned char* currQuery = srcKey + 128*qPtIdx;
-      tree->annkPriSearch(currQuery, 2, nn_idx.data(), dists.data(), 0.0);
+      const Desc* currQuery = (const Desc*)srcKey + descDim*qPtIdx;
+      {
+        StageTimer timer(stats, STAGE_SEARCH);
+        tree->annkPriSearch(currQuery, 2, nn_idx, dists, 0.0, PtsToVisit,
+            stats != NULL ? &stats->matchSearch : NULL);
+      }
+      if(stats != NULL) {
+        stats->count(COUNT_QUERIES, 1);
+      }
 
 
       /// Perform ratio-test between closest two points
@@ -428,22 +1032,16 @@ int FeatureMatcher::match() {
       float distRatio1 = sqrt(bestDist/secondBestDist);
 
       if(distRatio1 > 0.6) {
+        if(stats != NULL) {
+          stats->count(COUNT_RATIO_REJECTS, 1);
+        }
         continue;
       }
 
       int matchingPt = probMatches[(int)nn_idx[0]];
 
       /// Perform epipolar verification
-      double x2[] = {refKeysInfo[matchingPt].x,
-        refKeysInfo[matchingPt].y, 1.0};
-      double line[3];
-      geometry::ComputeEpipolarLine(x2,fMatrix.data(),line,true); 
-
-      double x1[] = {srcKeysInfo[qPtIdx].x,
-        srcKeysInfo[qPtIdx].y, 1.0};
-      float epiDist2 = 
-        geometry::ComputeDistanceFromLine( x1, line);
-      if(epiDist2 >= 4.0) {
+      if(!verifyMatch(qPtIdx, matchingPt)) {
         continue;
       }
       matches.push_back(make_pair(qPtIdx, matchingPt));
@@ -451,7 +1049,6 @@ int FeatureMatcher::match() {
     }
 
     /// Free memory.
-    annDeallocPts(tree->pts);
     delete tree;
   }
 
@@ -459,12 +1056,39 @@ int FeatureMatcher::match() {
   return matchCount;
 }
 
+/*! \brief Epipolar verification of a match found by match() or 
+ **  bfMatch(): the source point must lie within 4px of the epipolar 
+ **  line of the reference point.
+ **/
+bool FeatureMatcher::verifyMatch(int qPtIdx, int matchingPt) {
+  StageTimer timer(stats, STAGE_VERIFY);
+  double x2[] = {refKeysInfo[matchingPt].x,
+    refKeysInfo[matchingPt].y, 1.0};
+  double line[3];
+  geometry::ComputeEpipolarLine(x2,fMatrix.data(),line,true); 
+
+  double x1[] = {srcKeysInfo[qPtIdx].x,
+    srcKeysInfo[qPtIdx].y, 1.0};
+  float epiDist2 = 
+    geometry::ComputeDistanceFromLine( x1, line);
+  if(epiDist2 >= 4.0) {
+    if(stats != NULL) {
+      stats->count(COUNT_EPIPOLAR_REJECTS, 1);
+    }
+    return false;
+  }
+  return true;
+}
+
 /*! \brief Finds the candidate set using grid-based search
  **
  **  For a given point, finds features within 4px of its epipolar line
  **  Uses the grid-based search method explained in the WACV 2015 paper 
+ **  The set is then filtered, capped and padded as set by the 
+ **  CandidatePolicy; queries are the source features of the group.
  **/
-void FeatureMatcher::getProbableMatches(int idx, vector<int>& probMatches) {
+void FeatureMatcher::getProbableMatches(int idx, const vector<int>& queries,
+    vector<int>& probMatches) {
   double* currLine = epiLines[idx].data();
   int groupIdx = pointToLineGroupIdx[idx];
   vector<double>& endPoints = lineEndPointGroups[groupIdx];
@@ -485,44 +1109,255 @@ void FeatureMatcher::getProbableMatches(int idx, vector<int>& probMatches) {
   }
 
   rGrid->getGridPoints(x, y, probMatches);
-   // If probable matches are too few, ratio-test is meaning less and
-    // can generate false positives and add noise
-    // Add a random set of points as candidates in this case
-    if(probMatches.size() > 0 && probMatches.size() < 50) {
-        set<int> randIndices;
-        set<int>::iterator setItr;
-        pair<set<int>::iterator,bool> ret;
-
-        while(probMatches.size() < 50) {
-            int rand_index = rand() % numRefPts;
-            ret = randIndices.insert( rand_index );
-            if(ret.second == true) {
-                probMatches.push_back(rand_index);
-            }
-        }
+  if(keyFilter) {
+    filterCandidates(queries, probMatches);
+  }
+
+  if(candidatePolicy.maxCandidates > 0 && 
+      (int)probMatches.size() > candidatePolicy.maxCandidates) {
+    capCandidates(idx, probMatches);
+    if(stats != NULL) {
+      stats->count(COUNT_CAPPED_GROUPS, 1);
+    }
+  }
+
+  // If probable matches are too few, ratio-test is meaning less and
+  // can generate false positives and add noise
+  // Add points from the shuffled pool as candidates in this case
+  if(probMatches.size() > 0 && 
+      (int)probMatches.size() < candidatePolicy.minCandidates) {
+    padCandidates(idx, probMatches);
+    if(stats != NULL) {
+      stats->count(COUNT_PADDED_GROUPS, 1);
+    }
+  }
+
+  /// The ratio test needs two candidates
+  if(probMatches.size() < 2) {
+    probMatches.clear();
+  }
+}
+
+/*! \brief Drops the candidates whose scale and orientation agree with
+ **  none of the queries of the group (see consistentKeys())
+ **/
+void FeatureMatcher::filterCandidates(const vector<int>& queries,
+    vector<int>& probMatches) {
+  double logTolerance = candidatePolicy.scaleTolerance > 0 ? 
+    log(candidatePolicy.scaleTolerance) : 0;
+  double orientTolerance = candidatePolicy.orientTolerance;
+
+  /// Predicted log scale and orientation in the reference image
+  int numQueries = queries.size();
+  vector<double> qLogScale(numQueries);
+  vector<double> qOrient(numQueries);
+  vector<char> qScaled(numQueries);
+  for(int q=0; q < numQueries; q++) {
+    const keypt_t& src = srcKeysInfo[queries[q]];
+    qScaled[q] = src.scale > 0;
+    qLogScale[q] = qScaled[q] ? log(src.scale) + keyLogScale : 0;
+    qOrient[q] = src.orient + keyRotation;
+  }
+
+  int numKept = 0;
+  for(int p=0; p < (int)probMatches.size(); p++) {
+    const keypt_t& ref = refKeysInfo[probMatches[p]];
+    bool refScaled = ref.scale > 0;
+    double refLogScale = refScaled ? log(ref.scale) : 0;
+    bool consistent = false;
+    for(int q=0; q < numQueries && !consistent; q++) {
+      consistent = (logTolerance <= 0 || !refScaled || !qScaled[q] ||
+          fabs(refLogScale - qLogScale[q]) <= logTolerance) &&
+        (orientTolerance <= 0 || 
+         fabs(wrapAngle(ref.orient - qOrient[q])) <= orientTolerance);
+    }
+    if(consistent) {
+      probMatches[numKept++] = probMatches[p];
     }
+  }
+  if(stats != NULL) {
+    stats->count(COUNT_CONSISTENCY_REJECTS, probMatches.size() - numKept);
+  }
+  probMatches.resize(numKept);
+}
+
+/*! \brief Ranks the candidates by the sketch distance to a query
+ **
+ **  ranked holds (distance, position in probMatches) pairs, the first 
+ **  candidatePolicy.sketchKeep of them are the nearest, in no order.
+ **/
+void FeatureMatcher::nearestSketches(int qPtIdx, 
+    const vector<int>& probMatches, vector< pair<int, int> >& ranked) {
+  const unsigned long long* query = srcSketch->getSketch(qPtIdx);
+  int numCandidates = probMatches.size();
+  ranked.resize(numCandidates);
+  for(int p=0; p < numCandidates; p++) {
+    ranked[p] = make_pair(SketchDistance(query, 
+          refSketch->getSketch(probMatches[p])), p);
+  }
+  nth_element(ranked.begin(), ranked.begin() + candidatePolicy.sketchKeep,
+      ranked.end());
+}
+
+/*! \brief Keeps the candidates among the candidatePolicy.sketchKeep 
+ **  nearest in sketch distance of some query of the group, for match()
+ **/
+void FeatureMatcher::sketchCandidates(const vector<int>& queries,
+    vector<int>& probMatches) {
+  int numCandidates = probMatches.size();
+  vector<char> keep(numCandidates, 0);
+  vector< pair<int, int> > ranked;
+  for(int q=0; q < (int)queries.size(); q++) {
+    nearestSketches(queries[q], probMatches, ranked);
+    for(int k=0; k < candidatePolicy.sketchKeep; k++) {
+      keep[ranked[k].second] = 1;
+    }
+  }
+
+  int numKept = 0;
+  for(int p=0; p < numCandidates; p++) {
+    if(keep[p]) {
+      probMatches[numKept++] = probMatches[p];
+    }
+  }
+  probMatches.resize(numKept);
+  if(stats != NULL) {
+    stats->count(COUNT_SKETCH_REJECTS, 
+        (long long)(numCandidates - numKept)*queries.size());
+  }
+}
+
+/*! \brief Subsamples a candidate set to candidatePolicy.maxCandidates
+ **
+ **  The candidates are binned by their position along the line group,
+ **  each of the CANDIDATE_POSITION_BINS bins keeps a share of the cap 
+ **  proportional to its size, picked evenly from its candidates sorted 
+ **  by decreasing scale. The result is deterministic and stays sorted
+ **  by feature index like the grid output.
+ **/
+void FeatureMatcher::capCandidates(int idx, vector<int>& probMatches) {
+  int numCandidates = probMatches.size();
+  int cap = candidatePolicy.maxCandidates;
+
+  vector<double>& endPoints = lineEndPointGroups[pointToLineGroupIdx[idx]];
+  double dx = endPoints[2] - endPoints[0];
+  double dy = endPoints[3] - endPoints[1];
+  double len2 = dx*dx + dy*dy;
+
+  /// Position bins, each sorted by decreasing scale
+  vector< vector< pair<float, int> > > bins(CANDIDATE_POSITION_BINS);
+  for(int p=0; p < numCandidates; p++) {
+    const keypt_t& key = refKeysInfo[probMatches[p]];
+    double t = 0.0;
+    if(len2 > 0) {
+      t = ((key.x - endPoints[0])*dx + (key.y - endPoints[1])*dy)/len2;
+    }
+    int b = (int)floor(t*CANDIDATE_POSITION_BINS);
+    b = b < 0 ? 0 : (b >= CANDIDATE_POSITION_BINS ? 
+        CANDIDATE_POSITION_BINS - 1 : b);
+    bins[b].push_back(make_pair(-key.scale, probMatches[p]));
+  }
+
+  /// Proportional shares, the remainder goes to the bins cut short
+  vector<int> quota(CANDIDATE_POSITION_BINS);
+  int assigned = 0;
+  for(int b=0; b < CANDIDATE_POSITION_BINS; b++) {
+    quota[b] = (int)((long long)cap*bins[b].size()/numCandidates);
+    assigned += quota[b];
+  }
+  for(int b=0; b < CANDIDATE_POSITION_BINS && assigned < cap; b++) {
+    if(quota[b] < (int)bins[b].size()) {
+      quota[b]++;
+      assigned++;
+    }
+  }
+
+  probMatches.clear();
+  for(int b=0; b < CANDIDATE_POSITION_BINS; b++) {
+    int n = bins[b].size();
+    if(quota[b] == 0) {
+      continue;
+    }
+    sort(bins[b].begin(), bins[b].end());
+    for(int m=0; m < quota[b]; m++) {
+      int pick = (int)((long long)(2*m + 1)*n/(2*quota[b]));
+      probMatches.push_back(bins[b][pick].second);
+    }
+  }
+  sort(probMatches.begin(), probMatches.end());
+}
+
+/*! \brief Pads a candidate set to candidatePolicy.minCandidates
+ **
+ **  Takes reference features from padPool, a permutation of all of them
+ **  shuffled once per matcher with the random seed, starting at a place
+ **  derived from idx, the index of the source feature whose epipolar 
+ **  line the group uses, so it does not depend on the order in which the
+ **  groups are matched. Features already in the (sorted) set 
+ **  are skipped, so no feature is a candidate twice.
+ **/
+void FeatureMatcher::padCandidates(int idx, vector<int>& probMatches) {
+  if((int)padPool.size() != numRefPts) {
+    padPool.resize(numRefPts);
+    for(int p=0; p < numRefPts; p++) {
+      padPool[p] = p;
+    }
+    unsigned int seed = randSeed;
+    for(int p=numRefPts-1; p > 0; p--) {
+      int q = rand_r(&seed) % (p + 1);
+      swap(padPool[p], padPool[q]);
+    }
+  }
+  if(numRefPts == 0) {
+    return;
+  }
+
+  int numGrid = probMatches.size();
+  int start = (int)(((unsigned int)idx*2654435761u) % numRefPts);
+  for(int p=0; p < numRefPts && 
+      (int)probMatches.size() < candidatePolicy.minCandidates; p++) {
+    int cand = padPool[(start + p) % numRefPts];
+    if(!binary_search(probMatches.begin(), probMatches.begin() + numGrid, 
+          cand)) {
+      probMatches.push_back(cand);
+    }
+  }
 }
 
 
 /*! \brief Finds the candidate set and builds a Kd-tree of its descriptors.
+ **
+ **  The descriptors of the candidates are copied to subKeys, which must
+ **  outlive the returned tree.
  **/
-ANNkd_tree* FeatureMatcher::constructSearchTree(int idx, vector<int>& probMatches) {
-  getProbableMatches(idx, probMatches);
+template <class Desc>
+ANNkd_treeT<Desc>* FeatureMatcher::constructSearchTree(int idx, 
+    const vector<int>& queries, vector<int>& probMatches, 
+    vector<Desc>& subKeys) {
+  {
+    StageTimer timer(stats, STAGE_CANDIDATES);
+    getProbableMatches(idx, queries, probMatches);
+    if(sketching() && (int)probMatches.size() > candidatePolicy.sketchKeep) {
+      sketchCandidates(queries, probMatches);
+    }
+  }
   if(probMatches.size() == 0) {
     return NULL;
   }
+  StageTimer timer(stats, STAGE_TREE);
 
   int numSubKeys = probMatches.size();
-  ANNpointArray subKeyPts = annAllocPts( numSubKeys, 128 );
+  subKeys.resize(numSubKeys*descDim);
   for(int p=0; p < numSubKeys; p++) {
     int pm = probMatches[p];
-    memcpy(subKeyPts[p], refKey + 128*pm,
-        sizeof(unsigned char)*128);
+    memcpy(&subKeys[p*descDim], (const Desc*)refKey + descDim*pm,
+        sizeof(Desc)*descDim);
   }
 
 //  printf("\nProb Matches size = %d", probMatches.size());
 
-  ANNkd_tree* subTree = new ANNkd_tree(subKeyPts, numSubKeys, 128, 16);
+  ANNkd_treeT<Desc>* subTree = new ANNkd_treeT<Desc>(subKeys.data(), 
+      numSubKeys, descDim, 16);
   return subTree;
 }
 
@@ -533,6 +1368,7 @@ ANNkd_tree* FeatureMatcher::constructSearchTree(int idx, vector<int>& probMatche
  **  Endpoints are packed into a long long int for faster computation
  **/
 void FeatureMatcher::clusterPointsFast() {
+  StageTimer timer(stats, STAGE_CLUSTER);
 
   lineEndPointGroups.reserve(2000);
   pointGroups.reserve(2000);
@@ -608,6 +1444,7 @@ void FeatureMatcher::clusterPointsFast() {
  **  This is slower than clusterPointsFast() but better tested
  **/
 void FeatureMatcher::clusterPoints() {
+  StageTimer timer(stats, STAGE_CLUSTER);
   lineEndPointGroups.reserve(2000);
   pointGroups.reserve(2000);
   pointToLineGroupIdx.resize(numSrcPts);
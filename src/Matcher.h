@@ -25,6 +25,10 @@
 #include "defs.h"
 #include "keys2a.h"
 #include "Gridder.h"
+#include "GlobalTree.h"
+#include "MatchStats.h"
+#include "ANN/ANNkd_treeT.h"
+#include "KeySketch.h"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -33,7 +37,113 @@
 
 namespace match {
 
+/* Default length of a descriptor vector (SIFT) */
+const int DEFAULT_DESC_DIM = 128;
+
+/* Squared L2 distance between two descriptors with values of type Desc
+ * (unsigned char, unsigned short or float, see keydesc_t).
+ * DIM is the descriptor length; 128, 64 and 32 get fixed trip counts,
+ * DIM = 0 is the generic version and reads the length from dim. */
+template <class Desc, int DIM>
+inline typename ANNcoordTraits<Desc>::Dist descriptorDistance(
+    const Desc* a, const Desc* b, int dim) {
+  return annDistT<Desc, typename ANNcoordTraits<Desc>::Dist, DIM>(a, b, dim);
+}
+
+/* Progressive global matching (see globalMatchProgressive()).
+ * Matches are counted as well distributed once they fall into at least
+ * PROGRESSIVE_MIN_CELLS cells of a PROGRESSIVE_GRID_SIZE^2 grid over
+ * the source image. The fraction of features grows by 
+ * PROGRESSIVE_STEP_PERCENT per step. */
+const int PROGRESSIVE_STEP_PERCENT = 10;
+const int PROGRESSIVE_GRID_SIZE = 4;
+const int PROGRESSIVE_MIN_CELLS = 6;
+const int DEFAULT_PROGRESSIVE_TARGET = 60;
+
+/* Pair pre-rejection probe (see probeMatch()). By default the probe
+ * searches the larger of DEFAULT_PROBE_SIZE features and 
+ * DEFAULT_PROBE_FRACTION of the top-scale features, and may wrongly 
+ * reject at most DEFAULT_PROBE_BUDGET of the pairs that would pass the
+ * global stage. A sample too small to reject any pair within the budget
+ * is grown up to PROBE_MAX_FRACTION of the top-scale features. */
+const int DEFAULT_PROBE_SIZE = 200;
+const double DEFAULT_PROBE_FRACTION = 0.05;
+const double DEFAULT_PROBE_BUDGET = 0.02;
+const double PROBE_MAX_FRACTION = 0.5;
+
+/* Smallest probe match count for which a pair with at least minMatches
+ * global matches among numTop features is kept, wrongly rejecting at
+ * most a budget fraction of such pairs. 0 means never reject. */
+int probeRejectThreshold(int numProbe, int numTop, int minMatches,
+    double budget);
+
+/* Number of the numTop top-scale features the probe searches (see 
+ * above), 0 if no sample of at most PROBE_MAX_FRACTION of them can 
+ * reject a pair with at least minMatches global matches */
+int probeSampleSize(int numTop, int probeSize, double probeFraction,
+    int minMatches, double budget);
+
+/* Limits on the work spent on one pair, 0 for no limit. The matcher
+ * checks them between units of work and stops early: globalMatch() 
+ * keeps the matches found so far, computeFmatrix() fails and match()
+ * and bfMatch() return the matches found so far. Time is counted from 
+ * the start given to setBudget(). A comparison is one candidate a query
+ * of match() or bfMatch() is searched against. maxRansacIters caps the
+ * RANSAC iterations of computeFmatrix(), which then runs its own
+ * bounded estimator instead of findFundamentalMat(CV_FM_RANSAC). */
+struct PairBudget {
+  double maxSeconds;
+  long long maxComparisons;
+  int maxRansacIters;
+
+  PairBudget() : maxSeconds(0), maxComparisons(0), maxRansacIters(0) {}
+};
+
+/* Queries of globalMatch() and match() between two budget checks */
+const int BUDGET_CHECK_INTERVAL = 64;
+
+/* Size limits of the candidate set of a group (see getProbableMatches()).
+ * A set smaller than minCandidates is padded with reference features
+ * from a shuffled pool of the matcher, since the ratio test means little
+ * against a few candidates. A set larger than maxCandidates (0: no cap)
+ * is subsampled: the line is cut into CANDIDATE_POSITION_BINS stretches,
+ * each keeps its share of the cap, spread evenly over its scales. 
+ *
+ * With scaleTolerance or orientTolerance set, computeFmatrix() also 
+ * estimates the dominant scale ratio and rotation from reference to 
+ * source features over its inliers, and a candidate is kept only if it
+ * agrees with them for some feature of the group: its scale within a
+ * factor of scaleTolerance of the predicted one, its orientation within
+ * orientTolerance radians. The filter is left off for a pair whose
+ * inliers mostly disagree (less than KEY_CONSISTENCY_MIN_SUPPORT), or 
+ * whose F did not come from computeFmatrix(). 
+ *
+ * With sketchKeep set and the sketches of both images given (see 
+ * setSketches()), the exact descriptor distance is computed only for the
+ * sketchKeep candidates of a query nearest in sketch (Hamming) distance:
+ * bfMatch() per query, match() builds its kd-tree of a group over the 
+ * union of these candidates of its queries. */
+const int DEFAULT_MIN_CANDIDATES = 50;
+const int CANDIDATE_POSITION_BINS = 16;
+const int KEY_CONSISTENCY_MIN_MATCHES = 16;
+const double KEY_CONSISTENCY_MIN_SUPPORT = 0.5;
+
+struct CandidatePolicy {
+  int minCandidates;
+  int maxCandidates;
+  double scaleTolerance;
+  double orientTolerance;
+  int sketchKeep;
+
+  CandidatePolicy() : minCandidates(DEFAULT_MIN_CANDIDATES), 
+    maxCandidates(0), scaleTolerance(0), orientTolerance(0), 
+    sketchKeep(0) {}
+};
+
 class FeatureMatcher{
+  int descDim;
+  keydesc_t descType;
+
   int numSrcPts;
 	unsigned char* srcKey;
 	keypt_t* srcKeysInfo;
@@ -61,8 +171,69 @@ class FeatureMatcher{
     Gridder* qGrid;
     Gridder* rGrid;
 
+    const GlobalTree* srcGlobalTree;
+    const GlobalTree* refGlobalTree;
+
+    int numGlobalQueries;
+    unsigned int randSeed;
+    PairStats* stats;
+
+    CandidatePolicy candidatePolicy;
+    vector< int > padPool;
+    const KeySketch* srcSketch;
+    const KeySketch* refSketch;
+
+    /// Dominant log scale ratio and rotation of the pair, valid if
+    /// keyFilter is set
+    bool keyFilter;
+    double keyLogScale;
+    double keyRotation;
+
+    PairBudget budget;
+    double budgetStart;
+    long long numComparisons;
+    int budgetExceeded;
+
+    template <class Desc> int globalMatchT(int h, bool twoway, 
+        int targetMatches, bool* targetMet);
+    template <class Desc> int probeMatchT(int h, int numProbe);
+    template <class Desc> int matchT();
+    template <class Desc> int bfMatchT();
+    template <class Desc, int DIM> int bfMatchDim();
+    bool verifyMatch(int qPtIdx, int matchingPt);
+    void estimateKeyConsistency();
+    bool consistentKeys(int qPtIdx, int refPtIdx);
+    void filterCandidates(const vector<int>& queries, 
+        vector<int>& probMatches);
+    void capCandidates(int idx, vector<int>& probMatches);
+    void sketchCandidates(const vector<int>& queries, 
+        vector<int>& probMatches);
+    void nearestSketches(int qPtIdx, const vector<int>& probMatches,
+        vector< pair<int, int> >& ranked);
+
+    /* True if candidates are ranked by their sketches */
+    bool sketching() {
+        return candidatePolicy.sketchKeep > 0 && srcSketch != NULL && 
+          refSketch != NULL;
+    }
+    void padCandidates(int idx, vector<int>& probMatches);
+    bool checkBudget();
+
+    /* True once the time or comparison budget is used up */
+    bool overBudget() {
+        return (budget.maxSeconds > 0 || budget.maxComparisons > 0) &&
+          checkBudget();
+    }
+
     public:
 
+    FeatureMatcher() : descDim(DEFAULT_DESC_DIM), descType(KEY_UINT8),
+        srcGlobalTree(NULL), refGlobalTree(NULL), numGlobalQueries(0),
+        randSeed(1), stats(NULL), srcSketch(NULL), refSketch(NULL), 
+        keyFilter(false), keyLogScale(0), 
+        keyRotation(0), budgetStart(0), numComparisons(0), 
+        budgetExceeded(BUDGET_NONE) {}
+
     cv::Mat queryImage;
     cv::Mat referenceImage;
     void verifyEpipolarConstraints(); 
@@ -77,12 +248,82 @@ class FeatureMatcher{
         rGrid = grid;
     }
 
+    /* Prebuilt global trees of the source and reference image. 
+     * globalMatch() uses a tree only if it was built over the same
+     * top-scale features, otherwise it builds its own. */
+    void setSrcGlobalTree(const GlobalTree* tree) {
+        srcGlobalTree = tree;
+    }
+    void setRefGlobalTree(const GlobalTree* tree) {
+        refGlobalTree = tree;
+    }
+
+    /* Seed of the shuffled pool of candidates that match() adds when a
+     * group has too few; a matcher does not share random state with 
+     * other matchers, so the matches depend only on the pair and the
+     * seed. */
+    void setRandomSeed(unsigned int seed) {
+        randSeed = seed;
+        padPool.clear();
+    }
+
+    /* Size limits, consistency filter and sketch ranking of the 
+     * candidate sets of match() and bfMatch(); set it before 
+     * computeFmatrix() */
+    void setCandidatePolicy(const CandidatePolicy& policy) {
+        candidatePolicy = policy;
+    }
+
+    /* Sketches of the source and reference keys, see 
+     * CandidatePolicy::sketchKeep; NULL (the default) for none */
+    void setSketches(const KeySketch* src, const KeySketch* ref) {
+        srcSketch = src;
+        refSketch = ref;
+    }
+
+    /* Statistics of the stages run by this matcher are added to stats,
+     * NULL (the default) disables them */
+    void setStats(PairStats* s) {
+        stats = s;
+    }
+
+    /* Limits of the work on the pair, counted from start (WallTime()) */
+    void setBudget(const PairBudget& b, double start) {
+        budget = b;
+        budgetStart = start;
+    }
+
+    /* budget_t flags of the limits the matcher ran into */
+    int getBudgetExceeded() {
+        return budgetExceeded;
+    }
+
+    /* Length of the descriptor vectors of both images */
+    void setDescriptorDim(int dim) {
+        descDim = dim;
+    }
+
+    int getDescriptorDim() {
+        return descDim;
+    }
+
+    /* Type of the descriptor values of both images. The key buffers
+     * passed to setSrcKeys/setRefKeys hold values of this type. */
+    void setDescriptorType(keydesc_t type) {
+        descType = type;
+    }
+
+    keydesc_t getDescriptorType() {
+        return descType;
+    }
+
     void setNumSrcPoints(int nSrcPts) {
         numSrcPts = nSrcPts;
     }
 
     void setNumRefPoints(int nRefPts) {
         numRefPts = nRefPts;
+        padPool.clear();
     }
 
     void setFMatrix(vector<double>& f) {
@@ -186,8 +427,20 @@ class FeatureMatcher{
     int match();
     int bfMatch();
     int globalMatch(int h, bool twoway);
-    ANNkd_tree* constructSearchTree(int idx, vector<int>& probMatches);
-    void getProbableMatches(int idx, vector<int>& probMatches);
+    int globalMatchProgressive(int h, int hMax, int targetMatches, 
+        bool twoway);
+    int probeMatch(int h, int numProbe);
+
+    /* Number of source features searched by the last global match */
+    int getNumGlobalQueries() {
+        return numGlobalQueries;
+    }
+    template <class Desc>
+    ANNkd_treeT<Desc>* constructSearchTree(int idx, 
+        const vector<int>& queries, vector<int>& probMatches,
+        vector<Desc>& subKeys);
+    void getProbableMatches(int idx, const vector<int>& queries,
+        vector<int>& probMatches);
 };
 
 };
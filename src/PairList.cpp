@@ -0,0 +1,226 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "PairList.h"
+
+#include <stdio.h>
+#include <queue>
+#include <functional>
+
+using namespace match;
+
+/// Orders pairs by reference image, then source image
+static bool refImageOrder(const ImagePair& a, const ImagePair& b) {
+  if(a.second != b.second) {
+    return a.second < b.second;
+  }
+  return a.first < b.first;
+}
+
+void match::allImagePairs(int numImages, vector< ImagePair >& pairs) {
+  pairs.clear();
+  for(int i=0; i < numImages; i++) {
+    for(int j=0; j < i; j++) {
+      pairs.push_back(make_pair(j, i));
+    }
+  }
+}
+
+void match::sortImagePairs(vector< ImagePair >& pairs) {
+  int numValid = 0;
+  for(int p=0; p < (int)pairs.size(); p++) {
+    int a = pairs[p].first;
+    int b = pairs[p].second;
+    if(a == b) {
+      continue;
+    }
+    pairs[numValid++] = a < b ? make_pair(a, b) : make_pair(b, a);
+  }
+  pairs.resize(numValid);
+
+  sort(pairs.begin(), pairs.end(), refImageOrder);
+  pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+}
+
+void match::keepNewImagePairs(int numOldImages, 
+    vector< ImagePair >& pairs) {
+  int numNew = 0;
+  for(int p=0; p < (int)pairs.size(); p++) {
+    if(pairs[p].second >= numOldImages) {
+      pairs[numNew++] = pairs[p];
+    }
+  }
+  pairs.resize(numNew);
+}
+
+bool match::parseShard(const char* str, int* shard, int* numShards) {
+  int k, n;
+  char c;
+  if(sscanf(str, "%d/%d%c", &k, &n, &c) != 2) {
+    return false;
+  }
+  if(n < 1 || k < 0 || k >= n) {
+    return false;
+  }
+  *shard = k;
+  *numShards = n;
+  return true;
+}
+
+/// Orders pairs by decreasing cost, then position
+struct PairCostOrder {
+  const vector< long long >& cost;
+  PairCostOrder(const vector< long long >& c) : cost(c) {}
+  bool operator()(int a, int b) const {
+    if(cost[a] != cost[b]) {
+      return cost[a] > cost[b];
+    }
+    return a < b;
+  }
+};
+
+void match::shardImagePairs(const vector< int >& numFeatures, int shard,
+    int numShards, vector< ImagePair >& pairs) {
+  /// Both stages search features of the source image in trees 
+  /// of the reference image
+  vector< long long > cost(pairs.size());
+  vector< int > order(pairs.size());
+  for(int p=0; p < (int)pairs.size(); p++) {
+    cost[p] = (long long)numFeatures[pairs[p].first] + 
+      numFeatures[pairs[p].second];
+    order[p] = p;
+  }
+  sort(order.begin(), order.end(), PairCostOrder(cost));
+
+  /// Greedy assignment to the least loaded shard (lowest index on ties)
+  typedef pair< long long, int > ShardLoad;
+  priority_queue< ShardLoad, vector< ShardLoad >, greater< ShardLoad > > 
+    loads;
+  for(int k=0; k < numShards; k++) {
+    loads.push(make_pair(0LL, k));
+  }
+
+  vector< bool > keep(pairs.size(), false);
+  for(int o=0; o < (int)order.size(); o++) {
+    ShardLoad best = loads.top();
+    loads.pop();
+    keep[order[o]] = (best.second == shard);
+    best.first += cost[order[o]];
+    loads.push(best);
+  }
+
+  int numKept = 0;
+  for(int p=0; p < (int)pairs.size(); p++) {
+    if(keep[p]) {
+      pairs[numKept++] = pairs[p];
+    }
+  }
+  pairs.resize(numKept);
+}
+
+/// Orders pairs by tile, then reference image, then source image
+struct PairTileOrder {
+  int tileSize;
+  PairTileOrder(int t) : tileSize(t) {}
+  bool operator()(const ImagePair& a, const ImagePair& b) const {
+    int rowA = a.second/tileSize, rowB = b.second/tileSize;
+    if(rowA != rowB) {
+      return rowA < rowB;
+    }
+    /// Odd rows of tiles run backwards, so every row starts
+    /// next to the source tile the previous row ended with
+    int colA = a.first/tileSize, colB = b.first/tileSize;
+    if(colA != colB) {
+      return (rowA % 2 == 0) ? colA < colB : colA > colB;
+    }
+    return refImageOrder(a, b);
+  }
+};
+
+void match::tileImagePairs(int tileSize, vector< ImagePair >& pairs) {
+  if(tileSize < 1) {
+    tileSize = 1;
+  }
+  sort(pairs.begin(), pairs.end(), PairTileOrder(tileSize));
+}
+
+bool match::readPairList(const char* fileName, int numImages,
+    vector< ImagePair >& pairs) {
+  ifstream pairFile(fileName);
+  if(!pairFile.is_open()) {
+    printf("\nError opening pair list %s\n", fileName);
+    return false;
+  }
+
+  pairs.clear();
+  string line;
+  int lineNum = 0;
+  int numSkipped = 0;
+  while(getline(pairFile, line)) {
+    lineNum++;
+    if(line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    int a, b;
+    if(sscanf(line.c_str(), "%d %d", &a, &b) != 2) {
+      printf("\nBad pair at line %d of %s\n", lineNum, fileName);
+      return false;
+    }
+
+    if(a < 0 || b < 0 || a >= numImages || b >= numImages) {
+      numSkipped++;
+      continue;
+    }
+    pairs.push_back(make_pair(a, b));
+  }
+
+  if(numSkipped > 0) {
+    printf("\nSkipped %d pairs with unknown images in %s\n", 
+        numSkipped, fileName);
+  }
+
+  sortImagePairs(pairs);
+  return true;
+}
+
+bool match::writePairList(const char* fileName, 
+    const vector< ImagePair >& pairs) {
+  FILE* fp = fopen(fileName, "w");
+  if(fp == NULL) {
+    printf("\nError opening pair list %s for writing\n", fileName);
+    return false;
+  }
+
+  for(int p=0; p < (int)pairs.size(); p++) {
+    fprintf(fp, "%d %d\n", pairs[p].first, pairs[p].second);
+  }
+
+  bool ok = !ferror(fp);
+  if(fclose(fp) != 0) {
+    ok = false;
+  }
+  if(!ok) {
+    printf("\nError writing pair list %s\n", fileName);
+  }
+  return ok;
+}
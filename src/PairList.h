@@ -0,0 +1,77 @@
+#ifndef __PAIR_LIST_H
+#define __PAIR_LIST_H 
+
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+
+namespace match {
+
+/* An image pair to match, (source image, reference image) with 
+ * source < reference as in the match file (<im1 im2> with im1 < im2) */
+typedef pair<int, int> ImagePair;
+
+/* Fills pairs with all pairs of numImages images */
+void allImagePairs(int numImages, vector< ImagePair >& pairs);
+
+/* Puts every pair in (source < reference) order, drops self pairs and
+ * duplicates and sorts the pairs by reference image, then source image.
+ * All pairs of a reference image are then matched in a row and share
+ * its global tree and grid, and the output follows the order of a run
+ * over all pairs. */
+void sortImagePairs(vector< ImagePair >& pairs);
+
+/* Keeps only the pairs with an image index of numOldImages or more,
+ * i.e. the pairs an appended image takes part in. Pairs must be in
+ * (source < reference) order. */
+void keepNewImagePairs(int numOldImages, vector< ImagePair >& pairs);
+
+/* Parses a shard "k/n", 0 <= k < n */
+bool parseShard(const char* str, int* shard, int* numShards);
+
+/* Keeps the pairs of shard k of n. The pairs are split by their 
+ * estimated cost (numFeatures of both images): in order of decreasing
+ * cost, every pair goes to the shard with the least total cost so far.
+ * The split only depends on the pairs and feature counts, so separate
+ * processes agree on it, and the kept pairs stay in their order. */
+void shardImagePairs(const vector< int >& numFeatures, int shard, 
+    int numShards, vector< ImagePair >& pairs);
+
+/* Reorders pairs (sorted by sortImagePairs()) into tiles of tileSize 
+ * reference by tileSize source images. The tiles of a row of tiles 
+ * share the reference images and run back and forth, so that the 
+ * images of about two tiles are in use at a time. */
+void tileImagePairs(int tileSize, vector< ImagePair >& pairs);
+
+/* Reads a pair list, one <i j> pair of image indices (as in the key 
+ * list) per line. Empty lines and lines starting with # are skipped, 
+ * as are pairs with an index outside [0, numImages). The pairs are 
+ * returned sorted by sortImagePairs(). */
+bool readPairList(const char* fileName, int numImages, 
+    vector< ImagePair >& pairs);
+
+/* Writes pairs in the format read by readPairList() */
+bool writePairList(const char* fileName, const vector< ImagePair >& pairs);
+
+};
+#endif //__PAIR_LIST_H 
@@ -0,0 +1,136 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "PerfCounters.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+using namespace match;
+
+static const char* PERF_COUNTER_NAMES[NUM_PERF_COUNTERS] = {
+  "cycles", "instructions", "llc_misses", "branch_misses"
+};
+
+static const unsigned long long PERF_COUNTER_CONFIGS[NUM_PERF_COUNTERS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+const char* match::PerfCounterName(int counter) {
+  return PERF_COUNTER_NAMES[counter];
+}
+
+PerfCounterGroup::PerfCounterGroup() {
+  for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+    fds[c] = -1;
+  }
+}
+
+PerfCounterGroup::~PerfCounterGroup() {
+  for(int c=NUM_PERF_COUNTERS-1; c >= 0; c--) {
+    if(fds[c] >= 0) {
+      close(fds[c]);
+    }
+  }
+}
+
+bool PerfCounterGroup::open() {
+  for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNTER_CONFIGS[c];
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    /// The first counter leads the group; pid 0, cpu -1 is this thread
+    fds[c] = syscall(__NR_perf_event_open, &attr, 0, -1, 
+        c == 0 ? -1 : fds[0], 0);
+    if(fds[c] < 0) {
+      int err = errno;
+      printf("\nError opening hardware counter %s: %s\n", 
+          PERF_COUNTER_NAMES[c], strerror(err));
+      for(int o=c-1; o >= 0; o--) {
+        close(fds[o]);
+        fds[o] = -1;
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PerfCounterGroup::read(unsigned long long* values) {
+  /// nr, time enabled, time running, one value per counter
+  unsigned long long buf[3 + NUM_PERF_COUNTERS];
+  if(::read(fds[0], buf, sizeof(buf)) != sizeof(buf) || 
+      buf[0] != NUM_PERF_COUNTERS) {
+    return false;
+  }
+
+  double scale = 1.0;
+  if(buf[2] > 0 && buf[2] < buf[1]) {
+    scale = (double)buf[1]/(double)buf[2];
+  }
+  for(int c=0; c < NUM_PERF_COUNTERS; c++) {
+    values[c] = scale == 1.0 ? buf[3 + c] : 
+      (unsigned long long)(buf[3 + c]*scale);
+  }
+  return true;
+}
+
+PerfMonitor::PerfMonitor() {
+  pthread_key_create(&key, NULL);
+  pthread_mutex_init(&lock, NULL);
+}
+
+PerfMonitor::~PerfMonitor() {
+  for(int g=0; g < (int)groups.size(); g++) {
+    delete groups[g];
+  }
+  pthread_key_delete(key);
+  pthread_mutex_destroy(&lock);
+}
+
+/*! \brief Opens the group of a thread on its first call; a group that
+ **  failed to open is kept too, so that it is not retried.
+ **/
+PerfCounterGroup* PerfMonitor::getThreadGroup() {
+  PerfCounterGroup* group = (PerfCounterGroup*)pthread_getspecific(key);
+  if(group == NULL) {
+    group = new PerfCounterGroup();
+    group->open();
+    pthread_mutex_lock(&lock);
+    groups.push_back(group);
+    pthread_mutex_unlock(&lock);
+    pthread_setspecific(key, group);
+  }
+  return group->isOpen() ? group : NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef __PERF_COUNTERS_H
+#define __PERF_COUNTERS_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+
+#include <pthread.h>
+
+namespace match {
+
+/* Hardware counters of a PerfCounterGroup */
+enum perfcounter_t {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,      /* last level cache misses */
+  PERF_BRANCH_MISSES,
+  NUM_PERF_COUNTERS
+};
+
+/* Names of the counters in the exported statistics */
+const char* PerfCounterName(int counter);
+
+/* The counters of NUM_PERF_COUNTERS as one perf_event_open group of the
+ * calling thread, user space only, so that they are scheduled together
+ * and read with one system call. Linux only; needs 
+ * kernel.perf_event_paranoid <= 2 (or CAP_PERFMON). */
+class PerfCounterGroup {
+  int fds[NUM_PERF_COUNTERS];
+
+  public:
+  PerfCounterGroup();
+  ~PerfCounterGroup();
+
+  /* Opens and starts the counters for the calling thread */
+  bool open();
+
+  bool isOpen() const {
+    return fds[0] >= 0;
+  }
+
+  /* Current counts, scaled up if the group was multiplexed */
+  bool read(unsigned long long* values);
+};
+
+/* A PerfCounterGroup per thread, opened on first use by the thread */
+class PerfMonitor {
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  vector< PerfCounterGroup* > groups;
+
+  public:
+  PerfMonitor();
+  ~PerfMonitor();
+
+  /* The group of the calling thread, NULL if it could not be opened */
+  PerfCounterGroup* getThreadGroup();
+};
+
+};
+#endif //__PERF_COUNTERS_H
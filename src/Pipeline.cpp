@@ -0,0 +1,198 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "Pipeline.h"
+
+#include <pthread.h>
+
+using namespace match;
+
+/* State shared by the threads of a pipeline run */
+struct PipelineState {
+  PairStages* stages;
+  int numPairs;
+  int window;
+  int prefetchDistance;
+
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  /// Next pair to match, to prefetch and to write
+  int nextMatch;
+  int nextPrefetch;
+  int nextWrite;
+  bool stop;
+
+  /// Results of pairs nextWrite to nextWrite+window-1, by p % window
+  vector< PairResult > results;
+  vector< char > ready;
+};
+
+static void* matchThread(void* arg) {
+  PipelineState* s = (PipelineState*)arg;
+
+  pthread_mutex_lock(&s->lock);
+  while(true) {
+    while(!s->stop && s->nextMatch < s->numPairs && 
+        s->nextMatch >= s->nextWrite + s->window) {
+      pthread_cond_wait(&s->changed, &s->lock);
+    }
+    if(s->stop || s->nextMatch >= s->numPairs) {
+      break;
+    }
+    int p = s->nextMatch++;
+    pthread_cond_broadcast(&s->changed);
+    pthread_mutex_unlock(&s->lock);
+
+    /// Only this thread uses the slot until it is ready
+    PairResult& result = s->results[p % s->window];
+    bool ok = s->stages->match(p, result);
+
+    /// A failed slot is never marked ready, the writer stops before it
+    pthread_mutex_lock(&s->lock);
+    if(ok) {
+      s->ready[p % s->window] = 1;
+    } else {
+      s->stop = true;
+    }
+    pthread_cond_broadcast(&s->changed);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+static void* prefetchThread(void* arg) {
+  PipelineState* s = (PipelineState*)arg;
+
+  pthread_mutex_lock(&s->lock);
+  while(true) {
+    if(s->nextPrefetch < s->nextMatch) {
+      s->nextPrefetch = s->nextMatch;
+    }
+    while(!s->stop && s->nextPrefetch < s->numPairs &&
+        s->nextPrefetch >= s->nextMatch + s->prefetchDistance) {
+      pthread_cond_wait(&s->changed, &s->lock);
+    }
+    if(s->stop || s->nextPrefetch >= s->numPairs) {
+      break;
+    }
+    int p = s->nextPrefetch++;
+    pthread_mutex_unlock(&s->lock);
+
+    s->stages->prefetch(p);
+
+    pthread_mutex_lock(&s->lock);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+bool match::RunPairPipeline(PairStages& stages, int numPairs, 
+    int numThreads, int window, int prefetchDistance) {
+  if(numThreads <= 1 && prefetchDistance <= 0) {
+    PairResult result;
+    for(int p=0; p < numPairs; p++) {
+      if(!stages.match(p, result) || !stages.write(p, result)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  numThreads = numThreads > 1 ? numThreads : 1;
+  window = window > numThreads ? window : numThreads;
+
+  PipelineState s;
+  s.stages = &stages;
+  s.numPairs = numPairs;
+  s.window = window;
+  s.prefetchDistance = prefetchDistance;
+  s.nextMatch = 0;
+  s.nextPrefetch = 0;
+  s.nextWrite = 0;
+  s.stop = false;
+  s.results.resize(window);
+  s.ready.assign(window, 0);
+  pthread_mutex_init(&s.lock, NULL);
+  pthread_cond_init(&s.changed, NULL);
+
+  vector< pthread_t > threads(numThreads);
+  for(int t=0; t < numThreads; t++) {
+    pthread_create(&threads[t], NULL, matchThread, &s);
+  }
+  pthread_t prefetcher;
+  if(prefetchDistance > 0) {
+    pthread_create(&prefetcher, NULL, prefetchThread, &s);
+  }
+
+  /// Write the results in order as they become ready
+  bool ok = true;
+  for(int p=0; p < numPairs; p++) {
+    pthread_mutex_lock(&s.lock);
+    while(!s.ready[p % window] && !s.stop) {
+      pthread_cond_wait(&s.changed, &s.lock);
+    }
+    bool isReady = s.ready[p % window];
+    pthread_mutex_unlock(&s.lock);
+
+    /// A failed match stops the run at that pair
+    if(!isReady) {
+      ok = false;
+      break;
+    }
+
+    PairResult& result = s.results[p % window];
+    if(!stages.write(p, result)) {
+      ok = false;
+    }
+    result.matches.clear();
+
+    pthread_mutex_lock(&s.lock);
+    s.ready[p % window] = 0;
+    s.nextWrite = p + 1;
+    if(!ok) {
+      s.stop = true;
+    }
+    pthread_cond_broadcast(&s.changed);
+    pthread_mutex_unlock(&s.lock);
+
+    if(!ok) {
+      break;
+    }
+  }
+
+  pthread_mutex_lock(&s.lock);
+  s.stop = true;
+  pthread_cond_broadcast(&s.changed);
+  pthread_mutex_unlock(&s.lock);
+
+  for(int t=0; t < numThreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  if(prefetchDistance > 0) {
+    pthread_join(prefetcher, NULL);
+  }
+
+  pthread_cond_destroy(&s.changed);
+  pthread_mutex_destroy(&s.lock);
+  return ok;
+}
@@ -0,0 +1,87 @@
+#ifndef __PIPELINE_H
+#define __PIPELINE_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "FMatrixCache.h"
+#include "MatchStats.h"
+
+namespace match {
+
+/* Outcome of matching one pair of a match-graph run */
+enum pairstatus_t {
+  PAIR_SKIPPED = 0,  /* done in an earlier (resumed) run */
+  PAIR_PRUNED,       /* rejected by the probe */
+  PAIR_SELECTED,     /* passed the probe, only pairs are emitted */
+  PAIR_NO_GLOBAL,    /* too few matches in the global stage */
+  PAIR_MATCHED,      /* fully matched, matches may still be too few */
+  PAIR_PARTIAL,      /* matched until the budget ran out */
+  PAIR_OVER_BUDGET   /* ran out of its budget and was skipped */
+};
+
+struct PairResult {
+  pairstatus_t status;
+  bool probed;
+  int numGlobalQueries;
+  vector< pair<int, int> > matches;
+
+  /// budget_t flags of the limits the pair ran into
+  int budgetExceeded;
+
+  /// Set if the global stage ran, its outcome is in fEntry
+  bool newFMatrix;
+  FMatrixEntry fEntry;
+
+  /// Filled only if statistics are collected
+  PairStats stats;
+};
+
+/* The stages of a pipelined run over numPairs pairs. prefetch() and 
+ * match() are called from worker threads, for different pairs at the
+ * same time; write() is called for every pair in pair order, one pair 
+ * at a time. A stage returns false to stop the run. */
+class PairStages {
+  public:
+  virtual ~PairStages() {}
+
+  /* Loads the data of pair p ahead of its matching */
+  virtual void prefetch(int p) = 0;
+
+  /* Matches pair p */
+  virtual bool match(int p, PairResult& result) = 0;
+
+  /* Writes the result of pair p */
+  virtual bool write(int p, PairResult& result) = 0;
+};
+
+/* Runs the stages over the pairs. numThreads threads match pairs in
+ * order of index while the calling thread writes the results in order;
+ * at most window pairs are matched ahead of the writer. If 
+ * prefetchDistance > 0, one more thread prefetches pairs up to that 
+ * many pairs ahead of the matching. With one thread and no prefetching
+ * the pairs are matched and written on the calling thread. */
+bool RunPairPipeline(PairStages& stages, int numPairs, int numThreads,
+    int window, int prefetchDistance);
+
+};
+#endif //__PIPELINE_H 
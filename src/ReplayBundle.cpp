@@ -0,0 +1,161 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "ReplayBundle.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace match;
+
+/* Header of a replay bundle, followed by the key arrays */
+struct ReplayFileHeader {
+  char magic[8];
+  int im1;
+  int im2;
+  int dim;
+  int type;
+  int numSrc;
+  int numRef;
+  int srcWidth;
+  int srcHeight;
+  int refWidth;
+  int refHeight;
+  int hasF;
+  int numMatches;
+  double seconds;
+  double F[9];
+  ReplayParams params;
+};
+
+static const char REPLAY_MAGIC[8] = "GAPAIR5";
+
+ReplayBundle::~ReplayBundle() {
+  if(ownsKeys) {
+    delete[] srcKeys;
+    delete[] srcInfo;
+    delete[] refKeys;
+    delete[] refInfo;
+  }
+}
+
+/*! \brief Writes the bundle under a temporary name and renames it, so a
+ **  killed run never leaves a partial bundle
+ **/
+bool ReplayBundle::write(const char* name) const {
+  ReplayFileHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic));
+  hdr.im1 = im1;
+  hdr.im2 = im2;
+  hdr.dim = dim;
+  hdr.type = (int)type;
+  hdr.numSrc = numSrc;
+  hdr.numRef = numRef;
+  hdr.srcWidth = srcWidth;
+  hdr.srcHeight = srcHeight;
+  hdr.refWidth = refWidth;
+  hdr.refHeight = refHeight;
+  hdr.hasF = hasF ? 1 : 0;
+  hdr.numMatches = numMatches;
+  hdr.seconds = seconds;
+  memcpy(hdr.F, F, sizeof(hdr.F));
+  hdr.params = params;
+
+  size_t descSize = (size_t)dim*KeyDescriptorSize(type);
+
+  char tmpFile[1024];
+  snprintf(tmpFile, sizeof(tmpFile), "%s.%d.tmp", name, (int)getpid());
+  FILE* fp = fopen(tmpFile, "wb");
+  if(fp == NULL) {
+    printf("\nError writing replay bundle %s\n", name);
+    return false;
+  }
+
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+    fwrite(srcKeys, descSize, numSrc, fp) == (size_t)numSrc &&
+    fwrite(srcInfo, sizeof(keypt_t), numSrc, fp) == (size_t)numSrc &&
+    fwrite(refKeys, descSize, numRef, fp) == (size_t)numRef &&
+    fwrite(refInfo, sizeof(keypt_t), numRef, fp) == (size_t)numRef;
+  ok = (fclose(fp) == 0) && ok;
+
+  if(!ok || rename(tmpFile, name) != 0) {
+    printf("\nError writing replay bundle %s\n", name);
+    unlink(tmpFile);
+    return false;
+  }
+  return true;
+}
+
+/*! \brief Reads the keys of one image; the descriptor buffer is padded
+ **  like the ones of ReadKeyFile
+ **/
+static bool readImageKeys(FILE* fp, int num, size_t descSize,
+    unsigned char** keys, keypt_t** info) {
+  *keys = new unsigned char[num*descSize + 8];
+  *info = new keypt_t[num];
+  return fread(*keys, descSize, num, fp) == (size_t)num &&
+    fread(*info, sizeof(keypt_t), num, fp) == (size_t)num;
+}
+
+bool ReplayBundle::read(const char* name) {
+  FILE* fp = fopen(name, "rb");
+  if(fp == NULL) {
+    printf("\nError opening replay bundle %s\n", name);
+    return false;
+  }
+
+  ReplayFileHeader hdr;
+  bool ok = fread(&hdr, sizeof(hdr), 1, fp) == 1 && 
+    memcmp(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic)) == 0 &&
+    hdr.numSrc > 0 && hdr.numRef > 0 && IsSupportedKeyLength(hdr.dim) &&
+    hdr.type >= KEY_UINT8 && hdr.type <= KEY_FLOAT32;
+
+  if(ok) {
+    im1 = hdr.im1;
+    im2 = hdr.im2;
+    dim = hdr.dim;
+    type = (keydesc_t)hdr.type;
+    numSrc = hdr.numSrc;
+    numRef = hdr.numRef;
+    srcWidth = hdr.srcWidth;
+    srcHeight = hdr.srcHeight;
+    refWidth = hdr.refWidth;
+    refHeight = hdr.refHeight;
+    hasF = hdr.hasF != 0;
+    numMatches = hdr.numMatches;
+    seconds = hdr.seconds;
+    memcpy(F, hdr.F, sizeof(F));
+    params = hdr.params;
+
+    size_t descSize = (size_t)dim*KeyDescriptorSize(type);
+    ownsKeys = true;
+    ok = readImageKeys(fp, numSrc, descSize, &srcKeys, &srcInfo) &&
+      readImageKeys(fp, numRef, descSize, &refKeys, &refInfo);
+  }
+  fclose(fp);
+
+  if(!ok) {
+    printf("\nInvalid replay bundle %s\n", name);
+  }
+  return ok;
+}
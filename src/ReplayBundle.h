@@ -0,0 +1,94 @@
+#ifndef __REPLAY_BUNDLE_H
+#define __REPLAY_BUNDLE_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "keys2a.h"
+
+namespace match {
+
+/* Settings of match_graph that decide how a pair is matched */
+struct ReplayParams {
+  int topscale;
+  int treeTopscale;
+  int twoway;
+  int progressive;
+  int topscaleMax;
+  int progressiveTarget;
+  int probe;
+  int probeSize;
+  double probeFraction;
+  double probeBudget;
+  unsigned int seed;  /* random seed of match() for the pair */
+  int minCandidates;  /* CandidatePolicy of match() */
+  int maxCandidates;
+  double scaleTolerance;
+  double orientTolerance;
+  int sketchKeep;
+};
+
+/* Self-contained copy of one pair of a match-graph run, so that the 
+ * pair can be matched again without the rest of the collection (see 
+ * replay_pair).
+ *
+ * The file holds a header with the pair, the image dimensions, the
+ * ReplayParams, F and the outcome of the run, followed by the 
+ * descriptors (as read by ReadKeyFile) and the keypt_t array of the 
+ * source and then the reference image. F is valid if hasF is set; it
+ * is the F the run used, computed or taken from the F-matrix cache. */
+class ReplayBundle {
+  bool ownsKeys;
+
+  public:
+  int im1;
+  int im2;
+  int dim;
+  keydesc_t type;
+  int numSrc;
+  int numRef;
+  unsigned char* srcKeys;
+  keypt_t* srcInfo;
+  unsigned char* refKeys;
+  keypt_t* refInfo;
+  int srcWidth, srcHeight, refWidth, refHeight;
+  ReplayParams params;
+  bool hasF;
+  double F[9];
+
+  /// Outcome of the run that wrote the bundle
+  double seconds;
+  int numMatches;
+
+  ReplayBundle() : ownsKeys(false), numSrc(0), numRef(0), srcKeys(NULL), 
+      srcInfo(NULL), refKeys(NULL), refInfo(NULL) {}
+  ~ReplayBundle();
+
+  /* Writes a bundle; the keys set by the caller are only read */
+  bool write(const char* name) const;
+
+  /* Reads a bundle; the keys then belong to this object */
+  bool read(const char* name);
+};
+
+};
+#endif //__REPLAY_BUNDLE_H 
@@ -0,0 +1,250 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "Synthetic.h"
+
+#include <stdio.h>
+
+using namespace match;
+
+/// Random numbers from a private seed, so scenes do not depend on
+/// other users of rand()
+static double uniform(unsigned int* seed, double lo, double hi) {
+  return lo + (hi - lo)*(rand_r(seed)/((double)RAND_MAX + 1.0));
+}
+
+static double gaussian(unsigned int* seed, double sigma) {
+  double u1 = uniform(seed, 1e-12, 1.0);
+  double u2 = uniform(seed, 0.0, 1.0);
+  return sigma*sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+}
+
+static double exponential(unsigned int* seed, double mean) {
+  return -mean*log(uniform(seed, 1e-12, 1.0));
+}
+
+/* One feature of a view before sorting by scale */
+struct SyntheticFeature {
+  keypt_t info;
+  int pointId;
+  vector< unsigned char > desc;
+
+  bool operator<(const SyntheticFeature& f) const {
+    return info.scale > f.info.scale;
+  }
+};
+
+/*! \brief Image position of point X in a camera at C with rotation R
+ ** (row-major), false if it falls outside the image
+ **/
+static bool project(const SyntheticParams& params, const double* R, 
+    const double* C, const double* X, double* u, double* v) {
+  double d[3] = { X[0] - C[0], X[1] - C[1], X[2] - C[2] };
+  double x = R[0]*d[0] + R[1]*d[1] + R[2]*d[2];
+  double y = R[3]*d[0] + R[4]*d[1] + R[5]*d[2];
+  double z = R[6]*d[0] + R[7]*d[1] + R[8]*d[2];
+  *u = params.focal*x/z + params.width/2.0;
+  *v = params.focal*y/z + params.height/2.0;
+  return z > 0 && *u > 20 && *u < params.width - 20 && *v > 20 && 
+    *v < params.height - 20;
+}
+
+/*! \brief Projects the points into the camera (R, C) and adds clutter
+ **/
+static void makeView(const SyntheticParams& params, 
+    const vector< vector<double> >& points,
+    const vector< vector<unsigned char> >& descs, 
+    const vector< double >& scales, const double* R, const double* C,
+    unsigned int* seed, SyntheticView& view) {
+  vector< SyntheticFeature > feats;
+
+  for(int i=0; i < (int)points.size(); i++) {
+    double u, v;
+    project(params, R, C, points[i].data(), &u, &v);
+
+    SyntheticFeature f;
+    f.info.x = u + gaussian(seed, params.pixelNoise);
+    f.info.y = v + gaussian(seed, params.pixelNoise);
+    f.info.scale = scales[i]*uniform(seed, 0.9, 1.1);
+    f.info.orient = uniform(seed, -M_PI, M_PI);
+    f.pointId = i;
+    f.desc.resize(128);
+    for(int d=0; d < 128; d++) {
+      int v = descs[i][d] + (int)floor(gaussian(seed, params.descNoise) + 
+          0.5);
+      f.desc[d] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    feats.push_back(f);
+  }
+
+  int numClutter = (int)(params.numPoints*params.clutterFraction);
+  for(int i=0; i < numClutter; i++) {
+    SyntheticFeature f;
+    f.info.x = uniform(seed, 20, params.width - 20);
+    f.info.y = uniform(seed, 20, params.height - 20);
+    f.info.scale = exponential(seed, 3.0) + 1.0;
+    f.info.orient = uniform(seed, -M_PI, M_PI);
+    f.pointId = -1;
+    f.desc.resize(128);
+    for(int d=0; d < 128; d++) {
+      double v = exponential(seed, 25.0);
+      f.desc[d] = (unsigned char)(v > 255 ? 255 : v);
+    }
+    feats.push_back(f);
+  }
+
+  stable_sort(feats.begin(), feats.end());
+
+  view.numKeys = feats.size();
+  delete[] view.keys;
+  delete[] view.info;
+  view.keys = new unsigned char[view.numKeys*128];
+  view.info = new keypt_t[view.numKeys];
+  view.pointIds.resize(view.numKeys);
+  for(int k=0; k < view.numKeys; k++) {
+    memcpy(view.keys + 128*k, feats[k].desc.data(), 128);
+    view.info[k] = feats[k].info;
+    view.pointIds[k] = feats[k].pointId;
+  }
+}
+
+void match::MakeTwoViewScene(const SyntheticParams& params, 
+    SyntheticView& src, SyntheticView& ref, double* F) {
+  unsigned int seed = params.seed;
+
+  /// The reference camera is turned by yaw about the y axis and by
+  /// pitch about the x axis, R = Rx(pitch) Ry(yaw)
+  double cy = cos(params.yaw);
+  double sy = sin(params.yaw);
+  double cp = cos(params.pitch);
+  double sp = sin(params.pitch);
+  double I[9] = { 1, 0, 0,  0, 1, 0,  0, 0, 1 };
+  double R[9] = { cy, 0, sy,  sp*sy, cp, -sp*cy,  -cp*sy, sp, cp*cy };
+  double C0[3] = { 0, 0, 0 };
+  double C[3] = { params.baseline, 0, 0 };
+
+  /// Points in front of both cameras that project into both images
+  vector< vector<double> > points;
+  while((int)points.size() < params.numPoints) {
+    vector< double > p(3);
+    p[0] = uniform(&seed, -6.0, 6.0 + params.baseline);
+    p[1] = uniform(&seed, -4.5, 4.5);
+    p[2] = uniform(&seed, 9.0, 16.0);
+
+    double u, v;
+    if(project(params, I, C0, p.data(), &u, &v) && 
+        project(params, R, C, p.data(), &u, &v)) {
+      points.push_back(p);
+    }
+  }
+
+  vector< vector<unsigned char> > descs(points.size());
+  vector< double > scales(points.size());
+  for(int i=0; i < (int)points.size(); i++) {
+    descs[i].resize(128);
+    for(int d=0; d < 128; d++) {
+      double v = exponential(&seed, 25.0);
+      descs[i][d] = (unsigned char)(v > 255 ? 255 : v);
+    }
+    scales[i] = exponential(&seed, 3.0) + 1.0;
+  }
+
+  makeView(params, points, descs, scales, I, C0, &seed, src);
+  makeView(params, points, descs, scales, R, C, &seed, ref);
+
+  /// x_ref = K R (X - C), so E = [t]x R with t = -R C
+  double t[3];
+  for(int r=0; r < 3; r++) {
+    t[r] = -(R[3*r]*C[0] + R[3*r+1]*C[1] + R[3*r+2]*C[2]);
+  }
+  double T[9] = { 0, -t[2], t[1],  t[2], 0, -t[0],  -t[1], t[0], 0 };
+  double E[9];
+  for(int r=0; r < 3; r++) {
+    for(int k=0; k < 3; k++) {
+      E[3*r+k] = T[3*r]*R[k] + T[3*r+1]*R[3+k] + T[3*r+2]*R[6+k];
+    }
+  }
+
+  /// F = K^-T E K^-1
+  double f = params.focal;
+  double px = params.width/2.0;
+  double py = params.height/2.0;
+  double Kinv[9] = { 1/f, 0, -px/f,  0, 1/f, -py/f,  0, 0, 1 };
+  double EK[9];
+  for(int r=0; r < 3; r++) {
+    for(int k=0; k < 3; k++) {
+      EK[3*r+k] = E[3*r]*Kinv[k] + E[3*r+1]*Kinv[3+k] + E[3*r+2]*Kinv[6+k];
+    }
+  }
+  for(int r=0; r < 3; r++) {
+    for(int k=0; k < 3; k++) {
+      F[3*r+k] = Kinv[r]*EK[k] + Kinv[3+r]*EK[3+k] + Kinv[6+r]*EK[6+k];
+    }
+  }
+  double f8 = F[8];
+  for(int k=0; k < 9; k++) {
+    F[k] /= f8;
+  }
+}
+
+bool match::WriteSyntheticKeyFile(const char* name, 
+    const SyntheticView& view) {
+  FILE* fp = fopen(name, "w");
+  if(fp == NULL) {
+    printf("\nError opening key file %s\n", name);
+    return false;
+  }
+  fprintf(fp, "%d 128\n", view.numKeys);
+  for(int k=0; k < view.numKeys; k++) {
+    const keypt_t& p = view.info[k];
+    fprintf(fp, "%.2f %.2f %.2f %.3f\n", p.y, p.x, p.scale, p.orient);
+    for(int d=0; d < 128; d++) {
+      fprintf(fp, (d % 20 == 19 || d == 127) ? " %d\n" : " %d", 
+          view.keys[128*k + d]);
+    }
+  }
+  return fclose(fp) == 0;
+}
+
+int match::CountCorrectMatches(const vector< pair<int, int> >& matches,
+    const SyntheticView& src, const SyntheticView& ref) {
+  int numCorrect = 0;
+  for(int m=0; m < (int)matches.size(); m++) {
+    int id = src.pointIds[matches[m].first];
+    if(id >= 0 && id == ref.pointIds[matches[m].second]) {
+      numCorrect++;
+    }
+  }
+  return numCorrect;
+}
+
+int match::CountTrueMatches(const SyntheticView& src, 
+    const SyntheticView& ref) {
+  set< int > srcIds(src.pointIds.begin(), src.pointIds.end());
+  int numTrue = 0;
+  for(int k=0; k < ref.numKeys; k++) {
+    if(ref.pointIds[k] >= 0 && srcIds.count(ref.pointIds[k]) > 0) {
+      numTrue++;
+    }
+  }
+  return numTrue;
+}
@@ -0,0 +1,87 @@
+#ifndef __SYNTHETIC_H
+#define __SYNTHETIC_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "keys2a.h"
+
+namespace match {
+
+/* Parameters of a synthetic two-view scene: random 3D points seen by
+ * two pinhole cameras, the second one moved sideways by baseline and
+ * turned by yaw and pitch (radians). Each point gets a SIFT-like uint8 
+ * descriptor; every view adds gaussian noise of descNoise to it and
+ * pixelNoise to the projection. Each view also has clutterFraction 
+ * times numPoints features without a match. */
+struct SyntheticParams {
+  int numPoints;
+  double clutterFraction;
+  double descNoise;
+  double pixelNoise;
+  int width;
+  int height;
+  double focal;
+  double baseline;
+  double yaw;
+  double pitch;
+  unsigned int seed;
+
+  SyntheticParams() : numPoints(1000), clutterFraction(0.3), 
+      descNoise(6.0), pixelNoise(0.4), width(1600), height(1200),
+      focal(1100.0), baseline(1.5), yaw(0.05), pitch(0.02), seed(7) {}
+};
+
+/* Features of one view, sorted by decreasing scale as in the key files
+ * the matcher expects. pointIds[k] is the 3D point of feature k, -1 for
+ * clutter. */
+struct SyntheticView {
+  int numKeys;
+  unsigned char* keys;
+  keypt_t* info;
+  vector< int > pointIds;
+
+  SyntheticView() : numKeys(0), keys(NULL), info(NULL) {}
+  ~SyntheticView() {
+    delete[] keys;
+    delete[] info;
+  }
+};
+
+/* Builds the two views of a scene and its fundamental matrix F, in 
+ * image coordinates and normalized to F[8] = 1 like computeFmatrix(),
+ * such that x_ref^T F x_src = 0. */
+void MakeTwoViewScene(const SyntheticParams& params, SyntheticView& src,
+    SyntheticView& ref, double* F);
+
+/* Writes a view as a key file in Lowe's ASCII format */
+bool WriteSyntheticKeyFile(const char* name, const SyntheticView& view);
+
+/* Number of matches (src feature, ref feature) of the same 3D point */
+int CountCorrectMatches(const vector< pair<int, int> >& matches,
+    const SyntheticView& src, const SyntheticView& ref);
+
+/* Number of 3D points with a feature in both views */
+int CountTrueMatches(const SyntheticView& src, const SyntheticView& ref);
+
+};
+#endif //__SYNTHETIC_H 
@@ -0,0 +1,110 @@
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "Trace.h"
+
+#include <stdio.h>
+
+using namespace match;
+
+Tracer::Tracer(int eventsPerThread) : capacity(eventsPerThread) {
+  start = WallTime();
+  pthread_key_create(&key, NULL);
+  pthread_mutex_init(&lock, NULL);
+}
+
+Tracer::~Tracer() {
+  for(int b=0; b < (int)buffers.size(); b++) {
+    delete buffers[b];
+  }
+  pthread_key_delete(key);
+  pthread_mutex_destroy(&lock);
+}
+
+TraceBuffer* Tracer::getThreadBuffer() {
+  TraceBuffer* buffer = (TraceBuffer*)pthread_getspecific(key);
+  if(buffer == NULL) {
+    pthread_mutex_lock(&lock);
+    buffer = new TraceBuffer(capacity, buffers.size());
+    buffers.push_back(buffer);
+    pthread_mutex_unlock(&lock);
+    pthread_setspecific(key, buffer);
+  }
+  return buffer;
+}
+
+/*! \brief Writes the events of all threads as trace events, with times
+ **  in microseconds since the tracer was created.
+ **
+ **  If a buffer wrapped around, the end events whose begin events were
+ **  overwritten are left out, so that the spans stay nested.
+ **/
+bool Tracer::write(const char* name) {
+  FILE* fp = fopen(name, "w");
+  if(fp == NULL) {
+    printf("\nError opening trace file %s\n", name);
+    return false;
+  }
+
+  long long numDropped = 0;
+  fprintf(fp, "{\"traceEvents\":[\n");
+  for(int b=0; b < (int)buffers.size(); b++) {
+    const TraceBuffer* buffer = buffers[b];
+    fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", b == 0 ? "" : ",\n",
+        buffer->tid, buffer->tid);
+
+    long long size = buffer->events.size();
+    long long first = buffer->numEvents > size ? 
+      buffer->numEvents - size : 0;
+    numDropped += first;
+
+    int depth = 0;
+    for(long long n = first; n < buffer->numEvents; n++) {
+      const TraceEvent& e = buffer->events[n % size];
+      if(e.phase == 'E') {
+        if(depth == 0) {
+          continue;
+        }
+        depth--;
+      } else {
+        depth++;
+      }
+
+      fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+          "\"pid\":1,\"tid\":%d", e.name, e.phase, (e.time - start)*1e6,
+          buffer->tid);
+      if(e.pair >= 0) {
+        fprintf(fp, ",\"args\":{\"pair\":%d}", e.pair);
+      }
+      fprintf(fp, "}");
+    }
+  }
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":"
+      "{\"dropped_events\":%lld}}\n", numDropped);
+
+  if(fclose(fp) != 0) {
+    printf("\nError writing trace file %s\n", name);
+    return false;
+  }
+  return true;
+}
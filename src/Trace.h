@@ -0,0 +1,112 @@
+#ifndef __TRACE_H
+#define __TRACE_H 
+/*
+ * Author : Rajvi Shah (rajvi.a.shah@gmail.com)
+ * SIFT-like feature matching implementation introduced in the following paper:
+ *
+ * "Geometry-aware Feature Matching for Structure from Motion Applications", 
+ * Rajvi Shah, Vanshika Srivastava and P J Narayanan, WACV 2015.
+ * http://researchweb.iiit.ac.in/~rajvi.shah/projects/multistagesfm/
+ *
+ *
+ * Copyright (c) 2015 International Institute of Information Technology - 
+ * Hyderabad 
+ * All rights reserved.
+ *   
+ *  Permission to use, copy, modify and distribute this software and its 
+ *  documentation for educational purpose is hereby granted without fee 
+ *  provided that the above copyright notice and this permission notice 
+ *  appear in all copies of this software and that you do not sell the software.
+ *     
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND WITHOUT WARRANTY OF ANY KIND, 
+ *  EXPRESSED, IMPLIED OR OTHERWISE.
+ */
+
+#include "defs.h"
+#include "MatchStats.h"
+
+#include <pthread.h>
+
+namespace match {
+
+/* Default number of events kept per thread */
+const int DEFAULT_TRACE_EVENTS = 1 << 18;
+
+/* Begin ('B') or end ('E') of a span. name is a string constant; pair is
+ * the pair index, or -1. */
+struct TraceEvent {
+  const char* name;
+  double time;
+  int pair;
+  char phase;
+};
+
+/* Ring buffer of the events of one thread; once full, the oldest events 
+ * are overwritten. Only the owning thread adds events. */
+class TraceBuffer {
+  vector< TraceEvent > events;
+  long long numEvents;
+  int tid;
+
+  friend class Tracer;
+
+  public:
+  TraceBuffer(int capacity, int id) : events(capacity), numEvents(0), 
+      tid(id) {}
+
+  void add(const char* name, char phase, int pair) {
+    TraceEvent& e = events[numEvents % events.size()];
+    e.name = name;
+    e.time = WallTime();
+    e.pair = pair;
+    e.phase = phase;
+    numEvents++;
+  }
+};
+
+/* Records the spans of all threads of a run, each thread into its own
+ * TraceBuffer, and writes them in the Chrome trace-event format (JSON),
+ * which chrome://tracing and Perfetto open. Threads are numbered in the
+ * order of their first event. */
+class Tracer {
+  int capacity;
+  double start;
+  pthread_key_t key;
+  pthread_mutex_t lock;
+  vector< TraceBuffer* > buffers;
+
+  public:
+  Tracer(int eventsPerThread);
+  ~Tracer();
+
+  /* The buffer of the calling thread */
+  TraceBuffer* getThreadBuffer();
+
+  /* Writes the events of all threads; call once the threads are done */
+  bool write(const char* name);
+};
+
+/* Adds a span from construction to destruction to buffer, if buffer is
+ * not NULL */
+class TraceSpan {
+  TraceBuffer* buffer;
+  const char* name;
+  int pair;
+
+  public:
+  TraceSpan(TraceBuffer* b, const char* n, int p) : buffer(b), name(n), 
+      pair(p) {
+    if(buffer != NULL) {
+      buffer->add(name, 'B', pair);
+    }
+  }
+
+  ~TraceSpan() {
+    if(buffer != NULL) {
+      buffer->add(name, 'E', pair);
+    }
+  }
+};
+
+};
+#endif //__TRACE_H
@@ -0,0 +1,432 @@
+#include "defs.h"
+#include "Matcher.h"
+#include "keys2a.h"
+#include "Gridder.h"
+#include "Geometric.h"
+#include "Synthetic.h"
+#include "argvparser.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace match;
+using namespace CommandLineProcessing;
+
+/* Times each stage of geometry-aware matching separately on synthetic
+ * two-view scenes (see Synthetic.h) of several sizes. Every stage is 
+ * run --repeat times on a fresh matcher whose earlier stages are run
+ * untimed; the later stages use the true F so that they do not depend
+ * on the quality of the estimated one. One result per stage and size
+ * is written as CSV or JSON lines, with the matches found and, where 
+ * they can be checked, how many are correct. */
+
+void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
+  cmd.setIntroductoryDescription("Benchmark the matching stages");
+
+  //define error codes
+  cmd.addErrorCode(0, "Success");
+  cmd.addErrorCode(1, "Error");
+
+  cmd.setHelpOption("h", "help","");
+
+  cmd.defineOption("sizes", "Comma separated numbers of 3D points per "
+      "scene, [Default: 1000,5000,20000,50000]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("repeat", "Runs per stage and size, [Default: 3]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("stages", "Comma separated stages to run, "
+      "[Default: all]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("desc_noise", "Standard deviation of the descriptor "
+      "noise, [Default: 6]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("clutter", "Features without a match per view, as a "
+      "fraction of the points, [Default: 0.3]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("seed", "Seed of the scenes, [Default: 7]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("format", "csv or json (one object per line), "
+      "[Default: csv]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("output", "Filename with path for the results, "
+      "[Default: standard output]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("work_dir", "Directory for the key files of the "
+      "read_keys stage, [Default: /tmp]", ArgvParser::OptionRequiresValue);
+
+  int result = cmd.parse(argc, argv);
+  if (result != ArgvParser::NoParserError)
+  {
+    cout << cmd.parseErrorDescription(result);
+    exit(1);
+  }
+}
+
+enum benchstage_t {
+  STAGE_READ_KEYS = 0,
+  STAGE_GRID_BUILD,
+  STAGE_GRID_QUERY,
+  STAGE_GLOBAL_MATCH,
+  STAGE_COMPUTE_FMATRIX,
+  STAGE_EPIPOLAR_LINES,
+  STAGE_CLUSTER_POINTS,
+  STAGE_CLUSTER_POINTS_FAST,
+  STAGE_MATCH,
+  STAGE_BF_MATCH,
+  NUM_STAGES
+};
+
+static const char* STAGE_NAMES[NUM_STAGES] = {
+  "read_keys", "grid_build", "grid_query", "global_match", 
+  "compute_fmatrix", "epipolar_lines", "cluster_points", 
+  "cluster_points_fast", "match", "bf_match"
+};
+
+/* A scene and the data shared by the runs of its stages */
+struct BenchScene {
+  SyntheticView src;
+  SyntheticView ref;
+  vector< double > F;
+  Gridder* srcGrid;
+  Gridder* refGrid;
+  vector< vector<double> > srcRectEdges;
+  vector< vector<double> > refRectEdges;
+  vector< pair<int, int> > globalMatches;
+  string keyFile;
+  int width;
+  int height;
+};
+
+/* Outcome of one run of a stage; count and correct are -1 where they
+ * do not apply */
+struct StageRun {
+  double ms;
+  int count;
+  int correct;
+  double fError;
+};
+
+static double nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+}
+
+static void setupMatcher(FeatureMatcher& m, BenchScene& s) {
+  m.setNumSrcPoints(s.src.numKeys);
+  m.setSrcKeys(s.src.info, s.src.keys);
+  m.setNumRefPoints(s.ref.numKeys);
+  m.setRefKeys(s.ref.info, s.ref.keys);
+  m.setImageDims(s.width, s.height, s.width, s.height);
+  m.setSrcRectEdges(s.srcRectEdges);
+  m.setRefRectEdges(s.refRectEdges);
+  m.setQueryGrid(s.srcGrid);
+  m.setRefGrid(s.refGrid);
+  m.setRandomSeed(1);
+}
+
+/*! \brief RMS distance (pixels) of the true correspondences to their
+ ** epipolar lines under F
+ **/
+static double epipolarError(BenchScene& s, double* F) {
+  map< int, int > refOfPoint;
+  for(int k=0; k < s.ref.numKeys; k++) {
+    if(s.ref.pointIds[k] >= 0) {
+      refOfPoint[s.ref.pointIds[k]] = k;
+    }
+  }
+  double sum = 0;
+  int n = 0;
+  for(int k=0; k < s.src.numKeys; k++) {
+    map< int, int >::iterator it = refOfPoint.find(s.src.pointIds[k]);
+    if(s.src.pointIds[k] < 0 || it == refOfPoint.end()) {
+      continue;
+    }
+    double x1[] = { s.src.info[k].x, s.src.info[k].y, 1.0 };
+    double x2[] = { s.ref.info[it->second].x, s.ref.info[it->second].y, 
+      1.0 };
+    double line[3];
+    geometry::ComputeEpipolarLine(x1, F, line, false);
+    double d = geometry::ComputeDistanceFromLine(x2, line);
+    sum += d*d;
+    n++;
+  }
+  return n > 0 ? sqrt(sum/n) : 0.0;
+}
+
+/*! \brief Runs the stages before the given one untimed and times it
+ **/
+static StageRun runStage(int stage, BenchScene& s) {
+  StageRun run;
+  run.count = -1;
+  run.correct = -1;
+  run.fError = -1;
+
+  double start = 0;
+  FeatureMatcher m;
+  setupMatcher(m, s);
+
+  if(stage >= STAGE_EPIPOLAR_LINES) {
+    m.setFMatrix(s.F);
+  }
+  if(stage > STAGE_EPIPOLAR_LINES) {
+    m.computeEpipolarLines();
+  }
+  if(stage > STAGE_CLUSTER_POINTS_FAST) {
+    m.clusterPoints();
+  }
+
+  switch(stage) {
+    case STAGE_READ_KEYS: {
+      unsigned char* keys = NULL;
+      keypt_t* info = NULL;
+      start = nowMs();
+      run.count = ReadKeyFile(s.keyFile.c_str(), &keys, &info);
+      run.ms = nowMs() - start;
+      delete[] keys;
+      delete[] info;
+      return run;
+    }
+    case STAGE_GRID_BUILD: {
+      start = nowMs();
+      Gridder grid(16, s.width, s.height, s.ref.numKeys, s.ref.info);
+      run.ms = nowMs() - start;
+      return run;
+    }
+    case STAGE_GRID_QUERY: {
+      /// The cells around every source feature position
+      vector< float > x(1);
+      vector< float > y(1);
+      vector< int > pts;
+      long long total = 0;
+      start = nowMs();
+      for(int k=0; k < s.src.numKeys; k++) {
+        x[0] = s.src.info[k].x;
+        y[0] = s.src.info[k].y;
+        pts.clear();
+        s.refGrid->getNearbyGridPoints(x, y, pts);
+        total += pts.size();
+      }
+      run.ms = nowMs() - start;
+      run.count = (int)(total/(s.src.numKeys > 0 ? s.src.numKeys : 1));
+      return run;
+    }
+    case STAGE_GLOBAL_MATCH:
+      start = nowMs();
+      run.count = m.globalMatch(20, false);
+      run.ms = nowMs() - start;
+      run.correct = CountCorrectMatches(m.matches, s.src, s.ref);
+      return run;
+    case STAGE_COMPUTE_FMATRIX: {
+      vector< double > F(9);
+      m.matches = s.globalMatches;
+      start = nowMs();
+      run.count = m.computeFmatrix(F.data());
+      run.ms = nowMs() - start;
+      run.correct = CountCorrectMatches(m.matches, s.src, s.ref);
+      run.fError = epipolarError(s, F.data());
+      return run;
+    }
+    case STAGE_EPIPOLAR_LINES:
+      start = nowMs();
+      m.computeEpipolarLines();
+      run.ms = nowMs() - start;
+      return run;
+    case STAGE_CLUSTER_POINTS:
+      start = nowMs();
+      m.clusterPoints();
+      run.ms = nowMs() - start;
+      return run;
+    case STAGE_CLUSTER_POINTS_FAST:
+      start = nowMs();
+      m.clusterPointsFast();
+      run.ms = nowMs() - start;
+      return run;
+    case STAGE_MATCH:
+      start = nowMs();
+      run.count = m.match();
+      run.ms = nowMs() - start;
+      run.correct = CountCorrectMatches(m.matches, s.src, s.ref);
+      return run;
+    case STAGE_BF_MATCH:
+      start = nowMs();
+      run.count = m.bfMatch();
+      run.ms = nowMs() - start;
+      run.correct = CountCorrectMatches(m.matches, s.src, s.ref);
+      return run;
+  }
+  run.ms = 0;
+  return run;
+}
+
+static void splitList(const string& str, vector< string >& items) {
+  size_t start = 0;
+  while(start <= str.size()) {
+    size_t end = str.find(',', start);
+    if(end == string::npos) {
+      end = str.size();
+    }
+    if(end > start) {
+      items.push_back(str.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  ArgvParser cmd;
+  SetupCommandlineParser(cmd, argc, argv);
+
+  vector< string > sizeList;
+  splitList(cmd.foundOption("sizes") ? cmd.optionValue("sizes") : 
+      string("1000,5000,20000,50000"), sizeList);
+
+  int repeat = 3;
+  if(cmd.foundOption("repeat")) {
+    string str = cmd.optionValue("repeat");
+    repeat = atoi(str.c_str());
+    repeat = repeat > 1 ? repeat : 1;
+  }
+
+  vector< bool > runStageFlag(NUM_STAGES, !cmd.foundOption("stages"));
+  if(cmd.foundOption("stages")) {
+    vector< string > names;
+    splitList(cmd.optionValue("stages"), names);
+    for(int n=0; n < (int)names.size(); n++) {
+      int st = 0;
+      while(st < NUM_STAGES && names[n] != STAGE_NAMES[st]) {
+        st++;
+      }
+      if(st == NUM_STAGES) {
+        printf("\nUnknown stage %s\n", names[n].c_str());
+        return -1;
+      }
+      runStageFlag[st] = true;
+    }
+  }
+
+  SyntheticParams params;
+  if(cmd.foundOption("desc_noise")) {
+    string str = cmd.optionValue("desc_noise");
+    params.descNoise = atof(str.c_str());
+  }
+  if(cmd.foundOption("clutter")) {
+    string str = cmd.optionValue("clutter");
+    params.clutterFraction = atof(str.c_str());
+  }
+  if(cmd.foundOption("seed")) {
+    string str = cmd.optionValue("seed");
+    params.seed = atoi(str.c_str());
+  }
+
+  bool json = false;
+  if(cmd.foundOption("format")) {
+    string str = cmd.optionValue("format");
+    if(str == "json") {
+      json = true;
+    } else if(str != "csv") {
+      printf("\nUnknown format %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  string workDir = "/tmp";
+  if(cmd.foundOption("work_dir")) {
+    workDir = cmd.optionValue("work_dir");
+  }
+
+  FILE* out = stdout;
+  if(cmd.foundOption("output")) {
+    string str = cmd.optionValue("output");
+    out = fopen(str.c_str(), "w");
+    if(out == NULL) {
+      printf("\nError opening output file %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  if(!json) {
+    fprintf(out, "stage,points,src_features,ref_features,repeat,min_ms,"
+        "median_ms,count,correct,true_matches,f_error\n");
+  }
+
+  for(int z=0; z < (int)sizeList.size(); z++) {
+    params.numPoints = atoi(sizeList[z].c_str());
+
+    BenchScene s;
+    s.width = params.width;
+    s.height = params.height;
+    s.F.resize(9);
+    MakeTwoViewScene(params, s.src, s.ref, s.F.data());
+    s.srcGrid = new Gridder(16, s.width, s.height, s.src.numKeys, 
+        s.src.info);
+    s.refGrid = new Gridder(16, s.width, s.height, s.ref.numKeys, 
+        s.ref.info);
+    geometry::ComputeRectangleEdges(s.width, s.height, s.srcRectEdges);
+    geometry::ComputeRectangleEdges(s.width, s.height, s.refRectEdges);
+    int numTrue = CountTrueMatches(s.src, s.ref);
+
+    char name[64];
+    sprintf(name, "/bench_%d_%d.key", params.numPoints, (int)getpid());
+    s.keyFile = workDir + name;
+    if(runStageFlag[STAGE_READ_KEYS] && 
+        !WriteSyntheticKeyFile(s.keyFile.c_str(), s.ref)) {
+      return -1;
+    }
+
+    /// The input of compute_fmatrix
+    if(runStageFlag[STAGE_COMPUTE_FMATRIX]) {
+      FeatureMatcher m;
+      setupMatcher(m, s);
+      m.globalMatch(20, false);
+      s.globalMatches = m.matches;
+    }
+
+    for(int st=0; st < NUM_STAGES; st++) {
+      if(!runStageFlag[st]) {
+        continue;
+      }
+      vector< double > times;
+      StageRun run;
+      for(int r=0; r < repeat; r++) {
+        run = runStage(st, s);
+        times.push_back(run.ms);
+      }
+      sort(times.begin(), times.end());
+      double median = times[times.size()/2];
+
+      if(json) {
+        fprintf(out, "{\"stage\": \"%s\", \"points\": %d, "
+            "\"src_features\": %d, \"ref_features\": %d, \"repeat\": %d, "
+            "\"min_ms\": %.3f, \"median_ms\": %.3f, \"count\": %d, "
+            "\"correct\": %d, \"true_matches\": %d, \"f_error\": %.4f}\n",
+            STAGE_NAMES[st], params.numPoints, s.src.numKeys, 
+            s.ref.numKeys, repeat, times[0], median, run.count, 
+            run.correct, numTrue, run.fError);
+      } else {
+        fprintf(out, "%s,%d,%d,%d,%d,%.3f,%.3f,%d,%d,%d,%.4f\n",
+            STAGE_NAMES[st], params.numPoints, s.src.numKeys, 
+            s.ref.numKeys, repeat, times[0], median, run.count, 
+            run.correct, numTrue, run.fError);
+      }
+      fflush(out);
+    }
+
+    if(runStageFlag[STAGE_READ_KEYS]) {
+      unlink(s.keyFile.c_str());
+    }
+    delete s.srcGrid;
+    delete s.refGrid;
+  }
+
+  if(out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
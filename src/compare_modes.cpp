@@ -0,0 +1,702 @@
+#include "defs.h"
+#include "Matcher.h"
+#include "keys2a.h"
+#include "Gridder.h"
+#include "Geometric.h"
+#include "Synthetic.h"
+#include "argvparser.h"
+
+#include <stdio.h>
+#include <fstream>
+
+using namespace match;
+using namespace CommandLineProcessing;
+
+/* Compares the matching modes on a fixed set of pairs: synthetic
+ * two-view scenes (see Synthetic.h) with their true F, and real pairs
+ * given by the options files of match_pairs (e.g. the .opt files in 
+ * data/pairs). A real pair has no true F; its reference F is estimated
+ * by RANSAC from exhaustive matching.
+ *
+ * The reference matches of a pair are the exhaustive matches (every
+ * source feature against all reference features, same ratio test as
+ * the matcher) within --threshold pixels of their epipolar line under
+ * the reference F. For every mode and pair the output gives the time
+ * (median of --repeat runs, from globalMatch to the final matches, the
+ * grids are built once per pair), the matches, their precision (the
+ * fraction within --threshold of the epipolar line) and their recall
+ * of the reference matches. The rows of pair "all" pool the pairs, and
+ * pareto marks the modes not dominated in time, precision and recall
+ * by another mode. */
+
+void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
+  cmd.setIntroductoryDescription("Compare the accuracy and speed of the "
+      "matching modes");
+
+  //define error codes
+  cmd.addErrorCode(0, "Success");
+  cmd.addErrorCode(1, "Error");
+
+  cmd.setHelpOption("h", "help","");
+
+  cmd.defineOption("synthetic_sizes", "Comma separated numbers of 3D "
+      "points of the synthetic scenes, [Default: 1000,4000]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("pair_options", "Comma separated options files of "
+      "real pairs, in the format of match_pairs --options_file, "
+      "[Default: none]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("topscales", "Comma separated percentages of top-scale "
+      "features for the global stage, [Default: 10,20,40]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("modes", "Comma separated modes to run, [Default: all]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("repeat", "Runs per mode and pair, [Default: 3]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("threshold", "Largest distance (pixels) of a correct "
+      "match from its epipolar line, [Default: 4]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("desc_noise", "Standard deviation of the descriptor "
+      "noise of the synthetic scenes, [Default: 6]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("seed", "Seed of the synthetic scenes, [Default: 7]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("descriptor_type", "Type of descriptor values in the "
+      "key files: uint8, uint16 or float32, [Default: uint8]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("max_candidates", "Candidate set cap of the match() "
+      "and bfMatch() modes, [Default: 0, no cap]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("scale_tolerance", "Scale factor of the candidate "
+      "consistency filter of the match() and bfMatch() modes, "
+      "[Default: 0, off]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("orient_tolerance", "Orientation (degrees) of the "
+      "candidate consistency filter of the match() and bfMatch() modes, "
+      "[Default: 0, off]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("sketch_keep", "Candidates per query of the match() "
+      "and bfMatch() modes that get the exact distance, ranked by their "
+      "sketches, [Default: 0, all]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("format", "csv or json (one object per line), "
+      "[Default: csv]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("output", "Filename with path for the results, "
+      "[Default: standard output]", ArgvParser::OptionRequiresValue);
+
+  int result = cmd.parse(argc, argv);
+  if (result != ArgvParser::NoParserError)
+  {
+    cout << cmd.parseErrorDescription(result);
+    exit(1);
+  }
+}
+
+/* A way of matching a pair. The global stage uses topscale percent of
+ * the features; unless globalOnly, F is estimated from its matches and
+ * the pair is matched by match() or bfMatch() after clusterPoints() or
+ * clusterPointsFast(). */
+struct MatchMode {
+  string name;
+  int topscale;
+  bool twoway;
+  bool globalOnly;
+  bool fastCluster;
+  bool bruteForce;
+  CandidatePolicy candidates;
+};
+
+/* A pair with its reference; the pair owns the keys and grids */
+struct ComparePair {
+  string name;
+  keydesc_t descType;
+  int descDim;
+  int numSrc;
+  int numRef;
+  unsigned char* srcKeys;
+  unsigned char* refKeys;
+  keypt_t* srcInfo;
+  keypt_t* refInfo;
+  int srcWidth, srcHeight, refWidth, refHeight;
+  Gridder* srcGrid;
+  Gridder* refGrid;
+  vector< vector<double> > srcRectEdges;
+  vector< vector<double> > refRectEdges;
+  vector< double > F;
+  set< pair<int, int> > reference;
+
+  ComparePair() : descType(KEY_UINT8), descDim(DEFAULT_DESC_DIM),
+      numSrc(0), numRef(0), srcKeys(NULL), refKeys(NULL), srcInfo(NULL),
+      refInfo(NULL), srcGrid(NULL), refGrid(NULL) {}
+  ~ComparePair() {
+    delete[] srcKeys;
+    delete[] refKeys;
+    delete[] srcInfo;
+    delete[] refInfo;
+    delete srcGrid;
+    delete refGrid;
+  }
+};
+
+/* Outcome of a mode on one pair, or pooled over pairs */
+struct ModeResult {
+  double ms;
+  long long matches;
+  long long correct;
+  long long recalled;
+  long long reference;
+  bool pareto;
+
+  ModeResult() : ms(0), matches(0), correct(0), recalled(0),
+      reference(0), pareto(false) {}
+
+  double precision() const {
+    return matches > 0 ? (double)correct/matches : 0.0;
+  }
+  double recall() const {
+    return reference > 0 ? (double)recalled/reference : 0.0;
+  }
+};
+
+static void splitList(const string& str, vector< string >& items) {
+  size_t start = 0;
+  while(start <= str.size()) {
+    size_t end = str.find(',', start);
+    if(end == string::npos) {
+      end = str.size();
+    }
+    if(end > start) {
+      items.push_back(str.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+}
+
+static void setupMatcher(FeatureMatcher& m, ComparePair& p) {
+  m.setDescriptorDim(p.descDim);
+  m.setDescriptorType(p.descType);
+  m.setNumSrcPoints(p.numSrc);
+  m.setSrcKeys(p.srcInfo, p.srcKeys);
+  m.setNumRefPoints(p.numRef);
+  m.setRefKeys(p.refInfo, p.refKeys);
+  m.setImageDims(p.srcWidth, p.srcHeight, p.refWidth, p.refHeight);
+  m.setSrcRectEdges(p.srcRectEdges);
+  m.setRefRectEdges(p.refRectEdges);
+  m.setQueryGrid(p.srcGrid);
+  m.setRefGrid(p.refGrid);
+  m.setRandomSeed(1);
+}
+
+/*! \brief Distance (pixels) of a reference feature from the epipolar
+ **  line of a source feature under F
+ **/
+static double epipolarDistance(ComparePair& p, double* F, int src,
+    int ref) {
+  double x1[] = { p.srcInfo[src].x, p.srcInfo[src].y, 1.0 };
+  double x2[] = { p.refInfo[ref].x, p.refInfo[ref].y, 1.0 };
+  double line[3];
+  geometry::ComputeEpipolarLine(x1, F, line, false);
+  return geometry::ComputeDistanceFromLine(x2, line);
+}
+
+/*! \brief Matches every source feature against all reference features
+ **  with the ratio test of the matcher
+ **/
+template <class Desc>
+static void exhaustiveMatchT(ComparePair& p,
+    vector< pair<int, int> >& matches) {
+  const Desc* srcDesc = (const Desc*)p.srcKeys;
+  const Desc* refDesc = (const Desc*)p.refKeys;
+  for(int i=0; i < p.numSrc; i++) {
+    const Desc* query = srcDesc + (size_t)i*p.descDim;
+    double best = -1, second = -1;
+    int bestIdx = -1;
+    for(int j=0; j < p.numRef; j++) {
+      double d = (double)descriptorDistance<Desc, 0>(query,
+          refDesc + (size_t)j*p.descDim, p.descDim);
+      if(bestIdx < 0 || d < best) {
+        second = best;
+        best = d;
+        bestIdx = j;
+      } else if(second < 0 || d < second) {
+        second = d;
+      }
+    }
+    if(second > 0 && sqrt(best/second) <= 0.6) {
+      matches.push_back(make_pair(i, bestIdx));
+    }
+  }
+}
+
+static void exhaustiveMatch(ComparePair& p,
+    vector< pair<int, int> >& matches) {
+  switch(p.descType) {
+    case KEY_UINT16:
+      exhaustiveMatchT<unsigned short>(p, matches);
+      break;
+    case KEY_FLOAT32:
+      exhaustiveMatchT<float>(p, matches);
+      break;
+    default:
+      exhaustiveMatchT<unsigned char>(p, matches);
+      break;
+  }
+}
+
+/*! \brief Sets the reference matches of a pair whose F is known, and
+ **  estimates F by RANSAC over the exhaustive matches otherwise.
+ **  Returns false if F can not be estimated.
+ **/
+static bool setReference(ComparePair& p, double threshold) {
+  vector< pair<int, int> > matches;
+  exhaustiveMatch(p, matches);
+
+  if(p.F.empty()) {
+    FeatureMatcher m;
+    setupMatcher(m, p);
+    m.matches = matches;
+    p.F.resize(9);
+    if(matches.size() < 16 || m.computeFmatrix(p.F.data()) == -1) {
+      printf("\nCould not estimate the reference F of %s from %d "
+          "exhaustive matches, skipping it\n", p.name.c_str(),
+          (int)matches.size());
+      return false;
+    }
+  }
+
+  for(int i=0; i < (int)matches.size(); i++) {
+    if(epipolarDistance(p, p.F.data(), matches[i].first,
+          matches[i].second) <= threshold) {
+      p.reference.insert(matches[i]);
+    }
+  }
+  return true;
+}
+
+/*! \brief Builds the pair of a synthetic scene
+ **/
+static void makeSyntheticPair(const SyntheticParams& params,
+    ComparePair& p) {
+  SyntheticView src, ref;
+  p.F.resize(9);
+  MakeTwoViewScene(params, src, ref, p.F.data());
+
+  char name[64];
+  sprintf(name, "synthetic_%d", params.numPoints);
+  p.name = name;
+  p.numSrc = src.numKeys;
+  p.numRef = ref.numKeys;
+  p.srcKeys = src.keys;
+  p.refKeys = ref.keys;
+  p.srcInfo = src.info;
+  p.refInfo = ref.info;
+  p.srcWidth = p.refWidth = params.width;
+  p.srcHeight = p.refHeight = params.height;
+
+  /// The pair owns the keys now
+  src.keys = ref.keys = NULL;
+  src.info = ref.info = NULL;
+}
+
+/*! \brief Reads the pair of a match_pairs options file. Returns false
+ **  if an option is missing or a key file can not be read.
+ **/
+static bool readPairOptions(const string& fileName, keydesc_t descType,
+    ComparePair& p) {
+  std::ifstream optFile(fileName.c_str());
+  if(!optFile.is_open()) {
+    printf("\nError opening options file %s\n", fileName.c_str());
+    return false;
+  }
+
+  map< string, string > options;
+  string line;
+  while(std::getline(optFile, line)) {
+    size_t pos = line.find('=');
+    if(line.compare(0, 2, "--") == 0 && pos != string::npos) {
+      options[line.substr(2, pos - 2)] = line.substr(pos + 1);
+    }
+  }
+
+  const char* required[] = { "source_key", "target_key",
+    "source_dimension", "target_dimension" };
+  for(int r=0; r < 4; r++) {
+    if(options.find(required[r]) == options.end()) {
+      printf("\nOption %s missing in %s\n", required[r], fileName.c_str());
+      return false;
+    }
+  }
+  if(sscanf(options["source_dimension"].c_str(), "%dx%d", &p.srcWidth,
+        &p.srcHeight) != 2 || sscanf(options["target_dimension"].c_str(),
+        "%dx%d", &p.refWidth, &p.refHeight) != 2) {
+    printf("\nInvalid image dimensions in %s\n", fileName.c_str());
+    return false;
+  }
+
+  string base = fileName.substr(fileName.find_last_of('/') + 1);
+  p.name = base.substr(0, base.find('.'));
+  p.descType = descType;
+
+  int srcDim = 0, refDim = 0;
+  p.numSrc = ReadKeyFile(options["source_key"].c_str(), &p.srcKeys,
+      &p.srcInfo, &srcDim, descType);
+  p.numRef = ReadKeyFile(options["target_key"].c_str(), &p.refKeys,
+      &p.refInfo, &refDim, descType);
+  if(p.numSrc <= 0 || p.numRef <= 0) {
+    printf("\nError reading the key files of %s\n", fileName.c_str());
+    return false;
+  }
+  if(srcDim != refDim) {
+    printf("\nDescriptor lengths do not match: %d vs %d\n", srcDim, refDim);
+    return false;
+  }
+  p.descDim = srcDim;
+  return true;
+}
+
+/*! \brief Runs a mode on a pair, returns the time in milliseconds
+ **/
+static double runMode(const MatchMode& mode, ComparePair& p,
+    vector< pair<int, int> >& matches) {
+  FeatureMatcher m;
+  setupMatcher(m, p);
+  m.setCandidatePolicy(mode.candidates);
+
+  /// Sketches belong to loading the keys and are not timed
+  KeySketch srcSketch, refSketch;
+  if(mode.candidates.sketchKeep > 0) {
+    srcSketch.init(p.srcKeys, p.numSrc, p.descDim, p.descType);
+    refSketch.init(p.refKeys, p.numRef, p.descDim, p.descType);
+    m.setSketches(&srcSketch, &refSketch);
+  }
+
+  double start = WallTime();
+  m.globalMatch(mode.topscale, mode.twoway);
+  if(!mode.globalOnly) {
+    vector< double > F(9);
+    if(m.matches.size() < 16 || m.computeFmatrix(F.data()) == -1) {
+      m.matches.clear();
+    } else {
+      m.setFMatrix(F);
+      m.computeEpipolarLines();
+      if(mode.fastCluster) {
+        m.clusterPointsFast();
+      } else {
+        m.clusterPoints();
+      }
+      if(mode.bruteForce) {
+        m.bfMatch();
+      } else {
+        m.match();
+      }
+    }
+  }
+  double ms = (WallTime() - start)*1000.0;
+
+  matches = m.matches;
+  return ms;
+}
+
+/*! \brief Runs a mode repeat times on a pair and scores its matches
+ **/
+static ModeResult scoreMode(const MatchMode& mode, ComparePair& p,
+    int repeat, double threshold) {
+  vector< double > times;
+  vector< pair<int, int> > matches;
+  for(int r=0; r < repeat; r++) {
+    times.push_back(runMode(mode, p, matches));
+  }
+  sort(times.begin(), times.end());
+
+  ModeResult res;
+  res.ms = times[times.size()/2];
+  res.matches = matches.size();
+  res.reference = p.reference.size();
+  for(int i=0; i < (int)matches.size(); i++) {
+    if(epipolarDistance(p, p.F.data(), matches[i].first,
+          matches[i].second) <= threshold) {
+      res.correct++;
+    }
+  }
+
+  /// A match may be reported more than once, recall counts it once
+  set< pair<int, int> > found(matches.begin(), matches.end());
+  set< pair<int, int> >::iterator it;
+  for(it = found.begin(); it != found.end(); it++) {
+    if(p.reference.count(*it) > 0) {
+      res.recalled++;
+    }
+  }
+  return res;
+}
+
+/*! \brief Marks the results not dominated by another one: no other
+ **  result is at least as fast, precise and complete, and better in one
+ **/
+static void markPareto(vector< ModeResult >& results) {
+  for(int a=0; a < (int)results.size(); a++) {
+    results[a].pareto = true;
+    for(int b=0; b < (int)results.size(); b++) {
+      const ModeResult& x = results[a];
+      const ModeResult& y = results[b];
+      if(y.ms <= x.ms && y.precision() >= x.precision() &&
+          y.recall() >= x.recall() && (y.ms < x.ms ||
+          y.precision() > x.precision() || y.recall() > x.recall())) {
+        results[a].pareto = false;
+        break;
+      }
+    }
+  }
+}
+
+static void writeResults(FILE* out, bool json, const string& pairName,
+    const vector< MatchMode >& modes, const vector< ModeResult >& results,
+    int repeat) {
+  for(int k=0; k < (int)modes.size(); k++) {
+    const ModeResult& r = results[k];
+    if(json) {
+      fprintf(out, "{\"pair\": \"%s\", \"mode\": \"%s\", \"repeat\": %d, "
+          "\"median_ms\": %.3f, \"matches\": %lld, \"correct\": %lld, "
+          "\"precision\": %.4f, \"recall\": %.4f, \"reference\": %lld, "
+          "\"pareto\": %d}\n", pairName.c_str(), modes[k].name.c_str(),
+          repeat, r.ms, r.matches, r.correct, r.precision(), r.recall(),
+          r.reference, r.pareto ? 1 : 0);
+    } else {
+      fprintf(out, "%s,%s,%d,%.3f,%lld,%lld,%.4f,%.4f,%lld,%d\n",
+          pairName.c_str(), modes[k].name.c_str(), repeat, r.ms,
+          r.matches, r.correct, r.precision(), r.recall(), r.reference,
+          r.pareto ? 1 : 0);
+    }
+  }
+  fflush(out);
+}
+
+/*! \brief Prints the pooled results as a table sorted by time
+ **/
+static void printParetoTable(const vector< MatchMode >& modes,
+    const vector< ModeResult >& results) {
+  vector< pair<double, int> > order;
+  for(int k=0; k < (int)modes.size(); k++) {
+    order.push_back(make_pair(results[k].ms, k));
+  }
+  sort(order.begin(), order.end());
+
+  printf("\n%-28s %10s %9s %9s %7s %6s\n", "Mode", "Time(ms)", "Matches",
+      "Precision", "Recall", "Pareto");
+  for(int o=0; o < (int)order.size(); o++) {
+    const ModeResult& r = results[order[o].second];
+    printf("%-28s %10.1f %9lld %9.4f %7.4f %6s\n",
+        modes[order[o].second].name.c_str(), r.ms, r.matches,
+        r.precision(), r.recall(), r.pareto ? "*" : "");
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  ArgvParser cmd;
+  SetupCommandlineParser(cmd, argc, argv);
+
+  vector< string > sizeList;
+  splitList(cmd.foundOption("synthetic_sizes") ?
+      cmd.optionValue("synthetic_sizes") : string("1000,4000"), sizeList);
+
+  vector< string > optionFiles;
+  if(cmd.foundOption("pair_options")) {
+    splitList(cmd.optionValue("pair_options"), optionFiles);
+  }
+
+  vector< string > topscaleList;
+  splitList(cmd.foundOption("topscales") ? cmd.optionValue("topscales") :
+      string("10,20,40"), topscaleList);
+
+  int repeat = 3;
+  if(cmd.foundOption("repeat")) {
+    string str = cmd.optionValue("repeat");
+    repeat = atoi(str.c_str());
+    repeat = repeat > 1 ? repeat : 1;
+  }
+
+  double threshold = 4.0;
+  if(cmd.foundOption("threshold")) {
+    string str = cmd.optionValue("threshold");
+    threshold = atof(str.c_str());
+  }
+
+  SyntheticParams params;
+  if(cmd.foundOption("desc_noise")) {
+    string str = cmd.optionValue("desc_noise");
+    params.descNoise = atof(str.c_str());
+  }
+  if(cmd.foundOption("seed")) {
+    string str = cmd.optionValue("seed");
+    params.seed = atoi(str.c_str());
+  }
+
+  keydesc_t descType = KEY_UINT8;
+  if(cmd.foundOption("descriptor_type")) {
+    string str = cmd.optionValue("descriptor_type");
+    if(!ParseKeyDescriptorType(str.c_str(), &descType)) {
+      printf("\nUnknown descriptor type %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  CandidatePolicy candidates;
+  if(cmd.foundOption("max_candidates")) {
+    string str = cmd.optionValue("max_candidates");
+    candidates.maxCandidates = atoi(str.c_str());
+    if(candidates.maxCandidates < 0 || (candidates.maxCandidates > 0 &&
+          candidates.maxCandidates < candidates.minCandidates)) {
+      printf("\nmax_candidates must be 0 or at least %d\n", 
+          candidates.minCandidates);
+      return -1;
+    }
+  }
+  if(cmd.foundOption("scale_tolerance")) {
+    string str = cmd.optionValue("scale_tolerance");
+    candidates.scaleTolerance = atof(str.c_str());
+  }
+  if(cmd.foundOption("orient_tolerance")) {
+    string str = cmd.optionValue("orient_tolerance");
+    candidates.orientTolerance = atof(str.c_str())*M_PI/180.0;
+  }
+  if(cmd.foundOption("sketch_keep")) {
+    string str = cmd.optionValue("sketch_keep");
+    candidates.sketchKeep = atoi(str.c_str());
+    if(candidates.sketchKeep == 1) {
+      printf("\nsketch_keep must be 0 or at least 2\n");
+      return -1;
+    }
+  }
+
+  bool json = false;
+  if(cmd.foundOption("format")) {
+    string str = cmd.optionValue("format");
+    if(str == "json") {
+      json = true;
+    } else if(str != "csv") {
+      printf("\nUnknown format %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  /// The geometry-aware modes per topscale, then the global-only ones
+  vector< MatchMode > allModes;
+  for(int t=0; t < (int)topscaleList.size(); t++) {
+    for(int c=0; c < 2; c++) {
+      for(int b=0; b < 2; b++) {
+        MatchMode mode;
+        mode.topscale = atoi(topscaleList[t].c_str());
+        mode.twoway = false;
+        mode.globalOnly = false;
+        mode.fastCluster = (c == 1);
+        mode.bruteForce = (b == 1);
+        mode.candidates = candidates;
+        mode.name = string(mode.bruteForce ? "bf_match" : "match") +
+          (mode.fastCluster ? "_cluster_fast_t" : "_cluster_t") +
+          topscaleList[t];
+        allModes.push_back(mode);
+      }
+    }
+  }
+  for(int w=0; w < 2; w++) {
+    MatchMode mode;
+    mode.topscale = 100;
+    mode.twoway = (w == 1);
+    mode.globalOnly = true;
+    mode.fastCluster = false;
+    mode.bruteForce = false;
+    mode.name = mode.twoway ? "global_twoway_t100" : "global_t100";
+    allModes.push_back(mode);
+  }
+
+  vector< MatchMode > modes = allModes;
+  if(cmd.foundOption("modes")) {
+    vector< string > names;
+    splitList(cmd.optionValue("modes"), names);
+    modes.clear();
+    for(int n=0; n < (int)names.size(); n++) {
+      int k = 0;
+      while(k < (int)allModes.size() && names[n] != allModes[k].name) {
+        k++;
+      }
+      if(k == (int)allModes.size()) {
+        printf("\nUnknown mode %s\n", names[n].c_str());
+        return -1;
+      }
+      modes.push_back(allModes[k]);
+    }
+  }
+
+  FILE* out = stdout;
+  if(cmd.foundOption("output")) {
+    string str = cmd.optionValue("output");
+    out = fopen(str.c_str(), "w");
+    if(out == NULL) {
+      printf("\nError opening output file %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  if(!json) {
+    fprintf(out, "pair,mode,repeat,median_ms,matches,correct,precision,"
+        "recall,reference,pareto\n");
+  }
+
+  vector< ModeResult > pooled(modes.size());
+  int numPairs = sizeList.size() + optionFiles.size();
+  for(int q=0; q < numPairs; q++) {
+    ComparePair p;
+    if(q < (int)sizeList.size()) {
+      params.numPoints = atoi(sizeList[q].c_str());
+      makeSyntheticPair(params, p);
+    } else if(!readPairOptions(optionFiles[q - sizeList.size()],
+          descType, p)) {
+      continue;
+    }
+
+    p.srcGrid = new Gridder(16, p.srcWidth, p.srcHeight, p.numSrc,
+        p.srcInfo);
+    p.refGrid = new Gridder(16, p.refWidth, p.refHeight, p.numRef,
+        p.refInfo);
+    geometry::ComputeRectangleEdges((double)p.srcWidth,
+        (double)p.srcHeight, p.srcRectEdges);
+    geometry::ComputeRectangleEdges((double)p.refWidth,
+        (double)p.refHeight, p.refRectEdges);
+
+    if(!setReference(p, threshold)) {
+      continue;
+    }
+
+    vector< ModeResult > results;
+    for(int k=0; k < (int)modes.size(); k++) {
+      results.push_back(scoreMode(modes[k], p, repeat, threshold));
+      pooled[k].ms += results[k].ms;
+      pooled[k].matches += results[k].matches;
+      pooled[k].correct += results[k].correct;
+      pooled[k].recalled += results[k].recalled;
+      pooled[k].reference += results[k].reference;
+    }
+    markPareto(results);
+    writeResults(out, json, p.name, modes, results, repeat);
+  }
+
+  markPareto(pooled);
+  writeResults(out, json, "all", modes, pooled, repeat);
+
+  if(out != stdout) {
+    fclose(out);
+    printParetoTable(modes, pooled);
+  }
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "defs.h"
+#include "MatchFile.h"
+#include "argvparser.h"
+
+#include <stdio.h>
+
+using namespace match;
+using namespace CommandLineProcessing;
+
+/* Converts a binary match file written by match_graph --match_format 
+ * binary to the text layout read by Bundler, keeping the order of the
+ * records or, with --sorted, in the order of a single run over all 
+ * pairs (by second image, then first image). */
+
+void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
+  cmd.setIntroductoryDescription("Convert binary match files to text");
+
+  //define error codes
+  cmd.addErrorCode(0, "Success");
+  cmd.addErrorCode(1, "Error");
+
+  cmd.setHelpOption("h", "help","");
+
+  cmd.defineOption("binary_matches", "Filename with path, binary match "
+      "file", ArgvParser::OptionRequired);
+
+  cmd.defineOption("matches_file", "Filename with path, text match file",
+      ArgvParser::OptionRequired);
+
+  cmd.defineOption("sorted", "Order the records by second image, then "
+      "first image, [Default: False]", ArgvParser::NoOptionAttribute);
+
+  int result = cmd.parse(argc, argv);
+  if (result != ArgvParser::NoParserError)
+  {
+    cout << cmd.parseErrorDescription(result);
+    exit(1);
+  }
+}
+
+static bool indexEntryLess(const MatchIndexEntry& a, 
+    const MatchIndexEntry& b) {
+  if(a.im2 != b.im2) {
+    return a.im2 < b.im2;
+  }
+  return a.im1 < b.im1;
+}
+
+int main(int argc, char* argv[]) {
+
+  ArgvParser cmd;
+  SetupCommandlineParser(cmd, argc, argv);
+
+  string binaryFileName = cmd.optionValue("binary_matches");
+  string matchFileName = cmd.optionValue("matches_file");
+
+  FILE* fp = fopen(binaryFileName.c_str(), "rb");
+  if(fp == NULL) {
+    printf("\nError opening match file %s\n", binaryFileName.c_str());
+    return -1;
+  }
+
+  vector< MatchIndexEntry > index;
+  if(!ReadMatchIndex(fp, index)) {
+    printf("\n%s is not a complete binary match file\n", 
+        binaryFileName.c_str());
+    return -1;
+  }
+  if(cmd.foundOption("sorted")) {
+    stable_sort(index.begin(), index.end(), indexEntryLess);
+  }
+
+  MatchWriter out;
+  if(!out.open(matchFileName.c_str(), MATCH_TEXT, false)) {
+    return -1;
+  }
+
+  long long numMatches = 0;
+  vector< pair<int, int> > matches;
+  for(int r=0; r < (int)index.size(); r++) {
+    if(!ReadMatchRecord(fp, index[r], matches)) {
+      printf("\nError reading record <%d %d> of %s\n", index[r].im1,
+          index[r].im2, binaryFileName.c_str());
+      return -1;
+    }
+    out.writeRecord(index[r].im1, index[r].im2, matches);
+    numMatches += matches.size();
+  }
+  fclose(fp);
+
+  if(!out.close()) {
+    printf("\nError writing match file %s\n", matchFileName.c_str());
+    return -1;
+  }
+  printf("[ConvertMatches] Converted %d records with %lld matches\n", 
+      (int)index.size(), numMatches);
+  return 0;
+}
@@ -25,6 +25,7 @@
 #include <time.h>
 
 #include <zlib.h>
+#include <sys/stat.h>
 
 #include "keys2a.h"
 
@@ -36,7 +37,7 @@
 #endif
 
 int ReadKeysM(FILE *fp, unsigned char **keys, keypt_t **info);
-int GetNumberOfKeysNormal(FILE *fp)
+int GetNumberOfKeysNormal(FILE *fp, int *len_out)
 {
     int num, len;
 
@@ -45,10 +46,12 @@ int GetNumberOfKeysNormal(FILE *fp)
         return 0;
     }
 
+    if (len_out != NULL)
+        *len_out = len;
     return num;
 }
 
-int GetNumberOfKeysGzip(gzFile fp)
+int GetNumberOfKeysGzip(gzFile fp, int *len_out)
 {
     int num, len;
 
@@ -60,11 +63,13 @@ int GetNumberOfKeysGzip(gzFile fp)
         return 0;
     }
 
+    if (len_out != NULL)
+        *len_out = len;
     return num;
 }
 
 /* Returns the number of keys in a file */
-int GetNumberOfKeys(const char *filename)
+int GetNumberOfKeys(const char *filename, int *len)
 {
     FILE *file;
 
@@ -79,17 +84,34 @@ int GetNumberOfKeys(const char *filename)
             printf("Could not open file: %s\n", filename);
             return 0;
         } else {
-            int n = GetNumberOfKeysGzip(gzf);
+            int n = GetNumberOfKeysGzip(gzf, len);
             gzclose(gzf);
             return n;
         }
     }
 
-    int n = GetNumberOfKeysNormal(file);
+    int n = GetNumberOfKeysNormal(file, len);
     fclose(file);
     return n;
 }
 
+/* Returns the size and modification time of a key file */
+bool GetKeyFileStamp(const char *filename, long long *size, 
+    long long *mtime)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        char buf[1024];
+        sprintf(buf, "%s.gz", filename);
+        if (stat(buf, &st) != 0)
+            return false;
+    }
+
+    *size = (long long) st.st_size;
+    *mtime = (long long) st.st_mtime;
+    return true;
+}
+
 /* 
 Read Key file from model
 */
@@ -125,9 +147,96 @@ printf("Reached ReadKey Model\n");
     // return ReadKeysMMAP(file);
 }
 
+/* Returns true if descriptors of the given length can be read and
+ * matched (see match::FeatureMatcher::setDescriptorDim) */
+bool IsSupportedKeyLength(int len)
+{
+    return len == 128 || len == 64 || len == 32;
+}
+
+/* Checks the descriptor length from a key file header.  Without a
+ * dim argument only 128-D (SIFT) descriptors are accepted. */
+static bool CheckKeyLength(int len, int *dim)
+{
+    if (dim == NULL) {
+        if (len != 128) {
+            printf("Keypoint descriptor length invalid (should be 128).");
+            return false;
+        }
+        return true;
+    }
+
+    if (!IsSupportedKeyLength(len)) {
+        printf("Keypoint descriptor length %d invalid "
+            "(should be 128, 64 or 32).", len);
+        return false;
+    }
+
+    *dim = len;
+    return true;
+}
+
+/* Returns the size in bytes of one descriptor value */
+int KeyDescriptorSize(keydesc_t type)
+{
+    switch (type) {
+    case KEY_UINT16:
+        return sizeof(unsigned short);
+    case KEY_FLOAT32:
+        return sizeof(float);
+    default:
+        return sizeof(unsigned char);
+    }
+}
+
+/* Parses a descriptor type name (uint8, uint16 or float32) */
+bool ParseKeyDescriptorType(const char *name, keydesc_t *type)
+{
+    if (strcmp(name, "uint8") == 0) {
+        *type = KEY_UINT8;
+    } else if (strcmp(name, "uint16") == 0) {
+        *type = KEY_UINT16;
+    } else if (strcmp(name, "float32") == 0) {
+        *type = KEY_FLOAT32;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/* Parses count descriptor values from one line of a key file and
+ * stores them as values of the given type */
+static unsigned char *ParseKeyLine(const char *buf, unsigned char *p, 
+                                   int count, keydesc_t type)
+{
+    char *end;
+    if (type == KEY_FLOAT32) {
+        float *f = (float *) p;
+        for (int i = 0; i < count; i++) {
+            f[i] = strtof(buf, &end);
+            buf = end;
+        }
+    } else if (type == KEY_UINT16) {
+        unsigned short *s = (unsigned short *) p;
+        for (int i = 0; i < count; i++) {
+            s[i] = (unsigned short) strtol(buf, &end, 10);
+            buf = end;
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            p[i] = (unsigned char) strtol(buf, &end, 10);
+            buf = end;
+        }
+    }
+
+    return p + count * KeyDescriptorSize(type);
+}
+
 /* This reads a keypoint file from a given filename and returns the list
 * of keypoints. */
-int ReadKeyFile(const char *filename, unsigned char **keys, keypt_t **info)
+int ReadKeyFile(const char *filename, unsigned char **keys, keypt_t **info,
+                int *dim, keydesc_t type)
 {
     FILE *file;
 
@@ -142,13 +251,13 @@ int ReadKeyFile(const char *filename, unsigned char **keys, keypt_t **info)
             printf("Could not open file: %s\n", filename);
             return 0;
         } else {
-            int n = ReadKeysGzip(gzf, keys, info);
+            int n = ReadKeysGzip(gzf, keys, info, dim, type);
             gzclose(gzf);
             return n;
         }
     }
 
-    int n = ReadKeys(file, keys, info);
+    int n = ReadKeys(file, keys, info, dim, type);
     fclose(file);
     return n;
 
@@ -226,12 +335,14 @@ std::vector<Keypoint *> ReadKeysMMAP(FILE *fp)
 /* Read keypoints from the given file pointer and return the list of
 * keypoints.  The file format starts with 2 integers giving the total
 * number of keypoints and the size of descriptor vector for each
-* keypoint (currently assumed to be 128). Then each keypoint is
+* keypoint (128, or 64/32 if dim is passed). Then each keypoint is
 * specified by 4 floating point numbers giving subpixel row and
 * column location, scale, and orientation (in radians from -PI to
 * PI).  Then the descriptor vector for each keypoint is given as a
-* list of integers in range [0,255]. */
-int ReadKeys(FILE *fp, unsigned char **keys, keypt_t **info)
+* list of integers in range [0,255], 20 per line (or values of the
+* given type, see keydesc_t). */
+int ReadKeys(FILE *fp, unsigned char **keys, keypt_t **info, int *dim,
+             keydesc_t type)
 {
     int i, num, len;
 
@@ -244,12 +355,13 @@ int ReadKeys(FILE *fp, unsigned char **keys, keypt_t **info)
         return 0;
     }
 
-    if (len != 128) {
-        printf("Keypoint descriptor length invalid (should be 128).");
+    if (!CheckKeyLength(len, dim)) {
         return 0;
     }
 
-    *keys = new unsigned char[128 * num + 8];
+    int numLines = (len + 19) / 20;
+    int size = KeyDescriptorSize(type);
+    *keys = new unsigned char[len * num * size + 8];
 
     if (info != NULL) 
         *info = new keypt_t[num];
@@ -273,24 +385,10 @@ int ReadKeys(FILE *fp, unsigned char **keys, keypt_t **info)
         }
 
         char buf[1024];
-        for (int line = 0; line < 7; line++) {
+        for (int line = 0; line < numLines; line++) {
             fgets(buf, 1024, fp);
-
-            if (line < 6) {
-                sscanf(buf, 
-                    "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu "
-                    "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu", 
-                    p+0, p+1, p+2, p+3, p+4, p+5, p+6, p+7, p+8, p+9, 
-                    p+10, p+11, p+12, p+13, p+14, 
-                    p+15, p+16, p+17, p+18, p+19);
-
-                p += 20;
-            } else {
-                sscanf(buf, 
-                    "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu",
-                    p+0, p+1, p+2, p+3, p+4, p+5, p+6, p+7);
-                p += 8;
-            }
+            p = ParseKeyLine(buf, p, line < numLines - 1 ? 20 : 
+                             len - 20 * line, type);
         }
     }
 
@@ -353,7 +451,8 @@ int ReadKeysM(FILE *fp, unsigned char **keys, keypt_t **info)
 }
 
 
-int ReadKeysGzip(gzFile fp, unsigned char **keys, keypt_t **info)
+int ReadKeysGzip(gzFile fp, unsigned char **keys, keypt_t **info, 
+                 int *dim, keydesc_t type)
 {
     int i, num, len;
 
@@ -366,12 +465,13 @@ int ReadKeysGzip(gzFile fp, unsigned char **keys, keypt_t **info)
         return 0;
     }
 
-    if (len != 128) {
-        printf("Keypoint descriptor length invalid (should be 128).");
+    if (!CheckKeyLength(len, dim)) {
         return 0;
     }
 
-    *keys = new unsigned char[128 * num + 8];
+    int numLines = (len + 19) / 20;
+    int size = KeyDescriptorSize(type);
+    *keys = new unsigned char[len * num * size + 8];
 
     if (info != NULL) 
         *info = new keypt_t[num];
@@ -396,29 +496,16 @@ int ReadKeysGzip(gzFile fp, unsigned char **keys, keypt_t **info)
             (*info)[i].orient = ori;
         }
 
-        for (int line = 0; line < 7; line++) {
+        for (int line = 0; line < numLines; line++) {
             char *str = gzgets(fp, buf, 1024);
             assert(str != Z_NULL);
 
-            if (line < 6) {
-                sscanf(buf, 
-                    "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu "
-                    "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu", 
-                    p+0, p+1, p+2, p+3, p+4, p+5, p+6, p+7, p+8, p+9, 
-                    p+10, p+11, p+12, p+13, p+14, 
-                    p+15, p+16, p+17, p+18, p+19);
-
-                p += 20;
-            } else {
-                sscanf(buf, 
-                    "%hhu %hhu %hhu %hhu %hhu %hhu %hhu %hhu",
-                    p+0, p+1, p+2, p+3, p+4, p+5, p+6, p+7);
-                p += 8;
-            }
+            p = ParseKeyLine(buf, p, line < numLines - 1 ? 20 : 
+                             len - 20 * line, type);
         }
     }
 
-    assert(p == *keys + 128 * num);
+    assert(p == *keys + len * num * size);
 
     return num; // kps;
 }
@@ -69,13 +69,43 @@ typedef struct {
     float orient;
 } keypt_t;
 
-/* Returns the number of keys in a file */
-int GetNumberOfKeys(const char *filename);
+/* Type of the descriptor values in a key file.  KEY_UINT8 is the
+ * usual SIFT format; KEY_UINT16 and KEY_FLOAT32 hold descriptors that
+ * are not quantized to bytes (e.g. RootSIFT or learned descriptors). */
+enum keydesc_t {
+    KEY_UINT8 = 0,
+    KEY_UINT16,
+    KEY_FLOAT32
+};
+
+/* Returns the size in bytes of one descriptor value */
+int KeyDescriptorSize(keydesc_t type);
+
+/* Parses a descriptor type name (uint8, uint16 or float32) */
+bool ParseKeyDescriptorType(const char *name, keydesc_t *type);
+
+/* Returns the number of keys in a file, and the descriptor length in
+ * *len if given */
+int GetNumberOfKeys(const char *filename, int *len = NULL);
+
+/* Size and modification time of a key file (or of its .gz version),
+ * used to tell whether files derived from it are out of date */
+bool GetKeyFileStamp(const char *filename, long long *size, 
+    long long *mtime);
+
+/* Returns true if descriptors of the given length are supported 
+ * (128, 64 or 32) */
+bool IsSupportedKeyLength(int len);
 
 /* This reads a keypoint file from a given filename and returns the list
- * of keypoints. */
+ * of keypoints.  If dim is given, descriptors of any supported length
+ * are read and their length is returned in *dim, otherwise only 128-D 
+ * descriptors are accepted.  Descriptor values are stored in *keys as
+ * values of the given type, so *keys holds num * len * 
+ * KeyDescriptorSize(type) bytes. */
 int ReadKeyFile(const char *filename, unsigned char **keys, 
-                keypt_t **info = NULL);
+                keypt_t **info = NULL, int *dim = NULL,
+                keydesc_t type = KEY_UINT8);
 
 int ReadKeyPositions(const char *filename, keypt_t **info);
 
@@ -87,8 +117,10 @@ int ReadKeyPositions(const char *filename, keypt_t **info);
  * column location, scale, and orientation (in radians from -PI to
  * PI).  Then the descriptor vector for each keypoint is given as a
  * list of integers in range [0,255]. */
-int ReadKeys(FILE *fp, unsigned char **keys, keypt_t **info = NULL);
-int ReadKeysGzip(gzFile fp, unsigned char **keys, keypt_t **info = NULL);
+int ReadKeys(FILE *fp, unsigned char **keys, keypt_t **info = NULL,
+             int *dim = NULL, keydesc_t type = KEY_UINT8);
+int ReadKeysGzip(gzFile fp, unsigned char **keys, keypt_t **info = NULL,
+                 int *dim = NULL, keydesc_t type = KEY_UINT8);
 int ReadKeyModel(const char *filename, unsigned char **keys, keypt_t **info);
 
 /* Read keys using MMAP to speed things up */
@@ -3,6 +3,17 @@
 #include "keys2a.h"
 #include "Gridder.h"
 #include "Geometric.h"
+#include "PairList.h"
+#include "Checkpoint.h"
+#include "KeyStore.h"
+#include "KeyCache.h"
+#include "Pipeline.h"
+#include "MatchFile.h"
+#include "FMatrixCache.h"
+#include "MatchStats.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "ReplayBundle.h"
 #include "argvparser.h"
 
 #include <time.h>
@@ -31,12 +42,186 @@ void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
       "key matches in format <im1 im2\\n num_matches\\n keyIdx1 keyIdx2\\n...", 
       ArgvParser::OptionRequired);
 
+  cmd.defineOption("match_format", "Layout of matches_file: text or "
+      "binary (see convert_matches), not with checkpoint, resume, "
+      "append_keyfile_list or shard, [Default: text]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("append_keyfile_list", "List of key files of images "
+      "added to an already matched collection (keyfile_list). Only pairs "
+      "with an added image are matched, their matches are appended to "
+      "existing_matches_file and written to matches_file", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("append_dimension_list", "<Height Width> per line of "
+      "the images in append_keyfile_list", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("existing_matches_file", "Match file of the images in "
+      "keyfile_list, used with append_keyfile_list. May be the same as "
+      "matches_file to append in place", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("pair_list", "Filename with path, file stores the "
+      "image pairs to match as <i j> per line, indices as in the keyfile "
+      "list, [Default: all pairs]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("emit_pair_list", "Filename with path, write the pairs "
+      "that would be matched (after probe, if enabled) to this file "
+      "in pair_list format and exit without matching", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("checkpoint", "Record the completed pairs in "
+      "<matches_file>.ckpt so that the run can be resumed, "
+      "[Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("checkpoint_interval", "Seconds between two checkpoints, "
+      "[Default: 60]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("resume", "Continue a checkpointed run that was "
+      "stopped, keeping matches_file up to the last checkpoint, "
+      "[Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("shard", "k/n, match only the k-th (0 to n-1) of n "
+      "shares of the pairs, balanced by the number of features. Combine "
+      "the match files of all shares with merge_matches, "
+      "[Default: 0/1]", ArgvParser::OptionRequiresValue);
+
   cmd.defineOption("topscale_percent", "Percentage of top scale features"
       "to use for initial matching, [Default: 20]", ArgvParser::NoOptionAttribute); 
                    
   cmd.defineOption("twoway_global_match", "use two-way matching for top-scale" 
       "features (stricter, slow), [Default: False]", ArgvParser::NoOptionAttribute);
 
+  cmd.defineOption("progressive_global", "Match top-scale features in order "
+      "of scale and stop as soon as there are enough well distributed "
+      "matches, growing from topscale_percent to topscale_max percent of "
+      "the features in steps of 10 if there are not, [Default: False]", 
+      ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("topscale_max", "Largest percentage of top scale features"
+      " used by progressive_global, [Default: 40]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("progressive_target", "Number of matches after which "
+      "progressive_global stops, [Default: 60]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("probe", "Before the global stage, match a small sample "
+      "of the largest scale features of the pair and skip the pair if the "
+      "sample predicts too few global matches, [Default: False]", 
+      ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("probe_size", "Smallest number of features matched by "
+      "the probe, [Default: 200]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("probe_fraction", "Fraction of the top-scale features "
+      "matched by the probe if that is more than probe_size, [Default: "
+      "0.05]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("probe_budget", "Largest fraction of pairs that pass the "
+      "global stage which the probe may wrongly skip, [Default: 0.02]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("fmatrix_cache", "Filename with path, store the "
+      "fundamental matrix of each pair in this file and reuse the stored "
+      "ones, skipping the global stage, in later runs with the same "
+      "global stage, probe, consistency and budget_ransac_iters options", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("stats_file", "Filename with path, write the time of "
+      "each matching stage and the counters of each pair to this file",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("stats_format", "Layout of stats_file: json (one "
+      "object per line) or csv, [Default: json]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("trace", "Filename with path, write a timeline of the "
+      "pairs and stages matched by each thread to this file, in the "
+      "Chrome trace-event format", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("trace_events", "Number of trace events kept per "
+      "thread, older events are dropped, [Default: 262144]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("perf_counters", "Count cycles, instructions, last "
+      "level cache misses and branch misses of each matching stage with "
+      "perf_event_open; adds them to stats_file and prints the totals, "
+      "[Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("min_candidates", "Pad smaller candidate sets of the "
+      "match stage with random reference features, [Default: 50]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("max_candidates", "Subsample larger candidate sets of "
+      "the match stage, evenly along the epipolar line and over scales, "
+      "[Default: 0, no cap]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("scale_tolerance", "Drop candidates whose scale is off "
+      "by more than this factor from the one predicted by the global "
+      "matches, [Default: 0, off]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("orient_tolerance", "Drop candidates whose orientation "
+      "is off by more than this many degrees from the one predicted by the "
+      "global matches, [Default: 0, off]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("sketch_keep", "Compute the exact descriptor distance "
+      "only for this many candidates per query, those nearest in a 256-bit "
+      "sketch of the descriptors, [Default: 0, all]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("budget_seconds", "Wall-clock seconds of matching "
+      "per pair, [Default: 0, no limit]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("budget_comparisons", "Candidate comparisons of the "
+      "match stage per pair, [Default: 0, no limit]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("budget_ransac_iters", "RANSAC iterations of the F "
+      "estimation per pair, [Default: 0, no limit]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("budget_action", "What to do with a pair that runs "
+      "out of its budget: partial (keep the matches found so far) or "
+      "skip, [Default: partial]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("replay_threshold", "Seconds; write a replay bundle "
+      "(see replay_pair) of every pair that takes at least this long, "
+      "[Default: 0, none]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("replay_dir", "Directory of the replay bundles, "
+      "[Default: .]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("key_store", "Read the keys from a store packed by "
+      "pack_keys from the same keyfile_list (a shared memory object "
+      "/name or a file) instead of the key files", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("huge_pages", "Map the key_store with transparent huge "
+      "pages, [Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("max_memory", "Load keys only when needed and keep at "
+      "most this many MB of keys in memory, matching the pairs in tiles "
+      "that fit. The match file is then not in pair order, see "
+      "merge_matches, [Default: 0, all keys in memory]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("threads", "Number of threads matching pairs; the "
+      "matches are written in the same order as with one thread, "
+      "[Default: 1]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("prefetch_pairs", "With max_memory, load the keys of "
+      "the pairs up to this many pairs ahead of the matching on a "
+      "separate thread, [Default: 0, load when needed]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("tree_cache", "Store the global kd-tree of each image "
+      "next to its key file (<key file>.tree) and reuse it in later runs, "
+      "[Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("descriptor_type", "Type of descriptor values in the key "
+      "files: uint8, uint16 or float32, [Default: uint8]", 
+      ArgvParser::OptionRequiresValue);
+
   /// If instead of arguments, options file is supplied
   /// Parse options file to fill-up a dummy argv struct
   /// Parse the dummy argv struct to get true arguments
@@ -90,6 +275,454 @@ void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
   }
 }
 
+/* The stages of matching the pairs of a match-graph run, see 
+ * RunPairPipeline(). The data of an image comes from the key cache if
+ * there is one, otherwise from the per-image vectors. match() may run 
+ * on several threads at once and only reads the shared state; write()
+ * keeps the output, checkpoint and counters. */
+class GraphMatchStages : public PairStages {
+  public:
+  const vector< ImagePair >* pairs;
+  const vector< char >* pairDone;
+  const vector< int >* widths;
+  const vector< int >* heights;
+
+  KeyCache* keyCache;
+  const vector< unsigned char* >* keys;
+  const vector< keypt_t* >* keysInfo;
+  const vector< int >* numFeatures;
+  vector< Gridder >* grids;
+  const vector< GlobalTree* >* globalTrees;
+  const vector< KeySketch* >* sketches;
+  int descDim;
+  keydesc_t descType;
+
+  int topscale;
+  int treeTopscale;
+  bool twoWayGlobalMatch;
+  bool progressive;
+  int topscaleMax;
+  int progressiveTarget;
+  bool probe;
+  int probeSize;
+  double probeFraction;
+  double probeBudget;
+  bool emitPairs;
+
+  double replayThreshold;
+  string replayDir;
+
+  PairBudget budget;
+  bool skipOverBudget;
+
+  CandidatePolicy candidatePolicy;
+
+  FMatrixCache* fmatrixCache;
+  StatsWriter* statsFile;
+  Tracer* tracer;
+  PerfMonitor* perfMonitor;
+  PairStats statsTotal;
+  MatchWriter* matchFile;
+  MatchCheckpoint* checkpoint;
+  bool checkpointing;
+  long long lastRecordStart;
+  vector< ImagePair > selectedPairs;
+
+  long long numGlobalQueries;
+  int numProbedPairs;
+  int numUnprobedPairs;
+  int numPrunedPairs;
+  int numProbeMisses;
+  int numCachedPairs;
+  int numOverBudget;
+
+  int currRef;
+  double start;
+
+  void prefetch(int p);
+  bool match(int p, PairResult& result);
+  bool write(int p, PairResult& result);
+  void finish();
+  void writeReplay(int i, int j, const vector< double >& fMatrix, 
+      bool hasF, double seconds, int numMatches);
+};
+
+/*! \brief Random seed of match() for source image j and reference
+ ** image i
+ **/
+static unsigned int pairSeed(int i, int j) {
+  return (unsigned int)i*73856093u ^ (unsigned int)j*19349663u;
+}
+
+void GraphMatchStages::prefetch(int p) {
+  TraceSpan span(tracer != NULL ? tracer->getThreadBuffer() : NULL, 
+      "prefetch", p);
+
+  /// A failed load is reported when the pair is matched
+  if(keyCache != NULL) {
+    keyCache->prefetch((*pairs)[p].second);
+    keyCache->prefetch((*pairs)[p].first);
+  }
+}
+
+/*! \brief Matches source image j = pairs[p].first to reference image 
+ ** i = pairs[p].second
+ **/
+bool GraphMatchStages::match(int p, PairResult& result) {
+  result.status = PAIR_SKIPPED;
+  result.probed = false;
+  result.numGlobalQueries = 0;
+  result.matches.clear();
+  result.budgetExceeded = BUDGET_NONE;
+  result.newFMatrix = false;
+  if((*pairDone)[p]) {
+    return true;
+  }
+
+  int i = (*pairs)[p].second;
+  int j = (*pairs)[p].first;
+  double pairStart = WallTime();
+
+  /// Tracing records the stages through the statistics
+  TraceBuffer* trace = tracer != NULL ? tracer->getThreadBuffer() : NULL;
+  TraceSpan span(trace, "pair", p);
+  PerfCounterGroup* perf = perfMonitor != NULL ? 
+    perfMonitor->getThreadGroup() : NULL;
+  PairStats* stats = NULL;
+  StageMark pairMark;
+  if(statsFile != NULL || trace != NULL || perf != NULL) {
+    stats = &result.stats;
+    stats->clear();
+    stats->im1 = j;
+    stats->im2 = i;
+    stats->trace = trace;
+    stats->pair = p;
+    stats->perf = perf;
+    stats->beginPair(&pairMark);
+  }
+
+  match::FeatureMatcher matcher;
+  matcher.setDescriptorType( descType );
+  matcher.setStats( stats );
+  if(keyCache != NULL) {
+    bool loaded = false;
+    {
+      StageTimer timer(stats, STAGE_LOAD);
+      loaded = keyCache->acquirePair(i, j);
+    }
+    if(!loaded) {
+      return false;
+    }
+    matcher.setDescriptorDim( keyCache->getDescriptorDim() );
+    matcher.setNumSrcPoints( keyCache->getNumKeys(j) );
+    matcher.setSrcKeys( keyCache->getKeysInfo(j), keyCache->getKeys(j) );
+    matcher.setNumRefPoints( keyCache->getNumKeys(i) );
+    matcher.setRefKeys( keyCache->getKeysInfo(i), keyCache->getKeys(i) );
+    matcher.setQueryGrid(keyCache->getGrid(j));
+    matcher.setRefGrid(keyCache->getGrid(i));
+    matcher.setSrcGlobalTree(keyCache->getGlobalTree(j));
+    matcher.setRefGlobalTree(keyCache->getGlobalTree(i));
+    matcher.setSketches(keyCache->getSketch(j), keyCache->getSketch(i));
+  } else {
+    matcher.setDescriptorDim( descDim );
+    matcher.setNumSrcPoints( (*numFeatures)[j] );
+    matcher.setSrcKeys( (*keysInfo)[j], (*keys)[j] );
+    matcher.setNumRefPoints( (*numFeatures)[i] );
+    matcher.setRefKeys( (*keysInfo)[i], (*keys)[i] );
+    matcher.setQueryGrid(&(*grids)[j]);
+    matcher.setRefGrid(&(*grids)[i]);
+    matcher.setSrcGlobalTree((*globalTrees)[j]);
+    matcher.setRefGlobalTree((*globalTrees)[i]);
+    matcher.setSketches((*sketches)[j], (*sketches)[i]);
+  }
+  int numSrcFeatures = keyCache != NULL ? keyCache->getNumKeys(j) : 
+    (*numFeatures)[j];
+
+  vector< vector<double> > srcRectEdges; 
+  vector< vector<double> > refRectEdges; 
+  geometry::ComputeRectangleEdges((double)(*widths)[j],
+      (double)(*heights)[j], srcRectEdges);
+  geometry::ComputeRectangleEdges((double)(*widths)[i], 
+      (double)(*heights)[i], refRectEdges);
+
+  matcher.setImageDims((*widths)[j], (*heights)[j], (*widths)[i], 
+      (*heights)[i]);
+  matcher.setSrcRectEdges(srcRectEdges);
+  matcher.setRefRectEdges(refRectEdges);
+  matcher.setBudget(budget, WallTime());
+  matcher.setCandidatePolicy(candidatePolicy);
+
+  /// Skip the pair if a few of the largest features predict
+  /// that it will fail the global stage
+  result.status = PAIR_MATCHED;
+  if(probe) {
+    int numTopSrc = (int)(numSrcFeatures*treeTopscale/100);
+    int numProbe = probeSampleSize(numTopSrc, probeSize, probeFraction, 16,
+        probeBudget);
+    int minProbe = probeRejectThreshold(numProbe, numTopSrc, 16,
+        probeBudget);
+    if(minProbe > 0) {
+      result.probed = true;
+      if(matcher.probeMatch(treeTopscale, numProbe) < minProbe) {
+        result.status = PAIR_PRUNED;
+      }
+    }
+  }
+
+  if(result.status == PAIR_MATCHED && emitPairs) {
+    result.status = PAIR_SELECTED;
+  }
+
+  /// A cached pair skips the global stage and F estimation
+  const FMatrixEntry* cached = NULL;
+  if(result.status == PAIR_MATCHED && fmatrixCache != NULL) {
+    cached = fmatrixCache->find((*pairs)[p]);
+  }
+
+  vector< double > fMatrix(9);
+  if(cached != NULL) {
+    fMatrix.assign(cached->F, cached->F + 9);
+    if(cached->numGlobalMatches < 16) {
+      result.status = PAIR_NO_GLOBAL;
+    }
+  } else if(result.status == PAIR_MATCHED) {
+    if(progressive) {
+      matcher.globalMatchProgressive(topscale, topscaleMax, 
+          progressiveTarget, twoWayGlobalMatch);
+    } else {
+      matcher.globalMatch(topscale, twoWayGlobalMatch);
+    }
+    result.numGlobalQueries = matcher.getNumGlobalQueries();
+
+    result.newFMatrix = true;
+    result.fEntry.numGlobalMatches = matcher.matches.size();
+    result.fEntry.numInliers = 0;
+    if(matcher.matches.size() < 16) {
+      result.status = PAIR_NO_GLOBAL;
+    } else {
+      matcher.computeFmatrix(fMatrix.data());
+      result.fEntry.numInliers = matcher.matches.size();
+    }
+    copy(fMatrix.begin(), fMatrix.end(), result.fEntry.F);
+
+    /// An F cut short by the budget is not cached
+    if(matcher.getBudgetExceeded() != BUDGET_NONE) {
+      result.newFMatrix = false;
+    }
+  }
+
+  if(result.status == PAIR_MATCHED) {
+    matcher.setFMatrix( fMatrix );
+
+    matcher.computeEpipolarLines();
+    matcher.clusterPoints();
+
+    /// match() pads short candidate lists with random points; seed
+    /// it per pair so that a pair gets the same matches however the
+    /// pairs are split into shards, threads, resumed or appended
+    matcher.setRandomSeed(pairSeed(i, j));
+    matcher.match();
+    sort(matcher.matches.begin(), matcher.matches.end());
+    result.matches.swap(matcher.matches);
+  }
+
+  /// A pair over budget keeps what it found or is dropped
+  result.budgetExceeded = matcher.getBudgetExceeded();
+  if(result.budgetExceeded != BUDGET_NONE) {
+    if(skipOverBudget) {
+      result.status = PAIR_OVER_BUDGET;
+      result.matches.clear();
+    } else if(result.status == PAIR_MATCHED && (result.budgetExceeded & 
+          (BUDGET_TIME | BUDGET_COMPARISONS)) != 0) {
+      result.status = PAIR_PARTIAL;
+    }
+  }
+  if(stats != NULL) {
+    stats->budget = result.budgetExceeded;
+  }
+
+  /// Keep a copy of a slow pair while its keys are loaded
+  double seconds = WallTime() - pairStart;
+  if(replayThreshold > 0 && seconds >= replayThreshold) {
+    writeReplay(i, j, fMatrix, result.status == PAIR_MATCHED || 
+        result.status == PAIR_PARTIAL, seconds,
+        result.matches.size());
+  }
+
+  if(keyCache != NULL) {
+    keyCache->releasePair(i, j);
+  }
+  if(stats != NULL) {
+    stats->endPair(pairMark);
+  }
+  return true;
+}
+
+/*! \brief Writes the replay bundle of source image j and reference
+ ** image i to replayDir/pair_<j>_<i>.replay
+ **/
+void GraphMatchStages::writeReplay(int i, int j, 
+    const vector< double >& fMatrix, bool hasF, double seconds, 
+    int numMatches) {
+  ReplayBundle bundle;
+  bundle.im1 = j;
+  bundle.im2 = i;
+  bundle.type = descType;
+  if(keyCache != NULL) {
+    bundle.dim = keyCache->getDescriptorDim();
+    bundle.numSrc = keyCache->getNumKeys(j);
+    bundle.srcKeys = keyCache->getKeys(j);
+    bundle.srcInfo = keyCache->getKeysInfo(j);
+    bundle.numRef = keyCache->getNumKeys(i);
+    bundle.refKeys = keyCache->getKeys(i);
+    bundle.refInfo = keyCache->getKeysInfo(i);
+  } else {
+    bundle.dim = descDim;
+    bundle.numSrc = (*numFeatures)[j];
+    bundle.srcKeys = (*keys)[j];
+    bundle.srcInfo = (*keysInfo)[j];
+    bundle.numRef = (*numFeatures)[i];
+    bundle.refKeys = (*keys)[i];
+    bundle.refInfo = (*keysInfo)[i];
+  }
+  bundle.srcWidth = (*widths)[j];
+  bundle.srcHeight = (*heights)[j];
+  bundle.refWidth = (*widths)[i];
+  bundle.refHeight = (*heights)[i];
+
+  bundle.params.topscale = topscale;
+  bundle.params.treeTopscale = treeTopscale;
+  bundle.params.twoway = twoWayGlobalMatch ? 1 : 0;
+  bundle.params.progressive = progressive ? 1 : 0;
+  bundle.params.topscaleMax = topscaleMax;
+  bundle.params.progressiveTarget = progressiveTarget;
+  bundle.params.probe = probe ? 1 : 0;
+  bundle.params.probeSize = probeSize;
+  bundle.params.probeFraction = probeFraction;
+  bundle.params.probeBudget = probeBudget;
+  bundle.params.seed = pairSeed(i, j);
+  bundle.params.minCandidates = candidatePolicy.minCandidates;
+  bundle.params.maxCandidates = candidatePolicy.maxCandidates;
+  bundle.params.scaleTolerance = candidatePolicy.scaleTolerance;
+  bundle.params.orientTolerance = candidatePolicy.orientTolerance;
+  bundle.params.sketchKeep = candidatePolicy.sketchKeep;
+
+  bundle.hasF = hasF;
+  copy(fMatrix.begin(), fMatrix.end(), bundle.F);
+  bundle.seconds = seconds;
+  bundle.numMatches = numMatches;
+
+  char name[64];
+  sprintf(name, "/pair_%d_%d.replay", j, i);
+  string fileName = replayDir + name;
+  if(bundle.write(fileName.c_str())) {
+    printf("[KeyMatchGeoAware] Pair %d-%d took %0.3fs, wrote %s\n", j, i,
+        seconds, fileName.c_str());
+  }
+}
+
+/*! \brief Name of a pair status in the statistics file
+ **/
+static const char* pairStatusName(pairstatus_t status) {
+  switch(status) {
+    case PAIR_PRUNED:    return "pruned";
+    case PAIR_SELECTED:  return "selected";
+    case PAIR_NO_GLOBAL: return "no_global";
+    case PAIR_PARTIAL:   return "partial";
+    case PAIR_OVER_BUDGET: return "over_budget";
+    default:             return "matched";
+  }
+}
+
+/*! \brief Writes the matches of pair p and records it as done
+ **/
+bool GraphMatchStages::write(int p, PairResult& result) {
+  int i = (*pairs)[p].second;
+  int j = (*pairs)[p].first;
+  TraceSpan span(tracer != NULL ? tracer->getThreadBuffer() : NULL, 
+      "write", p);
+
+  if(i != currRef) {
+    finish();
+    currRef = i;
+    printf("[KeyMatchGeoAware] Matching to image %d\n", i);
+    start = WallTime();
+  }
+
+  if(result.status == PAIR_SKIPPED) {
+    return true;
+  }
+  if(statsFile != NULL) {
+    statsFile->write(result.stats, pairStatusName(result.status),
+        result.matches.size());
+  }
+  if(statsFile != NULL || perfMonitor != NULL) {
+    statsTotal.add(result.stats);
+  }
+  if(checkpointing && checkpoint->isDue() && 
+      !checkpoint->commit(lastRecordStart, *matchFile)) {
+    return false;
+  }
+
+  numGlobalQueries += result.numGlobalQueries;
+  if(result.probed) {
+    numProbedPairs++;
+  } else if(probe) {
+    /// Too few top-scale features for a sample that can reject a pair
+    if(numUnprobedPairs == 0) {
+      printf("[KeyMatchGeoAware] Warning: the probe cannot reject pair "
+          "%d-%d within probe_budget, it has too few top-scale features; "
+          "such pairs go to the global stage\n", j, i);
+    }
+    numUnprobedPairs++;
+  }
+  if(fmatrixCache != NULL && result.newFMatrix) {
+    fmatrixCache->add((*pairs)[p], result.fEntry);
+  } else if(fmatrixCache != NULL && (result.status == PAIR_MATCHED || 
+        result.status == PAIR_PARTIAL || result.status == PAIR_NO_GLOBAL)) {
+    numCachedPairs++;
+  }
+
+  if(result.status == PAIR_PRUNED) {
+    numPrunedPairs++;
+  } else if(result.status == PAIR_SELECTED) {
+    selectedPairs.push_back((*pairs)[p]);
+    return true;
+  } else if(result.status == PAIR_NO_GLOBAL && result.probed) {
+    numProbeMisses++;
+  }
+
+  int numMatches = result.matches.size();
+  if(result.budgetExceeded != BUDGET_NONE) {
+    numOverBudget++;
+    printf("[KeyMatchGeoAware] Pair %d-%d ran out of its %s budget, %s\n",
+        j, i, BudgetFlagNames(result.budgetExceeded).c_str(), 
+        result.status == PAIR_OVER_BUDGET ? "skipped" : "kept its matches");
+  }
+  if((result.status == PAIR_MATCHED || result.status == PAIR_PARTIAL) && 
+      numMatches >= 16) {
+    printf("Writing %d matches between images %d and %d\n", numMatches, j, i);
+    lastRecordStart = matchFile->tell();
+    matchFile->writeRecord(j, i, result.matches);
+  }
+
+  if(checkpointing) {
+    checkpoint->addPair((*pairs)[p]);
+  }
+  return true;
+}
+
+/*! \brief Reports the time taken by the pairs of the current reference
+ ** image
+ **/
+void GraphMatchStages::finish() {
+  if(currRef >= 0) {
+    printf("[KeyMatchGeoAware] Matching took %0.3fs\n", 
+        WallTime() - start);
+    fflush(stdout);
+  }
+}
+
 int main(int argc, char* argv[]) {
 
   ArgvParser cmd;
@@ -99,6 +732,76 @@ int main(int argc, char* argv[]) {
   string dimList = cmd.optionValue("image_dimension_list");
   string matchFileName = cmd.optionValue("matches_file");
 
+  matchformat_t matchFormat = MATCH_TEXT;
+  if(cmd.foundOption("match_format")) {
+    string str = cmd.optionValue("match_format");
+    if(!ParseMatchFormat(str.c_str(), &matchFormat)) {
+      printf("\nUnknown match format %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  string appendKeyList = "";
+  string appendDimList = "";
+  string existingMatchFileName = "";
+  bool appending = false;
+  if(cmd.foundOption("append_keyfile_list")) {
+    if(!cmd.foundOption("append_dimension_list") || 
+        !cmd.foundOption("existing_matches_file")) {
+      printf("\nappend_keyfile_list needs append_dimension_list and "
+          "existing_matches_file\n");
+      return -1;
+    }
+    appendKeyList = cmd.optionValue("append_keyfile_list");
+    appendDimList = cmd.optionValue("append_dimension_list");
+    existingMatchFileName = cmd.optionValue("existing_matches_file");
+    appending = true;
+  }
+
+  string pairListName = "";
+  if(cmd.foundOption("pair_list")) {
+    pairListName = cmd.optionValue("pair_list");
+  }
+
+  string emitPairListName = "";
+  if(cmd.foundOption("emit_pair_list")) {
+    emitPairListName = cmd.optionValue("emit_pair_list");
+  }
+
+  bool resume = false;
+  if(cmd.foundOption("resume")) {
+    resume = true;
+  }
+
+  bool checkpointing = resume;
+  if(cmd.foundOption("checkpoint")) {
+    checkpointing = true;
+  }
+
+  int checkpointInterval = DEFAULT_CHECKPOINT_INTERVAL;
+  if(cmd.foundOption("checkpoint_interval")) {
+    string str = cmd.optionValue("checkpoint_interval");
+    checkpointInterval = atoi(str.c_str());
+  }
+
+  int shard = 0;
+  int numShards = 1;
+  if(cmd.foundOption("shard")) {
+    string str = cmd.optionValue("shard");
+    if(!parseShard(str.c_str(), &shard, &numShards)) {
+      printf("\nBad shard %s, expected k/n with 0 <= k < n\n", str.c_str());
+      return -1;
+    }
+  }
+
+  /// Checkpoints, appending and merge_matches work on the text records
+  if(matchFormat == MATCH_BINARY && (checkpointing || appending || 
+        numShards > 1)) {
+    printf("\nThe binary match format does not support checkpoint, "
+        "resume, appending or shard\n");
+    return -1;
+  }
+
   int topscale = 20;
   if(cmd.foundOption("topscale_percent")) {
   
@@ -111,7 +814,205 @@ int main(int argc, char* argv[]) {
     twoWayGlobalMatch = true;
   }
 
-  clock_t start = clock();
+  bool progressive = false;
+  if(cmd.foundOption("progressive_global")) {
+    progressive = true;
+  }
+
+  int topscaleMax = 40;
+  if(cmd.foundOption("topscale_max")) {
+    string str = cmd.optionValue("topscale_max");
+    topscaleMax = atoi(str.c_str());
+  }
+
+  int progressiveTarget = DEFAULT_PROGRESSIVE_TARGET;
+  if(cmd.foundOption("progressive_target")) {
+    string str = cmd.optionValue("progressive_target");
+    progressiveTarget = atoi(str.c_str());
+  }
+
+  bool probe = false;
+  if(cmd.foundOption("probe")) {
+    probe = true;
+  }
+
+  int probeSize = DEFAULT_PROBE_SIZE;
+  if(cmd.foundOption("probe_size")) {
+    string str = cmd.optionValue("probe_size");
+    probeSize = atoi(str.c_str());
+  }
+
+  double probeFraction = DEFAULT_PROBE_FRACTION;
+  if(cmd.foundOption("probe_fraction")) {
+    string str = cmd.optionValue("probe_fraction");
+    probeFraction = atof(str.c_str());
+  }
+
+  double probeBudget = DEFAULT_PROBE_BUDGET;
+  if(cmd.foundOption("probe_budget")) {
+    string str = cmd.optionValue("probe_budget");
+    probeBudget = atof(str.c_str());
+  }
+
+  /// Percentage of top scale features indexed by the global trees
+  int treeTopscale = progressive ? topscaleMax : topscale;
+
+  bool useTreeCache = false;
+  if(cmd.foundOption("tree_cache")) {
+    useTreeCache = true;
+  }
+
+  string fmatrixCacheName = "";
+  if(cmd.foundOption("fmatrix_cache")) {
+    fmatrixCacheName = cmd.optionValue("fmatrix_cache");
+  }
+
+  string statsFileName = "";
+  if(cmd.foundOption("stats_file")) {
+    statsFileName = cmd.optionValue("stats_file");
+  }
+
+  statsformat_t statsFormat = STATS_JSON;
+  if(cmd.foundOption("stats_format")) {
+    string str = cmd.optionValue("stats_format");
+    if(!ParseStatsFormat(str.c_str(), &statsFormat)) {
+      printf("\nUnknown statistics format %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  string traceName = "";
+  if(cmd.foundOption("trace")) {
+    traceName = cmd.optionValue("trace");
+  }
+
+  int traceEvents = DEFAULT_TRACE_EVENTS;
+  if(cmd.foundOption("trace_events")) {
+    string str = cmd.optionValue("trace_events");
+    traceEvents = atoi(str.c_str());
+    traceEvents = traceEvents > 1 ? traceEvents : 1;
+  }
+
+  bool perfCounters = false;
+  if(cmd.foundOption("perf_counters")) {
+    perfCounters = true;
+  }
+
+  double replayThreshold = 0;
+  if(cmd.foundOption("replay_threshold")) {
+    string str = cmd.optionValue("replay_threshold");
+    replayThreshold = atof(str.c_str());
+  }
+
+  string replayDir = ".";
+  if(cmd.foundOption("replay_dir")) {
+    replayDir = cmd.optionValue("replay_dir");
+  }
+
+  CandidatePolicy candidatePolicy;
+  if(cmd.foundOption("min_candidates")) {
+    string str = cmd.optionValue("min_candidates");
+    candidatePolicy.minCandidates = atoi(str.c_str());
+    if(candidatePolicy.minCandidates < 2) {
+      printf("\nmin_candidates must be at least 2\n");
+      return -1;
+    }
+  }
+  if(cmd.foundOption("max_candidates")) {
+    string str = cmd.optionValue("max_candidates");
+    candidatePolicy.maxCandidates = atoi(str.c_str());
+  }
+  if(candidatePolicy.maxCandidates < 0 || (candidatePolicy.maxCandidates > 0
+        && candidatePolicy.maxCandidates < candidatePolicy.minCandidates)) {
+    printf("\nmax_candidates must be 0 or at least min_candidates\n");
+    return -1;
+  }
+  if(cmd.foundOption("scale_tolerance")) {
+    string str = cmd.optionValue("scale_tolerance");
+    candidatePolicy.scaleTolerance = atof(str.c_str());
+    if(candidatePolicy.scaleTolerance > 0 && 
+        candidatePolicy.scaleTolerance <= 1) {
+      printf("\nscale_tolerance must be 0 or larger than 1\n");
+      return -1;
+    }
+  }
+  if(cmd.foundOption("orient_tolerance")) {
+    string str = cmd.optionValue("orient_tolerance");
+    candidatePolicy.orientTolerance = atof(str.c_str())*M_PI/180.0;
+  }
+  if(cmd.foundOption("sketch_keep")) {
+    string str = cmd.optionValue("sketch_keep");
+    candidatePolicy.sketchKeep = atoi(str.c_str());
+    if(candidatePolicy.sketchKeep != 0 && candidatePolicy.sketchKeep < 2) {
+      printf("\nsketch_keep must be 0 or at least 2\n");
+      return -1;
+    }
+  }
+
+  PairBudget budget;
+  if(cmd.foundOption("budget_seconds")) {
+    string str = cmd.optionValue("budget_seconds");
+    budget.maxSeconds = atof(str.c_str());
+  }
+  if(cmd.foundOption("budget_comparisons")) {
+    string str = cmd.optionValue("budget_comparisons");
+    budget.maxComparisons = atoll(str.c_str());
+  }
+  if(cmd.foundOption("budget_ransac_iters")) {
+    string str = cmd.optionValue("budget_ransac_iters");
+    budget.maxRansacIters = atoi(str.c_str());
+  }
+
+  bool skipOverBudget = false;
+  if(cmd.foundOption("budget_action")) {
+    string str = cmd.optionValue("budget_action");
+    if(str == "skip") {
+      skipOverBudget = true;
+    } else if(str != "partial") {
+      printf("\nUnknown budget action %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  string keyStoreName = "";
+  if(cmd.foundOption("key_store")) {
+    keyStoreName = cmd.optionValue("key_store");
+  }
+
+  bool hugePages = false;
+  if(cmd.foundOption("huge_pages")) {
+    hugePages = true;
+  }
+
+  int numThreads = 1;
+  if(cmd.foundOption("threads")) {
+    string str = cmd.optionValue("threads");
+    numThreads = atoi(str.c_str());
+    numThreads = numThreads > 1 ? numThreads : 1;
+  }
+
+  int prefetchPairs = 0;
+  if(cmd.foundOption("prefetch_pairs")) {
+    string str = cmd.optionValue("prefetch_pairs");
+    prefetchPairs = atoi(str.c_str());
+  }
+
+  long long maxMemory = 0;
+  if(cmd.foundOption("max_memory")) {
+    string str = cmd.optionValue("max_memory");
+    maxMemory = atoll(str.c_str())*1024*1024;
+  }
+
+  keydesc_t descType = KEY_UINT8;
+  if(cmd.foundOption("descriptor_type")) {
+    string str = cmd.optionValue("descriptor_type");
+    if(!ParseKeyDescriptorType(str.c_str(), &descType)) {
+      printf("\nUnknown descriptor type %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  double start = WallTime();
   ifstream keyFile(keyList.c_str());
   ifstream dimFile(dimList.c_str());
 
@@ -126,108 +1027,443 @@ int main(int argc, char* argv[]) {
     keyFileNames.push_back(line);
   }
 
+  /// In append mode the added images follow the existing ones,
+  /// so the existing image indices stay valid
+  int numOldKeys = keyFileNames.size();
+  ifstream appendKeyFile;
+  ifstream appendDimFile;
+  if(appending) {
+    appendKeyFile.open(appendKeyList.c_str());
+    appendDimFile.open(appendDimList.c_str());
+    if(!appendKeyFile.is_open() || !appendDimFile.is_open()) {
+      cout << "\nError Opening File";
+      return -1;
+    }
+    while(getline(appendKeyFile, line)) {
+      keyFileNames.push_back(line);
+    }
+  }
+
   int numKeys = keyFileNames.size();
 
+  /// The store must hold the key files of the list, in the same order
+  KeyStore keyStore;
+  bool useKeyStore = !keyStoreName.empty();
+  if(useKeyStore) {
+    if(!keyStore.open(keyStoreName.c_str(), hugePages)) {
+      return -1;
+    }
+    if(keyStore.getDescriptorType() != descType) {
+      printf("\nKey store %s has a different descriptor type\n",
+          keyStoreName.c_str());
+      return -1;
+    }
+    if(keyStore.getNumImages() != numKeys) {
+      printf("\nKey store %s has %d images, the key lists have %d\n",
+          keyStoreName.c_str(), keyStore.getNumImages(), numKeys);
+      return -1;
+    }
+    for(int i=0; i < numKeys; i++) {
+      if(keyFileNames[i] != keyStore.getKeyFileName(i)) {
+        printf("\nKey store %s has %s for image %d instead of %s\n",
+            keyStoreName.c_str(), keyStore.getKeyFileName(i), i,
+            keyFileNames[i].c_str());
+        return -1;
+      }
+    }
+  }
+
   vector< int > widths( numKeys );
   vector< int > heights( numKeys );
 
-  for(int i=0; i < keyFileNames.size(); i++) {
+  for(int i=0; i < numOldKeys; i++) {
     dimFile >> heights[i] >> widths[i];
   } 
+  for(int i=numOldKeys; i < numKeys; i++) {
+    appendDimFile >> heights[i] >> widths[i];
+  } 
 
-  vector< unsigned char* > keys(numKeys);
-  vector< keypt_t* > keysInfo(numKeys);
-  vector< int > numFeatures(numKeys);
-  vector< Gridder > grids;
-
-  for(int i=0; i < keyFileNames.size(); i++) {
-    numFeatures[i] = ReadKeyFile(keyFileNames[i].c_str(),
-        &keys[i], &keysInfo[i]);
+  /// Pairs to match, grouped by reference image. The pairs of
+  /// reference image i are pairs[pairStart[i]] to pairs[pairStart[i+1]-1]
+  vector< ImagePair > pairs;
+  if(pairListName.empty()) {
+    allImagePairs(numKeys, pairs);
+  } else if(!readPairList(pairListName.c_str(), numKeys, pairs)) {
+    return -1;
+  }
+  if(appending) {
+    keepNewImagePairs(numOldKeys, pairs);
+  }
 
-    Gridder currGrid(16, widths[i], heights[i], numFeatures[i], keysInfo[i]);
-    grids.push_back(currGrid);
+  /// Keep the share of this process, balanced by the estimated cost 
+  /// of the pairs. Only the key file headers are needed for this.
+  if(numShards > 1) {
+    vector< int > numKeysInFile(numKeys);
+    for(int i=0; i < numKeys; i++) {
+      numKeysInFile[i] = useKeyStore ? keyStore.getNumKeys(i) : 
+        GetNumberOfKeys(keyFileNames[i].c_str());
+    }
+    int numAllPairs = pairs.size();
+    shardImagePairs(numKeysInFile, shard, numShards, pairs);
+    printf("[KeyMatchGeoAware] Shard %d/%d has %d of %d pairs\n", 
+        shard, numShards, (int)pairs.size(), numAllPairs);
   }
 
-  ofstream matchFile( matchFileName.c_str(), std::ofstream::out);
-  if(!matchFile.is_open()) {
-    cout << "\nError opening match file";
+  /// Images without pairs (outside the pair list or shard) 
+  /// are not read
+  vector< bool > imageUsed(numKeys, false);
+  for(int p=0; p < (int)pairs.size(); p++) {
+    imageUsed[pairs[p].first] = true;
+    imageUsed[pairs[p].second] = true;
   }
-  clock_t end = clock();    
-  printf("[KeyMatchGeoAware] Reading keys took %0.3fs\n", 
-      (end - start) / ((double) CLOCKS_PER_SEC));
 
+  /// With bounded memory, keys are loaded when a pair needs them and
+  /// the pairs are matched in tiles of images whose keys fit twice
+  KeyCache* keyCache = NULL;
+  if(maxMemory > 0 && useKeyStore) {
+    printf("[KeyMatchGeoAware] Keys are mapped from the key store, "
+        "ignoring max_memory\n");
+  } else if(maxMemory > 0) {
+    long long keyBytes = 0;
+    int numUsed = 0;
+    for(int i=0; i < numKeys; i++) {
+      if(imageUsed[i]) {
+        int len = 0;
+        int num = GetNumberOfKeys(keyFileNames[i].c_str(), &len);
+        keyBytes += (long long)num*(len*KeyDescriptorSize(descType) + 
+            sizeof(keypt_t));
+        numUsed++;
+      }
+    }
+    long long imageBytes = numUsed > 0 ? keyBytes/numUsed : 1;
+    int tileSize = (int)(maxMemory/(2*(imageBytes > 0 ? imageBytes : 1)));
+    tileSize = tileSize > 1 ? tileSize : 1;
+    tileImagePairs(tileSize, pairs);
+    printf("[KeyMatchGeoAware] Matching in tiles of %d images\n", tileSize);
 
-  for(int i=0; i < keyFileNames.size(); i++) {
-    vector< vector<double> > refRectEdges; 
-    geometry::ComputeRectangleEdges((double)widths[i], 
-        (double)heights[i], refRectEdges);
+    keyCache = new KeyCache(keyFileNames, widths, heights, descType, 
+        treeTopscale, useTreeCache, candidatePolicy.sketchKeep > 0, 
+        maxMemory);
+  }
 
-    printf("[KeyMatchGeoAware] Matching to image %d\n", i);
+  /// Without the probe, the selected pairs are known already
+  bool emitPairs = !emitPairListName.empty();
+  if(emitPairs && !probe) {
+    if(!writePairList(emitPairListName.c_str(), pairs)) {
+      return -1;
+    }
+    printf("[KeyMatchGeoAware] Wrote %d pairs to %s\n", 
+        (int)pairs.size(), emitPairListName.c_str());
+    return 0;
+  }
+  vector< unsigned char* > keys(numKeys, (unsigned char*)NULL);
+  vector< keypt_t* > keysInfo(numKeys, (keypt_t*)NULL);
+  vector< int > numFeatures(numKeys, 0);
+  vector< Gridder > grids(numKeys);
 
-    start = clock();
+  /// All key files must have descriptors of the same length
+  int descDim = 0;
 
-    for(int j=0; j < i; j++) {
-      vector< vector<double> > srcRectEdges; 
-      geometry::ComputeRectangleEdges((double)widths[j],
-          (double)heights[j], srcRectEdges);
+  for(int i=0; i < (int)keyFileNames.size() && keyCache == NULL; i++) {
+    int dim = 0;
+    if(imageUsed[i] && useKeyStore) {
+      /// The mapping is read-only; matching never writes the keys
+      numFeatures[i] = keyStore.getNumKeys(i);
+      keys[i] = (unsigned char*)keyStore.getKeys(i);
+      keysInfo[i] = (keypt_t*)keyStore.getKeysInfo(i);
+      dim = keyStore.getDescriptorDim();
+    } else if(imageUsed[i]) {
+      numFeatures[i] = ReadKeyFile(keyFileNames[i].c_str(),
+          &keys[i], &keysInfo[i], &dim, descType);
+    }
 
-      match::FeatureMatcher matcher;
+    if(numFeatures[i] > 0) {
+      if(descDim == 0) {
+        descDim = dim;
+      } else if(dim != descDim) {
+        printf("\nDescriptor length %d of %s does not match %d\n", 
+            dim, keyFileNames[i].c_str(), descDim);
+        return -1;
+      }
+    }
 
-      matcher.setNumSrcPoints( numFeatures[j] );
-      matcher.setSrcKeys( keysInfo[j], keys[j] );
+    grids[i].initialize(16, widths[i], heights[i], numFeatures[i], 
+        keysInfo[i]);
+  }
 
-      matcher.setNumRefPoints( numFeatures[i] );
-      matcher.setRefKeys( keysInfo[i], keys[i] );
+  /// On resume, the match file is cut to the last checkpoint
+  /// and the new matches are appended
+  MatchCheckpoint checkpoint;
+  long long lastRecordStart = -1;
+  if(checkpointing && !emitPairs) {
+    if(!checkpoint.open(matchFileName.c_str(), resume, 
+          checkpointInterval)) {
+      return -1;
+    }
+    lastRecordStart = checkpoint.getLastRecordStart();
+    if(resume) {
+      printf("[KeyMatchGeoAware] Resuming after %d completed pairs\n", 
+          checkpoint.getNumDone());
+    }
+  } else {
+    checkpointing = false;
+  }
 
-      matcher.setImageDims(widths[j], heights[j], widths[i], heights[i]);
+  /// Appending in place keeps the existing matches file as it is
+  bool appendInPlace = appending && 
+    existingMatchFileName == matchFileName;
 
-      matcher.setSrcRectEdges(srcRectEdges);
-      matcher.setRefRectEdges(refRectEdges);
+  MatchWriter matchFile;
+  if(!emitPairs) {
+    if(!matchFile.open(matchFileName.c_str(), matchFormat, 
+          resume || appendInPlace)) {
+      return -1;
+    }
 
-      matcher.setQueryGrid(&grids[j]);
-      matcher.setRefGrid(&grids[i]);
+    /// Pairs with an added image come after all pairs of existing
+    /// images in a full run, so the merged file starts with the
+    /// existing matches
+    if(appending && !appendInPlace && !resume) {
+      ifstream existingMatchFile(existingMatchFileName.c_str(), 
+          std::ifstream::binary);
+      if(!existingMatchFile.is_open()) {
+        cout << "\nError opening existing match file";
+        return -1;
+      }
+      vector< char > buf(1 << 20);
+      while(existingMatchFile.read(buf.data(), buf.size()) || 
+          existingMatchFile.gcount() > 0) {
+        matchFile.writeRaw(buf.data(), existingMatchFile.gcount());
+      }
+    }
+    if(appending && checkpointing && !resume && 
+        !checkpoint.commit(lastRecordStart, matchFile)) {
+      return -1;
+    }
+  }
+  printf("[KeyMatchGeoAware] Reading keys took %0.3fs\n", 
+      WallTime() - start);
 
-      matcher.globalMatch(topscale, twoWayGlobalMatch);
-      if(matcher.matches.size() < 16) {
-        continue;
+  /// Build (or load) the global kd-tree of the top-scale features of
+  /// each image once; it is shared by all pairs of the image
+  start = WallTime();
+  vector< GlobalTree* > globalTrees(numKeys, (GlobalTree*)NULL);
+  int numLoadedTrees = 0;
+  for(int i=0; i < numKeys && keyCache == NULL; i++) {
+    if(!imageUsed[i]) {
+      globalTrees[i] = NULL;
+      continue;
+    }
+    int numTopPts = (int)(numFeatures[i]*treeTopscale/100);
+    globalTrees[i] = new GlobalTree();
+    globalTrees[i]->init(keys[i], numTopPts, descDim, descType,
+        keyFileNames[i].c_str(), useTreeCache);
+    if(globalTrees[i]->isLoaded()) {
+      numLoadedTrees++;
+    }
+  }
+  printf("[KeyMatchGeoAware] Global trees (%d from cache) took %0.3fs\n", 
+      numLoadedTrees, WallTime() - start);
+
+  /// Sketches of all features, for ranking the candidates
+  vector< KeySketch* > sketches(numKeys, (KeySketch*)NULL);
+  if(candidatePolicy.sketchKeep > 0 && keyCache == NULL) {
+    start = WallTime();
+    for(int i=0; i < numKeys; i++) {
+      if(imageUsed[i]) {
+        sketches[i] = new KeySketch();
+        sketches[i]->init(keys[i], numFeatures[i], descDim, descType);
       }
-      vector< double > fMatrix(9);
-      matcher.computeFmatrix(fMatrix.data());
-      matcher.setFMatrix( fMatrix );
+    }
+    printf("[KeyMatchGeoAware] Sketches took %0.3fs\n", WallTime() - start);
+  }
 
-      matcher.computeEpipolarLines();
-      matcher.clusterPoints();
 
-      int numMatches = matcher.match();
+  /// F depends on the key files, the options of the global stage and
+  /// the RANSAC budget, which picks the estimator; the probe decides 
+  /// which pairs get an F and the consistency settings which of them
+  /// are matched with the key filter
+  FMatrixCache fmatrixCache;
+  bool useFMatrixCache = !fmatrixCacheName.empty() && !emitPairs;
+  if(useFMatrixCache) {
+    char params[512];
+    sprintf(params, "images=%d topscale=%d twoway=%d progressive=%d "
+        "topscale_max=%d progressive_target=%d descriptor_type=%d "
+        "ransac_iters=%d probe=%d probe_size=%d probe_fraction=%.17g "
+        "probe_budget=%.17g scale_tolerance=%.17g orient_tolerance=%.17g",
+        numKeys, topscale, (int)twoWayGlobalMatch, (int)progressive, 
+        topscaleMax, progressiveTarget, (int)descType, budget.maxRansacIters,
+        (int)probe, probeSize, probeFraction, probeBudget, 
+        candidatePolicy.scaleTolerance, candidatePolicy.orientTolerance);
+    if(!fmatrixCache.open(fmatrixCacheName.c_str(), params, 
+          keyFileNames)) {
+      return -1;
+    }
+  }
 
-      if(numMatches >= 16) {
-        printf("Writing %d matches between images %d and %d\n", numMatches, j, i);
-        sort(matcher.matches.begin(), matcher.matches.end());
-        matchFile << j << " " << i << endl;
-        matchFile << numMatches << endl;
+  /// Without counters on this thread, the workers will not have them
+  PerfMonitor* perfMonitor = NULL;
+  if(perfCounters) {
+    perfMonitor = new PerfMonitor();
+    if(perfMonitor->getThreadGroup() == NULL) {
+      printf("[KeyMatchGeoAware] Hardware counters are not available "
+          "(see kernel.perf_event_paranoid), running without them\n");
+      delete perfMonitor;
+      perfMonitor = NULL;
+    }
+  }
 
-        for(int m=0; m < matcher.matches.size(); m++) {
-          matchFile << matcher.matches[m].first 
-            << " " << matcher.matches[m].second << endl;
-        }
-      }
+  StatsWriter statsFile;
+  if(!statsFileName.empty() && !statsFile.open(statsFileName.c_str(), 
+        statsFormat, perfMonitor != NULL)) {
+    return -1;
+  }
+
+  /// Pairs completed by an earlier run are skipped
+  vector< char > pairDone(pairs.size(), 0);
+  for(int p=0; p < (int)pairs.size() && checkpointing; p++) {
+    pairDone[p] = checkpoint.isDone(pairs[p]);
+  }
+
+  GraphMatchStages stages;
+  stages.pairs = &pairs;
+  stages.pairDone = &pairDone;
+  stages.widths = &widths;
+  stages.heights = &heights;
+  stages.keyCache = keyCache;
+  stages.keys = &keys;
+  stages.keysInfo = &keysInfo;
+  stages.numFeatures = &numFeatures;
+  stages.grids = &grids;
+  stages.globalTrees = &globalTrees;
+  stages.sketches = &sketches;
+  stages.descDim = descDim;
+  stages.descType = descType;
+  stages.topscale = topscale;
+  stages.treeTopscale = treeTopscale;
+  stages.twoWayGlobalMatch = twoWayGlobalMatch;
+  stages.progressive = progressive;
+  stages.topscaleMax = topscaleMax;
+  stages.progressiveTarget = progressiveTarget;
+  stages.probe = probe;
+  stages.probeSize = probeSize;
+  stages.probeFraction = probeFraction;
+  stages.probeBudget = probeBudget;
+  stages.emitPairs = emitPairs;
+  stages.replayThreshold = replayThreshold;
+  stages.replayDir = replayDir;
+  stages.budget = budget;
+  stages.skipOverBudget = skipOverBudget;
+  stages.candidatePolicy = candidatePolicy;
+  stages.fmatrixCache = useFMatrixCache ? &fmatrixCache : NULL;
+  stages.statsFile = statsFileName.empty() ? NULL : &statsFile;
+  stages.tracer = traceName.empty() ? NULL : new Tracer(traceEvents);
+  stages.perfMonitor = perfMonitor;
+  stages.statsTotal.clear();
+  stages.matchFile = &matchFile;
+  stages.checkpoint = &checkpoint;
+  stages.checkpointing = checkpointing;
+  stages.lastRecordStart = lastRecordStart;
+  stages.numGlobalQueries = 0;
+  stages.numProbedPairs = 0;
+  stages.numUnprobedPairs = 0;
+  stages.numPrunedPairs = 0;
+  stages.numProbeMisses = 0;
+  stages.numCachedPairs = 0;
+  stages.numOverBudget = 0;
+  stages.currRef = -1;
+  stages.start = WallTime();
+
+  /// Pairs are grouped by reference image, in a row or (tiled)
+  /// in short runs. Without a key cache there is nothing to prefetch.
+  if(keyCache == NULL) {
+    prefetchPairs = 0;
+  }
+  if(!RunPairPipeline(stages, pairs.size(), numThreads, 4*numThreads,
+        prefetchPairs)) {
+    return -1;
+  }
+  stages.finish();
+
+  vector< ImagePair >& selectedPairs = stages.selectedPairs;
+  lastRecordStart = stages.lastRecordStart;
+  if(emitPairs) {
+    if(!writePairList(emitPairListName.c_str(), selectedPairs)) {
+      return -1;
     }
+    printf("[KeyMatchGeoAware] Wrote %d of %d pairs to %s\n", 
+        (int)selectedPairs.size(), (int)pairs.size(), 
+        emitPairListName.c_str());
+  }
 
-    end = clock();    
-    printf("[KeyMatchGeoAware] Matching took %0.3fs\n", 
-        (end - start) / ((double) CLOCKS_PER_SEC));
-    fflush(stdout);
+  if(checkpointing && !checkpoint.commit(lastRecordStart, matchFile)) {
+    return -1;
+  }
+  if(!emitPairs && !matchFile.close()) {
+    printf("\nError writing match file %s\n", matchFileName.c_str());
+    return -1;
+  }
+  printf("[KeyMatchGeoAware] Global stage searched %lld features\n",
+      stages.numGlobalQueries);
+  if(keyCache != NULL) {
+    keyCache->printStats();
+  }
+  if(stages.tracer != NULL) {
+    if(!stages.tracer->write(traceName.c_str())) {
+      return -1;
+    }
+    printf("[KeyMatchGeoAware] Wrote trace to %s\n", traceName.c_str());
+    delete stages.tracer;
+  }
+  if(!statsFileName.empty()) {
+    PrintSearchStats("[KeyMatchGeoAware]", stages.statsTotal);
+  }
+  if(perfMonitor != NULL) {
+    PrintStagePerf("[KeyMatchGeoAware]", stages.statsTotal);
+    delete perfMonitor;
+  }
+  if(!statsFile.close()) {
+    printf("\nError writing statistics file %s\n", statsFileName.c_str());
+    return -1;
+  }
+  if(useFMatrixCache) {
+    if(!fmatrixCache.close()) {
+      return -1;
+    }
+    printf("[KeyMatchGeoAware] F-matrix cache reused %d pairs, "
+        "added %d pairs\n", stages.numCachedPairs, 
+        fmatrixCache.getNumAdded());
+  }
+  if(stages.numOverBudget > 0) {
+    printf("[KeyMatchGeoAware] %d pairs ran out of their budget\n",
+        stages.numOverBudget);
+  }
+  if(probe) {
+    printf("[KeyMatchGeoAware] Probe skipped %d of %d probed pairs, "
+        "%d pairs passed the probe but failed the global stage\n", 
+        stages.numPrunedPairs, stages.numProbedPairs, 
+        stages.numProbeMisses);
+    if(stages.numUnprobedPairs > 0) {
+      printf("[KeyMatchGeoAware] Warning: the probe could not reject %d "
+          "pairs, they have too few top-scale features for probe_budget\n",
+          stages.numUnprobedPairs);
+    }
   }
-  matchFile.close();
 
   /// Skiped Freeing keyfile memory due to performance issues
   /// Assuming program exits right afterwards
   /// Please free it if you intend to extend this code beyond this point
   
-  for(int i=0; i < numKeys; i++) {
-    delete[] keys[i];
-    delete[] keysInfo[i];
+  /// The key cache owns the keys and trees it loaded
+  for(int i=0; i < numKeys && keyCache == NULL; i++) {
+    delete globalTrees[i];
+    delete sketches[i];
+    if(!useKeyStore) {
+      delete[] keys[i];
+      delete[] keysInfo[i];
+    }
   }
+  delete keyCache;
 
   return 0;
 }
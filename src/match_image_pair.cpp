@@ -67,6 +67,10 @@ void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
   cmd.defineOption("save_visualization", "Saves Visualization", ArgvParser::NoOptionAttribute);
   cmd.defineOptionAlternative("save_visualization","s");
 
+  cmd.defineOption("descriptor_type", "Type of descriptor values in the key "
+      "files: uint8, uint16 or float32, [Default: uint8]", 
+      ArgvParser::OptionRequiresValue);
+
   string dummyArgv;
   vector< char* > argstr;
 
@@ -147,16 +151,31 @@ bool findMatches(ArgvParser& cmd) {
   int rH = atoi(rHeight.c_str());
   int rW = atoi(rWidth.c_str());
 
+  keydesc_t descType = KEY_UINT8;
+  if(cmd.foundOption("descriptor_type")) {
+    string str = cmd.optionValue("descriptor_type");
+    if(!ParseKeyDescriptorType(str.c_str(), &descType)) {
+      printf("\nUnknown descriptor type %s\n", str.c_str());
+      return false;
+    }
+  }
+
   unsigned char* queryKey;
   unsigned char* refKey;
   keypt_t* queryKeyInfo;
   keypt_t* refKeyInfo;
 
+  int qDim = 0, rDim = 0;
   int nPts1 = ReadKeyFile(keyPath1.c_str(),
-      &queryKey, &queryKeyInfo);
+      &queryKey, &queryKeyInfo, &qDim, descType);
 
   int nPts2 = ReadKeyFile(keyPath2.c_str(),
-      &refKey, &refKeyInfo);
+      &refKey, &refKeyInfo, &rDim, descType);
+
+  if(qDim != rDim) {
+    printf("\nDescriptor lengths do not match: %d vs %d\n", qDim, rDim);
+    return false;
+  }
 
   struct timeval t1, t2, t3;
   gettimeofday(&t1, NULL);
@@ -174,6 +193,8 @@ bool findMatches(ArgvParser& cmd) {
 
   /// Initialize Matcher
   match::FeatureMatcher matcher;
+  matcher.setDescriptorDim(qDim);
+  matcher.setDescriptorType(descType);
   matcher.queryImage = imread(imagePath1.c_str(),
       CV_LOAD_IMAGE_COLOR);
 
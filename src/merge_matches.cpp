@@ -0,0 +1,182 @@
+#include "defs.h"
+#include "argvparser.h"
+
+#include <stdio.h>
+
+using namespace CommandLineProcessing;
+
+/* Combines the match files written by match_graph --shard k/n (or by
+ * any runs over disjoint sets of pairs of the same images) into one
+ * file, ordered as a single run over all pairs writes it: by second
+ * image, then first image. The inputs may be in any order (e.g. tiled
+ * by --max_memory); the records are indexed first and then copied in 
+ * order, so only the index is held in memory. A single input just 
+ * gets sorted. */
+
+void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
+  cmd.setIntroductoryDescription("Merge match files of match-graph shards");
+
+  //define error codes
+  cmd.addErrorCode(0, "Success");
+  cmd.addErrorCode(1, "Error");
+
+  cmd.setHelpOption("h", "help",""); 
+
+  cmd.defineOption("shard_list", "List of match files (full paths) to "
+      "merge, one per line", ArgvParser::OptionRequired);
+
+  cmd.defineOption("matches_file", "Filename with path, merged match file",
+      ArgvParser::OptionRequired);
+
+  int result = cmd.parse(argc, argv);
+  if (result != ArgvParser::NoParserError)
+  {
+    cout << cmd.parseErrorDescription(result);
+    exit(1);
+  }
+}
+
+/* Position of one record in the input files */
+struct RecordRef {
+  int im1, im2;
+  int file;
+  long long offset;
+
+  bool operator<(const RecordRef& r) const {
+    if(im2 != r.im2) {
+      return im2 < r.im2;
+    }
+    return im1 < r.im1;
+  }
+};
+
+/*! \brief Adds the records of a match file to the index
+ **/
+static bool indexRecords(FILE* fp, int file, const char* fileName,
+    vector< RecordRef >& records) {
+  char line[256];
+  while(true) {
+    long long offset = ftello(fp);
+    if(fgets(line, sizeof(line), fp) == NULL) {
+      return true;
+    }
+    if(line[0] == '\n') {
+      continue;
+    }
+
+    RecordRef r;
+    int numMatches = 0;
+    if(sscanf(line, "%d %d", &r.im1, &r.im2) != 2 ||
+        fgets(line, sizeof(line), fp) == NULL || 
+        sscanf(line, "%d", &numMatches) != 1) {
+      printf("\nBad record at offset %lld of %s\n", offset, fileName);
+      return false;
+    }
+    for(int m=0; m < numMatches; m++) {
+      if(fgets(line, sizeof(line), fp) == NULL) {
+        printf("\nTruncated record <%d %d> in %s\n", r.im1, r.im2, 
+            fileName);
+        return false;
+      }
+    }
+
+    r.file = file;
+    r.offset = offset;
+    records.push_back(r);
+  }
+}
+
+/*! \brief Copies one record (header, match count and matches) to out
+ **/
+static bool copyRecord(FILE* fp, const RecordRef& r, FILE* out) {
+  char line[256];
+  int numMatches = 0;
+  if(fseeko(fp, r.offset, SEEK_SET) != 0 || 
+      fgets(line, sizeof(line), fp) == NULL) {
+    return false;
+  }
+  fputs(line, out);
+  if(fgets(line, sizeof(line), fp) == NULL || 
+      sscanf(line, "%d", &numMatches) != 1) {
+    return false;
+  }
+  fputs(line, out);
+  for(int m=0; m < numMatches; m++) {
+    if(fgets(line, sizeof(line), fp) == NULL) {
+      return false;
+    }
+    fputs(line, out);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+
+  ArgvParser cmd;
+  SetupCommandlineParser(cmd, argc, argv);
+
+  string shardList = cmd.optionValue("shard_list");
+  string matchFileName = cmd.optionValue("matches_file");
+
+  ifstream shardFile(shardList.c_str());
+  if(!shardFile.is_open()) {
+    cout << "\nError Opening File";
+    return -1;
+  }
+
+  vector< string > fileNames;
+  vector< FILE* > files;
+  vector< RecordRef > records;
+  string line;
+  while(getline(shardFile, line)) {
+    if(line.empty()) {
+      continue;
+    }
+    FILE* fp = fopen(line.c_str(), "r");
+    if(fp == NULL) {
+      printf("\nError opening match file %s\n", line.c_str());
+      return -1;
+    }
+    if(!indexRecords(fp, files.size(), line.c_str(), records)) {
+      return -1;
+    }
+    fileNames.push_back(line);
+    files.push_back(fp);
+  }
+
+  sort(records.begin(), records.end());
+  for(int r=1; r < (int)records.size(); r++) {
+    if(!(records[r-1] < records[r])) {
+      printf("\nPair <%d %d> is in both %s and %s\n", records[r].im1,
+          records[r].im2, fileNames[records[r-1].file].c_str(),
+          fileNames[records[r].file].c_str());
+      return -1;
+    }
+  }
+
+  FILE* out = fopen(matchFileName.c_str(), "w");
+  if(out == NULL) {
+    printf("\nError opening match file %s\n", matchFileName.c_str());
+    return -1;
+  }
+
+  for(int r=0; r < (int)records.size(); r++) {
+    if(!copyRecord(files[records[r].file], records[r], out)) {
+      printf("\nError reading record <%d %d> of %s\n", records[r].im1,
+          records[r].im2, fileNames[records[r].file].c_str());
+      return -1;
+    }
+  }
+
+  if(fclose(out) != 0) {
+    printf("\nError writing match file %s\n", matchFileName.c_str());
+    return -1;
+  }
+  printf("[MergeMatches] Merged %d records of %d files\n", 
+      (int)records.size(), (int)files.size());
+
+  for(int f=0; f < (int)files.size(); f++) {
+    fclose(files[f]);
+  }
+  return 0;
+}
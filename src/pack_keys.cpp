@@ -0,0 +1,104 @@
+#include "defs.h"
+#include "keys2a.h"
+#include "KeyStore.h"
+#include "argvparser.h"
+
+#include <stdio.h>
+#include <time.h>
+
+using namespace match;
+using namespace CommandLineProcessing;
+
+/* Packs the key files of a collection into a key store that
+ * match_graph --key_store maps read-only, so that several match_graph
+ * processes on a host share one copy of the keys. */
+
+void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
+  cmd.setIntroductoryDescription("Pack key files into a shared key store");
+
+  //define error codes
+  cmd.addErrorCode(0, "Success");
+  cmd.addErrorCode(1, "Error");
+
+  cmd.setHelpOption("h", "help",""); 
+
+  cmd.defineOption("key_store", "Name of the store, /name for a shared "
+      "memory object, else a file name", ArgvParser::OptionRequired);
+
+  cmd.defineOption("keyfile_list", "List of key files (full paths) in LOWE's" 
+      "format (ASCII text or gzipped), as passed to KeyMatchGeometryAware", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("descriptor_type", "Type of descriptor values in the key "
+      "files: uint8, uint16 or float32, [Default: uint8]", 
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("huge_pages", "Pad the store to a multiple of the huge "
+      "page size (2MB), [Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("remove", "Remove the store instead of packing it",
+      ArgvParser::NoOptionAttribute);
+
+  int result = cmd.parse(argc, argv);
+  if (result != ArgvParser::NoParserError)
+  {
+    cout << cmd.parseErrorDescription(result);
+    exit(1);
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  ArgvParser cmd;
+  SetupCommandlineParser(cmd, argc, argv);
+
+  string storeName = cmd.optionValue("key_store");
+
+  if(cmd.foundOption("remove")) {
+    if(!KeyStore::remove(storeName.c_str())) {
+      printf("\nError removing key store %s\n", storeName.c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+  if(!cmd.foundOption("keyfile_list")) {
+    printf("\nkeyfile_list is required for packing\n");
+    return -1;
+  }
+  string keyList = cmd.optionValue("keyfile_list");
+
+  keydesc_t descType = KEY_UINT8;
+  if(cmd.foundOption("descriptor_type")) {
+    string str = cmd.optionValue("descriptor_type");
+    if(!ParseKeyDescriptorType(str.c_str(), &descType)) {
+      printf("\nUnknown descriptor type %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  bool hugePages = cmd.foundOption("huge_pages");
+
+  ifstream keyFile(keyList.c_str());
+  if(!keyFile.is_open()) {
+    cout << "\nError Opening File";
+    return -1;
+  }
+
+  string line;
+  vector<string> keyFileNames;
+  while(getline(keyFile, line)) {
+    keyFileNames.push_back(line);
+  }
+
+  clock_t start = clock();
+  if(!KeyStore::pack(storeName.c_str(), keyFileNames, descType, 
+        hugePages)) {
+    return -1;
+  }
+  clock_t end = clock();    
+  printf("[PackKeys] Packed %d key files into %s in %0.3fs\n", 
+      (int)keyFileNames.size(), storeName.c_str(),
+      (end - start) / ((double) CLOCKS_PER_SEC));
+  return 0;
+}
@@ -0,0 +1,404 @@
+#include "defs.h"
+#include "Matcher.h"
+#include "keys2a.h"
+#include "Gridder.h"
+#include "Geometric.h"
+#include "ReplayBundle.h"
+#include "MatchFile.h"
+#include "MatchStats.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "argvparser.h"
+
+#include <stdio.h>
+
+using namespace match;
+using namespace CommandLineProcessing;
+
+/* Matches the pair of a replay bundle written by match_graph
+ * --replay_threshold again, by default the way the run matched it,
+ * with all statistics enabled. Options change the mode: start from the
+ * F of the run, other global stage settings, clusterPointsFast() or
+ * bfMatch(). */
+
+void SetupCommandlineParser(ArgvParser& cmd, int argc, char* argv[]) {
+  cmd.setIntroductoryDescription("Replay the matching of one pair");
+
+  //define error codes
+  cmd.addErrorCode(0, "Success");
+  cmd.addErrorCode(1, "Error");
+
+  cmd.setHelpOption("h", "help","");
+
+  cmd.defineOption("bundle", "Replay bundle written by match_graph",
+      ArgvParser::OptionRequired);
+
+  cmd.defineOption("repeat", "Number of runs, [Default: 1]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("use_f", "Skip the probe and global stage and match "
+      "with the F of the bundle, [Default: False]",
+      ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("topscale_percent", "Percentage of top scale features "
+      "to use for initial matching, [Default: as in the bundle]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("twoway_global_match", "Use two-way matching for "
+      "top-scale features, [Default: as in the bundle]",
+      ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("progressive_global", "Use progressive global "
+      "matching, [Default: as in the bundle]",
+      ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("no_probe", "Do not run the probe, [Default: as in "
+      "the bundle]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("min_candidates", "Pad smaller candidate sets, "
+      "[Default: as in the bundle]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("max_candidates", "Subsample larger candidate sets, "
+      "0 for no cap, [Default: as in the bundle]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("scale_tolerance", "Scale factor of the candidate "
+      "consistency filter, 0 for off, [Default: as in the bundle]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("orient_tolerance", "Orientation (degrees) of the "
+      "candidate consistency filter, 0 for off, [Default: as in the "
+      "bundle]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("sketch_keep", "Candidates per query ranked by their "
+      "sketches that get the exact distance, 0 for all, [Default: as in "
+      "the bundle]", ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("cluster_fast", "Group the epipolar lines with "
+      "clusterPointsFast(), [Default: False]",
+      ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("bf_match", "Match the candidates by brute force "
+      "(bfMatch()), [Default: False]", ArgvParser::NoOptionAttribute);
+
+  cmd.defineOption("matches_file", "Filename with path, write the "
+      "matches of the last run to this file in the text match format",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("stats_file", "Filename with path, write the "
+      "statistics of each run to this file",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("stats_format", "Layout of stats_file: json (one "
+      "object per line) or csv, [Default: json]",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("trace", "Filename with path, write a timeline of the "
+      "stages to this file, in the Chrome trace-event format",
+      ArgvParser::OptionRequiresValue);
+
+  cmd.defineOption("perf_counters", "Count cycles, instructions, last "
+      "level cache misses and branch misses of each matching stage, "
+      "[Default: False]", ArgvParser::NoOptionAttribute);
+
+  int result = cmd.parse(argc, argv);
+  if (result != ArgvParser::NoParserError)
+  {
+    cout << cmd.parseErrorDescription(result);
+    exit(1);
+  }
+}
+
+/* How the pair is matched, see GraphMatchStages::match() */
+struct ReplayMode {
+  ReplayParams params;
+  bool useF;
+  bool fastCluster;
+  bool bruteForce;
+};
+
+/*! \brief Matches the pair like match_graph does, returns the status
+ ** as named in the statistics file
+ **/
+static const char* replayPair(ReplayBundle& b, const ReplayMode& mode,
+    Gridder& srcGrid, Gridder& refGrid, const KeySketch* srcSketch, 
+    const KeySketch* refSketch, PairStats* stats,
+    vector< pair<int, int> >& matches) {
+  const ReplayParams& params = mode.params;
+
+  FeatureMatcher matcher;
+  matcher.setDescriptorType(b.type);
+  matcher.setDescriptorDim(b.dim);
+  matcher.setStats(stats);
+  matcher.setNumSrcPoints(b.numSrc);
+  matcher.setSrcKeys(b.srcInfo, b.srcKeys);
+  matcher.setNumRefPoints(b.numRef);
+  matcher.setRefKeys(b.refInfo, b.refKeys);
+  matcher.setQueryGrid(&srcGrid);
+  matcher.setRefGrid(&refGrid);
+  matcher.setSketches(srcSketch, refSketch);
+
+  vector< vector<double> > srcRectEdges;
+  vector< vector<double> > refRectEdges;
+  geometry::ComputeRectangleEdges((double)b.srcWidth, (double)b.srcHeight,
+      srcRectEdges);
+  geometry::ComputeRectangleEdges((double)b.refWidth, (double)b.refHeight,
+      refRectEdges);
+  matcher.setImageDims(b.srcWidth, b.srcHeight, b.refWidth, b.refHeight);
+  matcher.setSrcRectEdges(srcRectEdges);
+  matcher.setRefRectEdges(refRectEdges);
+
+  CandidatePolicy policy;
+  policy.minCandidates = params.minCandidates;
+  policy.maxCandidates = params.maxCandidates;
+  policy.scaleTolerance = params.scaleTolerance;
+  policy.orientTolerance = params.orientTolerance;
+  policy.sketchKeep = params.sketchKeep;
+  matcher.setCandidatePolicy(policy);
+
+  matches.clear();
+  vector< double > fMatrix(9);
+  if(mode.useF) {
+    fMatrix.assign(b.F, b.F + 9);
+  } else {
+    if(params.probe) {
+      int numTopSrc = (int)(b.numSrc*params.treeTopscale/100);
+      int numProbe = probeSampleSize(numTopSrc, params.probeSize,
+          params.probeFraction, 16, params.probeBudget);
+      int minProbe = probeRejectThreshold(numProbe, numTopSrc, 16,
+          params.probeBudget);
+      if(minProbe > 0 &&
+          matcher.probeMatch(params.treeTopscale, numProbe) < minProbe) {
+        return "pruned";
+      }
+    }
+
+    if(params.progressive) {
+      matcher.globalMatchProgressive(params.topscale, params.topscaleMax,
+          params.progressiveTarget, params.twoway != 0);
+    } else {
+      matcher.globalMatch(params.topscale, params.twoway != 0);
+    }
+    if(matcher.matches.size() < 16) {
+      return "no_global";
+    }
+    matcher.computeFmatrix(fMatrix.data());
+  }
+
+  matcher.setFMatrix(fMatrix);
+  matcher.computeEpipolarLines();
+  if(mode.fastCluster) {
+    matcher.clusterPointsFast();
+  } else {
+    matcher.clusterPoints();
+  }
+
+  matcher.setRandomSeed(params.seed);
+  if(mode.bruteForce) {
+    matcher.bfMatch();
+  } else {
+    matcher.match();
+  }
+  sort(matcher.matches.begin(), matcher.matches.end());
+  matches.swap(matcher.matches);
+  return "matched";
+}
+
+/*! \brief Prints the stage times and counters averaged over the runs
+ **/
+static void printStages(const PairStats& total, int runs) {
+  printf("[ReplayPair] Stage times per run\n");
+  for(int s=0; s < NUM_MATCH_STAGES; s++) {
+    printf("[ReplayPair]   %-12s %10.3f ms\n", MatchStageName(s),
+        total.stageTime[s]*1000.0/runs);
+  }
+  printf("[ReplayPair] Counters per run\n");
+  for(int c=0; c < NUM_MATCH_COUNTERS; c++) {
+    printf("[ReplayPair]   %-18s %12lld\n", MatchCounterName(c),
+        total.counters[c]/runs);
+  }
+}
+
+int main(int argc, char* argv[]) {
+
+  ArgvParser cmd;
+  SetupCommandlineParser(cmd, argc, argv);
+
+  ReplayBundle bundle;
+  string bundleName = cmd.optionValue("bundle");
+  if(!bundle.read(bundleName.c_str())) {
+    return -1;
+  }
+
+  ReplayMode mode;
+  mode.params = bundle.params;
+  mode.useF = cmd.foundOption("use_f");
+  mode.fastCluster = cmd.foundOption("cluster_fast");
+  mode.bruteForce = cmd.foundOption("bf_match");
+  if(cmd.foundOption("topscale_percent")) {
+    string str = cmd.optionValue("topscale_percent");
+    mode.params.topscale = atoi(str.c_str());
+  }
+  if(cmd.foundOption("twoway_global_match")) {
+    mode.params.twoway = 1;
+  }
+  if(cmd.foundOption("progressive_global")) {
+    mode.params.progressive = 1;
+  }
+  if(cmd.foundOption("no_probe")) {
+    mode.params.probe = 0;
+  }
+  if(cmd.foundOption("min_candidates")) {
+    string str = cmd.optionValue("min_candidates");
+    mode.params.minCandidates = atoi(str.c_str());
+  }
+  if(cmd.foundOption("max_candidates")) {
+    string str = cmd.optionValue("max_candidates");
+    mode.params.maxCandidates = atoi(str.c_str());
+  }
+  if(mode.params.minCandidates < 2) {
+    printf("\nmin_candidates must be at least 2\n");
+    return -1;
+  }
+  if(mode.params.maxCandidates < 0 || (mode.params.maxCandidates > 0 &&
+        mode.params.maxCandidates < mode.params.minCandidates)) {
+    printf("\nmax_candidates must be 0 or at least min_candidates\n");
+    return -1;
+  }
+  if(cmd.foundOption("scale_tolerance")) {
+    string str = cmd.optionValue("scale_tolerance");
+    mode.params.scaleTolerance = atof(str.c_str());
+  }
+  if(cmd.foundOption("orient_tolerance")) {
+    string str = cmd.optionValue("orient_tolerance");
+    mode.params.orientTolerance = atof(str.c_str())*M_PI/180.0;
+  }
+  if(cmd.foundOption("sketch_keep")) {
+    string str = cmd.optionValue("sketch_keep");
+    mode.params.sketchKeep = atoi(str.c_str());
+  }
+  if(mode.params.sketchKeep == 1) {
+    printf("\nsketch_keep must be 0 or at least 2\n");
+    return -1;
+  }
+  mode.params.treeTopscale = mode.params.progressive ?
+    mode.params.topscaleMax : mode.params.topscale;
+
+  if(mode.useF && !bundle.hasF) {
+    printf("\nThe bundle has no F, the run did not match the pair\n");
+    return -1;
+  }
+
+  int repeat = 1;
+  if(cmd.foundOption("repeat")) {
+    string str = cmd.optionValue("repeat");
+    repeat = atoi(str.c_str());
+    repeat = repeat > 1 ? repeat : 1;
+  }
+
+  statsformat_t statsFormat = STATS_JSON;
+  if(cmd.foundOption("stats_format")) {
+    string str = cmd.optionValue("stats_format");
+    if(!ParseStatsFormat(str.c_str(), &statsFormat)) {
+      printf("\nUnknown statistics format %s\n", str.c_str());
+      return -1;
+    }
+  }
+
+  PerfMonitor* perfMonitor = NULL;
+  if(cmd.foundOption("perf_counters")) {
+    perfMonitor = new PerfMonitor();
+    if(perfMonitor->getThreadGroup() == NULL) {
+      printf("[ReplayPair] Hardware counters are not available, "
+          "running without them\n");
+      delete perfMonitor;
+      perfMonitor = NULL;
+    }
+  }
+
+  StatsWriter statsFile;
+  bool writeStats = cmd.foundOption("stats_file");
+  if(writeStats && !statsFile.open(cmd.optionValue("stats_file").c_str(),
+        statsFormat, perfMonitor != NULL)) {
+    return -1;
+  }
+
+  Tracer* tracer = cmd.foundOption("trace") ?
+    new Tracer(DEFAULT_TRACE_EVENTS) : NULL;
+
+  printf("[ReplayPair] Pair %d-%d, %d and %d features, took %0.3fs with "
+      "%d matches when recorded\n", bundle.im1, bundle.im2, bundle.numSrc,
+      bundle.numRef, bundle.seconds, bundle.numMatches);
+
+  Gridder srcGrid(16, bundle.srcWidth, bundle.srcHeight, bundle.numSrc,
+      bundle.srcInfo);
+  Gridder refGrid(16, bundle.refWidth, bundle.refHeight, bundle.numRef,
+      bundle.refInfo);
+
+  /// Sketches are built at load time, outside the timed runs
+  KeySketch srcSketch, refSketch;
+  bool useSketches = mode.params.sketchKeep > 0;
+  if(useSketches) {
+    srcSketch.init(bundle.srcKeys, bundle.numSrc, bundle.dim, bundle.type);
+    refSketch.init(bundle.refKeys, bundle.numRef, bundle.dim, bundle.type);
+  }
+
+  PairStats total;
+  total.clear();
+  vector< pair<int, int> > matches;
+  for(int r=0; r < repeat; r++) {
+    TraceBuffer* trace = tracer != NULL ? tracer->getThreadBuffer() : NULL;
+    TraceSpan span(trace, "pair", r);
+
+    PairStats stats;
+    stats.clear();
+    stats.im1 = bundle.im1;
+    stats.im2 = bundle.im2;
+    stats.trace = trace;
+    stats.pair = r;
+    stats.perf = perfMonitor != NULL ? perfMonitor->getThreadGroup() : NULL;
+
+    StageMark pairMark;
+    stats.beginPair(&pairMark);
+    double start = WallTime();
+    const char* status = replayPair(bundle, mode, srcGrid, refGrid, 
+        useSketches ? &srcSketch : NULL, useSketches ? &refSketch : NULL,
+        &stats, matches);
+    double seconds = WallTime() - start;
+    stats.endPair(pairMark);
+
+    printf("[ReplayPair] Run %d: %0.3fs, %s, %d matches\n", r + 1, seconds,
+        status, (int)matches.size());
+    if(writeStats) {
+      statsFile.write(stats, status, matches.size());
+    }
+    total.add(stats);
+  }
+
+  printStages(total, repeat);
+  PrintSearchStats("[ReplayPair]", total);
+  if(perfMonitor != NULL) {
+    PrintStagePerf("[ReplayPair]", total);
+    delete perfMonitor;
+  }
+
+  bool ok = true;
+  if(cmd.foundOption("matches_file")) {
+    MatchWriter matchFile;
+    string str = cmd.optionValue("matches_file");
+    ok = matchFile.open(str.c_str(), MATCH_TEXT, false);
+    if(ok) {
+      matchFile.writeRecord(bundle.im1, bundle.im2, matches);
+      ok = matchFile.close();
+    }
+  }
+  if(tracer != NULL) {
+    string str = cmd.optionValue("trace");
+    ok = tracer->write(str.c_str()) && ok;
+    delete tracer;
+  }
+  if(writeStats) {
+    ok = statsFile.close() && ok;
+  }
+  return ok ? 0 : -1;
+}